@@ -0,0 +1,31 @@
+/*========================================================================
+ * File: AllocationCounter.cpp
+ * Purpose: global operator new and delete that count bytes for the
+ *          profiler; linked only into the programs that profile
+ *======================================================================*/
+#include <cstdlib>
+#include <new>
+#include "AllocationCounter.h"
+
+// The array, nothrow and sized forms all end up here or in free. There
+// is no aligned operator new before C++17, so there is nothing else to
+// count.
+void* operator new(size_t size)
+{
+    if (allocationCountingProfilers.load(std::memory_order_relaxed) > 0) {
+        allocationCountedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,23 @@
+/*========================================================================
+ * File: AllocationCounter.h
+ * Purpose: state shared by the profiler and the optional allocation
+ *          hook
+ *======================================================================*/
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Defined in Profiler.cpp. FrameProfilers that exist right now; the
+// hook counts while this is above zero.
+extern std::atomic<int> allocationCountingProfilers;
+
+// Bytes counted by the hook. AllocationCounter.cpp replaces the global
+// operator new and delete, so it is not part of treegen. A program
+// that wants allocation counts lists it among its own sources. Other
+// programs keep the standard allocator (or jemalloc, or a sanitizer's),
+// and this stays 0.
+extern std::atomic<uint64_t> allocationCountedBytes;
+
+#endif // ALLOCATIONCOUNTER_H
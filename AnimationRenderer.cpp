@@ -0,0 +1,125 @@
+/*========================================================================
+ * File: AnimationRenderer.cpp
+ * Purpose: implementation of the frame-parallel animation renderer
+ *======================================================================*/
+#include "AnimationRenderer.h"
+#include <algorithm>
+#include <chrono>
+#include "CompactSegments.h"
+#include "SoftwareRasterizer.h"
+#include "SpecializedGenerator.h"
+#include "TreeAnimation.h"
+
+namespace {
+    // Frames in flight per worker: enough for stealing to even out
+    // frames of different branch counts
+    const int FRAMES_PER_THREAD = 4;
+}
+
+// Buffers kept by one pool thread between tasks
+struct AnimationRenderer::Worker {
+    CompactSegmentStore lines;
+    std::unique_ptr<SoftwareRasterizer> rasterizer;
+};
+
+AnimationRenderer::AnimationRenderer(int threads)
+    : pool(threads), tilt(20.0), maxDepth(7), stochastic(false),
+      variation(defaultTreeVariation(0)), stats()
+{
+    for (int i = 0; i < pool.ThreadCount(); i++) {
+        workers.emplace_back(new Worker());
+    }
+}
+
+AnimationRenderer::~AnimationRenderer()
+{
+}
+
+void AnimationRenderer::SetVariation(const TreeVariation& v)
+{
+    variation = v;
+    stochastic = true;
+}
+
+bool AnimationRenderer::Run(const TreeParams& base, long first, long count, VideoWriter& writer)
+{
+    stats = AnimationStats();
+    for (auto& worker : workers) {
+        if (!worker->rasterizer || worker->rasterizer->Width() != writer.Width()
+            || worker->rasterizer->Height() != writer.Height()) {
+            worker->rasterizer.reset(new SoftwareRasterizer(writer.Width(), writer.Height(), 1));
+        }
+    }
+
+    long batch = (long)pool.ThreadCount() * FRAMES_PER_THREAD;
+    std::vector<Slot> slots[2];
+    slots[0].resize(batch);
+    slots[1].resize(batch);
+
+    int current = 0;
+    submitBatch(base, first, std::min(batch, count), writer, slots[current]);
+    bool ok = true;
+    for (long done = 0; done < count; done += batch) {
+        pool.Wait();
+        long size = std::min(batch, count - done);
+
+        // The next batch renders while this one is written
+        long next = done + batch;
+        if (next < count) {
+            submitBatch(base, first + next, std::min(batch, count - next), writer,
+                        slots[1 - current]);
+        }
+        for (long i = 0; i < size; i++) {
+            const Slot& slot = slots[current][i];
+            if (ok && !writer.WriteFrame(slot.encoded)) ok = false;
+            stats.frames++;
+            stats.segments += slot.segments;
+            stats.generateMs += slot.generateMs;
+            stats.renderMs += slot.renderMs;
+        }
+        current = 1 - current;
+    }
+    pool.Wait();
+    return ok;
+}
+
+void AnimationRenderer::submitBatch(const TreeParams& base, long first, long count,
+                                    const VideoWriter& writer, std::vector<Slot>& slots)
+{
+    for (long i = 0; i < count; i++) {
+        Slot* slot = &slots[i];
+        long frame = first + i;
+        pool.Submit([this, &base, &writer, slot, frame]() {
+            renderOne(*workers[WorkStealingPool::CurrentWorker()], base, frame, writer, *slot);
+        });
+    }
+}
+
+void AnimationRenderer::renderOne(Worker& worker, const TreeParams& base, long frame,
+                                  const VideoWriter& writer, Slot& slot)
+{
+    auto start = std::chrono::steady_clock::now();
+    double rotation;
+    TreeParams params = TreeAnimation(base).AtFrame(frame, 1.0 / writer.FrameRate(), rotation);
+    worker.lines.Clear();
+    if (stochastic) {
+        generateStochasticTree(params, variation, maxDepth, worker.lines);
+    } else {
+        generateTreeSpecialized(params, maxDepth, worker.lines);
+    }
+    auto generated = std::chrono::steady_clock::now();
+
+    ViewParams view = defaultViewParams(writer.Width(), writer.Height());
+    view.rotationX = tilt;
+    view.rotationY = rotation;
+    SoftwareRasterizer& rasterizer = *worker.rasterizer;
+    rasterizer.SetView(view);
+    rasterizer.Clear(0.0f, 0.0f, 0.0f);
+    rasterizer.DrawLines(worker.lines);
+    writer.Encode(rasterizer.Pixels().data(), slot.encoded);
+
+    slot.segments = worker.lines.Size();
+    slot.generateMs = std::chrono::duration<double, std::milli>(generated - start).count();
+    slot.renderMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - generated).count();
+}
@@ -0,0 +1,79 @@
+/*========================================================================
+ * File: AnimationRenderer.h
+ * Purpose: offline rendering of the viewer's animation, many frames at
+ *          once, streamed in order as video
+ *======================================================================*/
+#ifndef ANIMATIONRENDERER_H
+#define ANIMATIONRENDERER_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "StochasticTree.h"
+#include "ThreadPool.h"
+#include "TreeGenerator.h"
+#include "VideoWriter.h"
+#include "View.h"
+
+// Totals of one run
+struct AnimationStats {
+    long frames;
+    size_t segments;
+    double generateMs;          // summed over the workers
+    double renderMs;            // rasterizing and encoding, summed
+};
+
+// Every frame is one task on a work-stealing pool. The frame's
+// parameters and rotation come straight from TreeAnimation::AtFrame, so
+// frames do not depend on each other. A worker keeps its segment store
+// and single-threaded rasterizer between tasks, and encodes the frame
+// itself. Frames are rendered in batches of a few per thread. The
+// calling thread writes one batch in frame order while the pool renders
+// the next, so memory stays bounded by two batches.
+class AnimationRenderer
+{
+    public:
+        // threads <= 0 uses the hardware concurrency
+        explicit AnimationRenderer(int threads = 0);
+        ~AnimationRenderer();
+
+        // View rotation X is the viewer's tilt; the animation turns Y
+        void SetTilt(double degrees) { tilt = degrees; }
+        void SetDepth(int depth) { maxDepth = depth; }
+        void SetVariation(const TreeVariation& v);
+
+        // Renders frames [first, first + count) of base's animation at
+        // the writer's size and frame rate. Returns false if a frame
+        // could not be written.
+        bool Run(const TreeParams& base, long first, long count, VideoWriter& writer);
+
+        int ThreadCount() const { return pool.ThreadCount(); }
+        const AnimationStats& Stats() const { return stats; }
+
+    private:
+        struct Worker;
+        struct Slot {
+            std::vector<uint8_t> encoded;
+            size_t segments;
+            double generateMs;
+            double renderMs;
+        };
+
+        WorkStealingPool pool;
+        std::vector<std::unique_ptr<Worker>> workers;
+        double tilt;
+        int maxDepth;
+        bool stochastic;
+        TreeVariation variation;
+        AnimationStats stats;
+
+        void submitBatch(const TreeParams& base, long first, long count,
+                         const VideoWriter& writer, std::vector<Slot>& slots);
+        void renderOne(Worker& worker, const TreeParams& base, long frame,
+                       const VideoWriter& writer, Slot& slot);
+
+        AnimationRenderer(const AnimationRenderer&);
+        AnimationRenderer& operator=(const AnimationRenderer&);
+};
+
+#endif // ANIMATIONRENDERER_H
@@ -0,0 +1,404 @@
+/*========================================================================
+ * File: BranchBVH.cpp
+ * Purpose: implementation of the branch bounding volume hierarchy
+ *======================================================================*/
+#include "BranchBVH.h"
+#include <algorithm>
+#include <cmath>
+#include "ThreadPool.h"
+
+namespace {
+    // Subtrees with fewer capsules are built on the calling thread
+    const uint32_t PARALLEL_MIN = 8192;
+
+    // Nodes of a subtree over count capsules (median split)
+    uint32_t subtreeNodes(uint32_t count)
+    {
+        if (count <= (uint32_t)BranchBVH::LEAF_SIZE) return 1;
+        return 1 + subtreeNodes(count / 2) + subtreeNodes(count - count / 2);
+    }
+
+    float capsuleRadius(int width, double radiusPerWidth)
+    {
+        return (float)(0.5 * (width < 1 ? 1 : width) * radiusPerWidth);
+    }
+
+    float centroid(const BranchCapsule& c, int axis)
+    {
+        return 0.5f * (c.a[axis] + c.b[axis]);
+    }
+
+    double dot(const double u[3], const double v[3])
+    {
+        return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+    }
+
+    // Entry distance of the ray into a box, or false if it misses
+    bool rayBox(const double origin[3], const double inverse[3],
+                const float lo[3], const float hi[3], double limit, double& enter)
+    {
+        double tMin = 0.0;
+        double tMax = limit;
+        for (int i = 0; i < 3; i++) {
+            double t0 = (lo[i] - origin[i]) * inverse[i];
+            double t1 = (hi[i] - origin[i]) * inverse[i];
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > tMin) tMin = t0;
+            if (t1 < tMax) tMax = t1;
+            if (tMin > tMax) return false;
+        }
+        enter = tMin;
+        return true;
+    }
+
+    // Closest approach of a ray (unit direction) and a segment:
+    // the squared distance, and where along the ray it is
+    double raySegment(const double origin[3], const double direction[3],
+                      const BranchCapsule& c, double& t)
+    {
+        double u[3], w[3];
+        for (int i = 0; i < 3; i++) {
+            u[i] = (double)c.b[i] - c.a[i];
+            w[i] = (double)c.a[i] - origin[i];
+        }
+        double a = dot(u, u);
+        double b = dot(u, direction);
+        double d = dot(u, w);
+        double e = dot(direction, w);
+        double denominator = a - b * b;
+
+        double s = 0.0;
+        if (denominator > 1e-12) {
+            s = std::min(1.0, std::max(0.0, (b * e - d) / denominator));
+        }
+        t = b * s + e;
+        if (t < 0.0) {
+            t = 0.0;
+            s = a > 0.0 ? std::min(1.0, std::max(0.0, -d / a)) : 0.0;
+        }
+
+        double squared = 0.0;
+        for (int i = 0; i < 3; i++) {
+            double delta = c.a[i] + s * u[i] - (origin[i] + t * direction[i]);
+            squared += delta * delta;
+        }
+        return squared;
+    }
+
+    double pointSegmentSquared(const double p[3], const BranchCapsule& c)
+    {
+        double u[3], w[3];
+        for (int i = 0; i < 3; i++) {
+            u[i] = (double)c.b[i] - c.a[i];
+            w[i] = p[i] - c.a[i];
+        }
+        double a = dot(u, u);
+        double s = a > 0.0 ? std::min(1.0, std::max(0.0, dot(w, u) / a)) : 0.0;
+        double squared = 0.0;
+        for (int i = 0; i < 3; i++) {
+            double delta = w[i] - s * u[i];
+            squared += delta * delta;
+        }
+        return squared;
+    }
+
+    // Slab clip of the segment against the box grown by the radius
+    bool segmentInBox(const BranchCapsule& c, const double lo[3], const double hi[3])
+    {
+        double s0 = 0.0;
+        double s1 = 1.0;
+        for (int i = 0; i < 3; i++) {
+            double from = c.a[i];
+            double delta = (double)c.b[i] - c.a[i];
+            double boxLo = lo[i] - c.radius;
+            double boxHi = hi[i] + c.radius;
+            if (delta == 0.0) {
+                if (from < boxLo || from > boxHi) return false;
+                continue;
+            }
+            double t0 = (boxLo - from) / delta;
+            double t1 = (boxHi - from) / delta;
+            if (t0 > t1) std::swap(t0, t1);
+            s0 = std::max(s0, t0);
+            s1 = std::min(s1, t1);
+            if (s0 > s1) return false;
+        }
+        return true;
+    }
+}
+
+bool rayHitsCapsule(const double origin[3], const double direction[3],
+                    const BranchCapsule& capsule, double& distance)
+{
+    return raySegment(origin, direction, capsule, distance)
+        <= (double)capsule.radius * capsule.radius;
+}
+
+BranchBVH::BranchBVH(WorkStealingPool* workers)
+    : pool(workers)
+{
+}
+
+void BranchBVH::Build(const CompactSegmentStore& segments, double radiusPerWidth)
+{
+    setCapsules(segments, radiusPerWidth);
+    buildHierarchy();
+}
+
+void BranchBVH::Build(const Segment3D* segments, size_t count, double radiusPerWidth)
+{
+    setCapsules(segments, count, radiusPerWidth);
+    buildHierarchy();
+}
+
+bool BranchBVH::Refit(const CompactSegmentStore& segments, double radiusPerWidth)
+{
+    if (segments.Size() != capsules.size()) return false;
+    setCapsules(segments, radiusPerWidth);
+    refitBounds();
+    return true;
+}
+
+bool BranchBVH::Refit(const Segment3D* segments, size_t count, double radiusPerWidth)
+{
+    if (count != capsules.size()) return false;
+    setCapsules(segments, count, radiusPerWidth);
+    refitBounds();
+    return true;
+}
+
+void BranchBVH::setCapsules(const CompactSegmentStore& segments, double radiusPerWidth)
+{
+    capsules.resize(segments.Size());
+    float p[6];
+    for (size_t i = 0; i < capsules.size(); i++) {
+        const CompactSegment& s = segments.Segments()[i];
+        segments.Decode(s, p);
+        BranchCapsule& c = capsules[i];
+        std::copy(p, p + 3, c.a);
+        std::copy(p + 3, p + 6, c.b);
+        c.radius = capsuleRadius(segments.StyleOf(s).width, radiusPerWidth);
+    }
+}
+
+void BranchBVH::setCapsules(const Segment3D* segments, size_t count, double radiusPerWidth)
+{
+    capsules.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const Segment3D& s = segments[i];
+        BranchCapsule& c = capsules[i];
+        c.a[0] = (float)s.x1; c.a[1] = (float)s.y1; c.a[2] = (float)s.z1;
+        c.b[0] = (float)s.x2; c.b[1] = (float)s.y2; c.b[2] = (float)s.z2;
+        c.radius = capsuleRadius(s.width, radiusPerWidth);
+    }
+}
+
+void BranchBVH::buildHierarchy()
+{
+    uint32_t count = (uint32_t)capsules.size();
+    order.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    nodes.clear();
+    if (count == 0) return;
+
+    nodes.resize(subtreeNodes(count));
+    buildNode(0, 0, count);
+    if (pool) pool->Wait();
+    refitBounds();
+}
+
+// Only the split is decided here; bounds are filled in by refitBounds
+void BranchBVH::buildNode(uint32_t index, uint32_t first, uint32_t count)
+{
+    Node& node = nodes[index];
+    if (count <= (uint32_t)LEAF_SIZE) {
+        node.start = first;
+        node.count = count;
+        return;
+    }
+
+    float lo[3], hi[3];
+    for (int axis = 0; axis < 3; axis++) {
+        lo[axis] = hi[axis] = centroid(capsules[order[first]], axis);
+    }
+    for (uint32_t i = first + 1; i < first + count; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            float c = centroid(capsules[order[i]], axis);
+            lo[axis] = std::min(lo[axis], c);
+            hi[axis] = std::max(hi[axis], c);
+        }
+    }
+    int axis = 0;
+    for (int i = 1; i < 3; i++) {
+        if (hi[i] - lo[i] > hi[axis] - lo[axis]) axis = i;
+    }
+
+    uint32_t half = count / 2;
+    const std::vector<BranchCapsule>& all = capsules;
+    std::nth_element(order.begin() + first, order.begin() + first + half,
+                     order.begin() + first + count,
+                     [&all, axis](uint32_t x, uint32_t y) {
+                         float cx = centroid(all[x], axis);
+                         float cy = centroid(all[y], axis);
+                         return cx < cy || (cx == cy && x < y);
+                     });
+
+    uint32_t left = index + 1;
+    uint32_t right = left + subtreeNodes(half);
+    node.start = right;
+    node.count = 0;
+
+    if (pool && half >= PARALLEL_MIN) {
+        pool->Submit([this, left, first, half]() { buildNode(left, first, half); });
+    } else {
+        buildNode(left, first, half);
+    }
+    buildNode(right, first + half, count - half);
+}
+
+// Children follow their parent in pre-order, so a backward pass sees
+// every child before its parent
+void BranchBVH::refitBounds()
+{
+    for (size_t n = nodes.size(); n-- > 0;) {
+        Node& node = nodes[n];
+        if (node.count > 0) {
+            const BranchCapsule& first = capsules[order[node.start]];
+            for (int axis = 0; axis < 3; axis++) {
+                node.lo[axis] = std::min(first.a[axis], first.b[axis]) - first.radius;
+                node.hi[axis] = std::max(first.a[axis], first.b[axis]) + first.radius;
+            }
+            for (uint32_t i = 1; i < node.count; i++) {
+                const BranchCapsule& c = capsules[order[node.start + i]];
+                for (int axis = 0; axis < 3; axis++) {
+                    node.lo[axis] = std::min(node.lo[axis], std::min(c.a[axis], c.b[axis]) - c.radius);
+                    node.hi[axis] = std::max(node.hi[axis], std::max(c.a[axis], c.b[axis]) + c.radius);
+                }
+            }
+        } else {
+            const Node& left = nodes[n + 1];
+            const Node& right = nodes[node.start];
+            for (int axis = 0; axis < 3; axis++) {
+                node.lo[axis] = std::min(left.lo[axis], right.lo[axis]);
+                node.hi[axis] = std::max(left.hi[axis], right.hi[axis]);
+            }
+        }
+    }
+}
+
+bool BranchBVH::Pick(const double origin[3], const double direction[3], BranchHit& hit) const
+{
+    if (nodes.empty()) return false;
+
+    double inverse[3];
+    for (int i = 0; i < 3; i++) {
+        inverse[i] = direction[i] != 0.0 ? 1.0 / direction[i] : HUGE_VAL;
+    }
+
+    bool found = false;
+    double best = HUGE_VAL;
+    uint32_t bestSegment = 0;
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const Node& node = nodes[index];
+        double enter;
+        if (!rayBox(origin, inverse, node.lo, node.hi, best, enter)) continue;
+
+        if (node.count == 0) {
+            stack[top++] = index + 1;
+            stack[top++] = node.start;
+            continue;
+        }
+        for (uint32_t i = 0; i < node.count; i++) {
+            uint32_t segment = order[node.start + i];
+            const BranchCapsule& c = capsules[segment];
+            double t;
+            if (!rayHitsCapsule(origin, direction, c, t)) continue;
+            if (t < best || (t == best && segment < bestSegment)) {
+                best = t;
+                bestSegment = segment;
+                found = true;
+            }
+        }
+    }
+
+    if (found) {
+        hit.segment = bestSegment;
+        hit.distance = best;
+    }
+    return found;
+}
+
+void BranchBVH::QuerySphere(const double center[3], double radius, std::vector<uint32_t>& out) const
+{
+    if (nodes.empty()) return;
+
+    size_t before = out.size();
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const Node& node = nodes[index];
+
+        double squared = 0.0;
+        for (int axis = 0; axis < 3; axis++) {
+            double outside = std::max(std::max(node.lo[axis] - center[axis],
+                                               center[axis] - node.hi[axis]), 0.0);
+            squared += outside * outside;
+        }
+        if (squared > radius * radius) continue;
+
+        if (node.count == 0) {
+            stack[top++] = index + 1;
+            stack[top++] = node.start;
+            continue;
+        }
+        for (uint32_t i = 0; i < node.count; i++) {
+            uint32_t segment = order[node.start + i];
+            double reach = radius + capsules[segment].radius;
+            if (pointSegmentSquared(center, capsules[segment]) <= reach * reach) {
+                out.push_back(segment);
+            }
+        }
+    }
+    std::sort(out.begin() + before, out.end());
+}
+
+void BranchBVH::QueryBox(const double lo[3], const double hi[3], std::vector<uint32_t>& out) const
+{
+    if (nodes.empty()) return;
+
+    size_t before = out.size();
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const Node& node = nodes[index];
+
+        bool overlaps = true;
+        for (int axis = 0; axis < 3; axis++) {
+            if (node.lo[axis] > hi[axis] || node.hi[axis] < lo[axis]) overlaps = false;
+        }
+        if (!overlaps) continue;
+
+        if (node.count == 0) {
+            stack[top++] = index + 1;
+            stack[top++] = node.start;
+            continue;
+        }
+        for (uint32_t i = 0; i < node.count; i++) {
+            uint32_t segment = order[node.start + i];
+            if (segmentInBox(capsules[segment], lo, hi)) {
+                out.push_back(segment);
+            }
+        }
+    }
+    std::sort(out.begin() + before, out.end());
+}
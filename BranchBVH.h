@@ -0,0 +1,104 @@
+/*========================================================================
+ * File: BranchBVH.h
+ * Purpose: bounding volume hierarchy over generated branches for
+ *          picking and range queries
+ *======================================================================*/
+#ifndef BRANCHBVH_H
+#define BRANCHBVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "CompactSegments.h"
+#include "SegmentSink.h"
+
+class WorkStealingPool;
+
+// A branch as a capsule: the segment a-b swept by a sphere whose radius
+// is half its line width, converted to world units
+struct BranchCapsule {
+    float a[3];
+    float b[3];
+    float radius;
+};
+
+struct BranchHit {
+    uint32_t segment;       // index in the indexed segment set
+    double distance;        // along the ray to the closest approach
+};
+
+// Whether a ray (unit direction) passes through one capsule, and how far
+// along it the closest approach to the segment lies
+bool rayHitsCapsule(const double origin[3], const double direction[3],
+                    const BranchCapsule& capsule, double& distance);
+
+// Binary BVH with up to LEAF_SIZE capsules per leaf. Nodes are split at
+// the median centroid along the widest axis and stored in pre-order;
+// since a subtree's node count depends only on its capsule count, each
+// subtree's slots are known before it is built, and the top subtrees
+// are built in parallel on the pool without locking. The layout is the
+// same whatever the thread count.
+//
+// When the same set of segments has only moved (the animation changed
+// lambda, angle or factor but not the topology), Refit recomputes the
+// bounds bottom-up in one linear pass and keeps the hierarchy.
+class BranchBVH
+{
+    public:
+        static const int LEAF_SIZE = 4;
+
+        // Without a pool the build is serial
+        explicit BranchBVH(WorkStealingPool* pool = nullptr);
+
+        // radiusPerWidth converts line widths (pixels) to world units,
+        // e.g. viewUnitsPerPixel of the view the lines are drawn with
+        void Build(const CompactSegmentStore& segments, double radiusPerWidth);
+        void Build(const Segment3D* segments, size_t count, double radiusPerWidth);
+
+        // Same segments in the same order, moved. Returns false (and
+        // changes nothing) when the count differs from the built one.
+        bool Refit(const CompactSegmentStore& segments, double radiusPerWidth);
+        bool Refit(const Segment3D* segments, size_t count, double radiusPerWidth);
+
+        size_t Size() const { return capsules.size(); }
+        size_t NodeCount() const { return nodes.size(); }
+        const BranchCapsule& Capsule(uint32_t segment) const { return capsules[segment]; }
+
+        // Nearest capsule the ray passes through; direction must be unit
+        // length. Ties go to the lower segment index.
+        bool Pick(const double origin[3], const double direction[3], BranchHit& hit) const;
+
+        // Appends, in increasing order, the capsules overlapping a sphere
+        // or an axis-aligned box. A capsule counts as inside the box when
+        // its segment crosses the box grown by the radius, which is
+        // slightly generous at the box corners.
+        void QuerySphere(const double center[3], double radius, std::vector<uint32_t>& out) const;
+        void QueryBox(const double lo[3], const double hi[3], std::vector<uint32_t>& out) const;
+
+    private:
+        // Leaves hold count > 0 capsules from order[start]; internal
+        // nodes have count 0, the left child next and the right child
+        // at start
+        struct Node {
+            float lo[3];
+            float hi[3];
+            uint32_t start;
+            uint32_t count;
+        };
+
+        WorkStealingPool* pool;
+        std::vector<BranchCapsule> capsules;
+        std::vector<uint32_t> order;
+        std::vector<Node> nodes;
+
+        void setCapsules(const CompactSegmentStore& segments, double radiusPerWidth);
+        void setCapsules(const Segment3D* segments, size_t count, double radiusPerWidth);
+        void buildHierarchy();
+        void buildNode(uint32_t index, uint32_t first, uint32_t count);
+        void refitBounds();
+
+        BranchBVH(const BranchBVH&);
+        BranchBVH& operator=(const BranchBVH&);
+};
+
+#endif // BRANCHBVH_H
@@ -0,0 +1,145 @@
+/*========================================================================
+ * File: BranchMesh.cpp
+ * Purpose: implementation of the tapered branch mesh builder
+ *======================================================================*/
+#include "BranchMesh.h"
+#include <algorithm>
+#include <cmath>
+
+const double BranchMeshBuilder::RADIUS_PER_LENGTH = 0.025;
+const double BranchMeshBuilder::TIP_RATIO = 0.65;
+
+namespace {
+    // Direction of the light shading prisms (unit length), and how much
+    // of a color is kept on the side facing away from it
+    const float LIGHT[3] = {0.48f, 0.80f, 0.36f};
+    const float AMBIENT = 0.55f;
+
+    void cross(const float a[3], const float b[3], float out[3])
+    {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    bool normalize(float v[3])
+    {
+        float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length < 1e-12f) return false;
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+        return true;
+    }
+
+    // Any unit vector perpendicular to the unit vector d
+    void perpendicular(const float d[3], float out[3])
+    {
+        const float up[3] = {0.0f, 1.0f, 0.0f};
+        const float side[3] = {1.0f, 0.0f, 0.0f};
+        cross(d, fabsf(d[1]) > 0.99f ? side : up, out);
+        normalize(out);
+    }
+
+    float* putVertex(float* v, const float p[3], const float offset[3], float radius,
+                     float r, float g, float b)
+    {
+        v[0] = p[0] + offset[0] * radius;
+        v[1] = p[1] + offset[1] * radius;
+        v[2] = p[2] + offset[2] * radius;
+        v[3] = r;
+        v[4] = g;
+        v[5] = b;
+        return v + LineBatch::FLOATS_PER_VERTEX;
+    }
+}
+
+BranchMeshBuilder::BranchMeshBuilder(int sideCount)
+    : sides(0)
+{
+    SetSides(sideCount);
+}
+
+void BranchMeshBuilder::SetSides(int sideCount)
+{
+    sides = sideCount <= 0 ? 0 : std::min(std::max(sideCount, 3), (int)MAX_SIDES);
+}
+
+void BranchMeshBuilder::Build(const CompactSegmentStore& segments, const double eye[3],
+                              double minRadius, TriangleBatch& out) const
+{
+    const int ring = sides == 0 ? 2 : sides;
+    const size_t count = segments.Size();
+    out.vertices.resize(count * 2 * ring * LineBatch::FLOATS_PER_VERTEX);
+    out.indices.resize(count * (sides == 0 ? 6 : 6 * sides));
+    if (count == 0) return;
+
+    float cosSide[MAX_SIDES], sinSide[MAX_SIDES];
+    for (int k = 0; k < sides; k++) {
+        cosSide[k] = (float)cos(2.0 * M_PI * k / sides);
+        sinSide[k] = (float)sin(2.0 * M_PI * k / sides);
+    }
+    const float eyePoint[3] = {(float)eye[0], (float)eye[1], (float)eye[2]};
+    const float floor = (float)minRadius;
+
+    float* v = out.vertices.data();
+    uint32_t* index = out.indices.data();
+    uint32_t base = 0;
+    float p[6];
+    for (const auto& segment : segments.Segments()) {
+        const SegmentStyle& style = segments.StyleOf(segment);
+        segments.Decode(segment, p);
+        const float* a = p;
+        const float* b = p + 3;
+        float axis[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        if (!normalize(axis)) axis[1] = 1.0f;
+        float r0 = std::max((float)(RADIUS_PER_LENGTH * length), floor);
+        float r1 = std::max((float)(RADIUS_PER_LENGTH * TIP_RATIO * length), floor);
+
+        if (sides == 0) {
+            // Across the branch and across the line of sight
+            float toEye[3] = {eyePoint[0] - a[0], eyePoint[1] - a[1], eyePoint[2] - a[2]};
+            float across[3];
+            cross(axis, toEye, across);
+            if (!normalize(across)) perpendicular(axis, across);
+            const float back[3] = {-across[0], -across[1], -across[2]};
+            v = putVertex(v, a, across, r0, style.r, style.g, style.b);
+            v = putVertex(v, a, back, r0, style.r, style.g, style.b);
+            v = putVertex(v, b, across, r1, style.r, style.g, style.b);
+            v = putVertex(v, b, back, r1, style.r, style.g, style.b);
+            const uint32_t quad[6] = {0, 1, 2, 2, 1, 3};
+            for (int k = 0; k < 6; k++) {
+                *index++ = base + quad[k];
+            }
+            base += 4;
+            continue;
+        }
+
+        // A ring of sides vertices at each end, joined by quads
+        float u[3], w[3];
+        perpendicular(axis, u);
+        cross(axis, u, w);
+        for (int end = 0; end < 2; end++) {
+            for (int k = 0; k < sides; k++) {
+                float normal[3];
+                for (int c = 0; c < 3; c++) {
+                    normal[c] = u[c] * cosSide[k] + w[c] * sinSide[k];
+                }
+                float light = normal[0] * LIGHT[0] + normal[1] * LIGHT[1] + normal[2] * LIGHT[2];
+                float shade = AMBIENT + (1.0f - AMBIENT) * std::max(light, 0.0f);
+                v = putVertex(v, end ? b : a, normal, end ? r1 : r0,
+                              style.r * shade, style.g * shade, style.b * shade);
+            }
+        }
+        for (int k = 0; k < sides; k++) {
+            uint32_t next = (k + 1) % sides;
+            const uint32_t quad[6] = {(uint32_t)k, next, (uint32_t)(sides + k),
+                                      (uint32_t)(sides + k), next, (uint32_t)sides + next};
+            for (int c = 0; c < 6; c++) {
+                *index++ = base + quad[c];
+            }
+        }
+        base += 2 * sides;
+    }
+}
@@ -0,0 +1,47 @@
+/*========================================================================
+ * File: BranchMesh.h
+ * Purpose: tapered triangle geometry for branches, with world-space
+ *          thickness, built from stored segments
+ *======================================================================*/
+#ifndef BRANCHMESH_H
+#define BRANCHMESH_H
+
+#include "CompactSegments.h"
+#include "LineBatch.h"
+
+// Turns every segment into a tapered solid whose radius is a fixed
+// fraction of the branch length. The radius shrinks to TIP_RATIO of it
+// at the far end, which is where the next level starts at the default
+// lambda. Thickness is in world units, so it shrinks with distance like
+// the rest of the tree, unlike a line width in pixels. minRadius keeps
+// the thinnest twigs from vanishing between pixels.
+//
+// With 0 sides a branch is one quad turned to face the eye (4 vertices,
+// 2 triangles), which needs rebuilding when the view turns. With 3 or
+// more it is an open prism around the branch with those sides. Prisms
+// do not depend on the view, and are shaded by a fixed light.
+//
+// Every branch goes into one TriangleBatch that is drawn with a single
+// call, whatever the widths.
+class BranchMeshBuilder
+{
+    public:
+        static const double RADIUS_PER_LENGTH;
+        static const double TIP_RATIO;
+        static const int MAX_SIDES = 16;
+
+        explicit BranchMeshBuilder(int sides = 0);
+
+        void SetSides(int sides);           // 0, or 3 to MAX_SIDES
+        int Sides() const { return sides; }
+
+        // eye is the camera position in the segments' space (see
+        // viewRay); prisms ignore it
+        void Build(const CompactSegmentStore& segments, const double eye[3],
+                   double minRadius, TriangleBatch& out) const;
+
+    private:
+        int sides;
+};
+
+#endif // BRANCHMESH_H
@@ -1,69 +1,45 @@
 /*========================================================================
  * File: Canvas.cpp
  * Purpose: implementation of Canvas class using GLFW with 3D support
+ *          (line storage and the software backend; GL drawing is in
+ *          CanvasGL.cpp)
  *======================================================================*/
 #define GL_SILENCE_DEPRECATION
 #include "Canvas.h"
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include "ImageWriter.h"
 
-Canvas::Canvas(int w, int h)
-    : width(w), height(h), curPosX(w/2), curPosY(h/2),
+Canvas::Canvas(int w, int h, Backend b)
+    : backend(b), width(w), height(h), curPosX(w/2), curPosY(h/2),
       curColorR(1.0f), curColorG(1.0f), curColorB(1.0f),
       curLineWidth(1), curLineStyle(SOLID), window(nullptr),
-      rotationX(0.0), rotationY(0.0)
-{
-    if (!glfwInit()) {
-        std::cerr << "Failed to initialize GLFW" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    
-    window = glfwCreateWindow(width, height, "Boom - 3D Recursive Tree", nullptr, nullptr);
-    if (!window) {
-        std::cerr << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        exit(EXIT_FAILURE);
+      rotationX(0.0), rotationY(0.0), renderPath(BATCHED), vertexBuffer(0), indexBuffer(0),
+      instanceVertexBuffer(0), staticLines(), staticVertexBuffer(0), packedVertexBuffer(0),
+      staticLinesUploaded(false), profiler(nullptr), presentMs(0.0),
+      mouseDown(false)
+{
+    if (backend == SOFTWARE) {
+        software.reset(new SoftwareRasterizer(width, height));
+        return;
     }
-    
-    glfwMakeContextCurrent(window);
-    
-    // Enable depth testing for 3D
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    
-    // Enable line smoothing for better appearance
-    glEnable(GL_LINE_SMOOTH);
-    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    // Set up perspective projection for 3D
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    double aspect = (double)width / (double)height;
-    double fov = 45.0;
-    double nearPlane = 1.0;
-    double farPlane = 1000.0;
-    double top = nearPlane * tan(fov * M_PI / 360.0);
-    double bottom = -top;
-    double right = top * aspect;
-    double left = -right;
-    glFrustum(left, right, bottom, top, nearPlane, farPlane);
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    // Set background to black
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+#ifdef BOOM_WITH_GL
+    openWindow(backend == OPENGL);
+#else
+    std::cerr << "Built without OpenGL: only the software backend is available" << std::endl;
+    exit(EXIT_FAILURE);
+#endif
 }
 
 Canvas::~Canvas()
 {
-    if (window) {
-        glfwDestroyWindow(window);
+#ifdef BOOM_WITH_GL
+    if (backend != SOFTWARE) {
+        closeWindow();
     }
-    glfwTerminate();
+#endif
 }
 
 void Canvas::SetColor(Color color)
@@ -89,35 +65,24 @@ void Canvas::SetColorRGB(float r, float g, float b)
 
 void Canvas::Line3D(double x1, double y1, double z1, double x2, double y2, double z2)
 {
-    LineSegment3D line;
-    line.x1 = x1;
-    line.y1 = y1;
-    line.z1 = z1;
-    line.x2 = x2;
-    line.y2 = y2;
-    line.z2 = z2;
-    line.r = curColorR;
-    line.g = curColorG;
-    line.b = curColorB;
-    line.width = curLineWidth;
-    lines3D.push_back(line);
+    lines3D.Add(x1, y1, z1, x2, y2, z2, curColorR, curColorG, curColorB, curLineWidth);
 }
 
 void Canvas::Line3DColored(double x1, double y1, double z1, double x2, double y2, double z2,
                           float r, float g, float b)
 {
-    LineSegment3D line;
-    line.x1 = x1;
-    line.y1 = y1;
-    line.z1 = z1;
-    line.x2 = x2;
-    line.y2 = y2;
-    line.z2 = z2;
-    line.r = r;
-    line.g = g;
-    line.b = b;
-    line.width = curLineWidth;
-    lines3D.push_back(line);
+    lines3D.Add(x1, y1, z1, x2, y2, z2, r, g, b, curLineWidth);
+}
+
+// Bulk append of pre-colored segments
+void Canvas::Lines3D(const Segment3D* segments, size_t count)
+{
+    lines3D.AddSegments(segments, count);
+}
+
+void Canvas::ReserveLines3D(size_t count)
+{
+    lines3D.Reserve(lines3D.Size() + count);
 }
 
 void Canvas::SetRotation(double angleX, double angleY)
@@ -126,6 +91,84 @@ void Canvas::SetRotation(double angleX, double angleY)
     rotationY = angleY;
 }
 
+ViewParams Canvas::GetView() const
+{
+    ViewParams view = defaultViewParams(width, height);
+    view.rotationX = rotationX;
+    view.rotationY = rotationY;
+    return view;
+}
+
+void Canvas::SetRenderPath(RenderPath path)
+{
+    renderPath = path;
+}
+
+void Canvas::SetMeshSides(int sides)
+{
+    meshBuilder.SetSides(sides);
+}
+
+// Quads face the current eye; half a pixel at the rotation centre is
+// the thinnest a branch gets
+void Canvas::buildMesh()
+{
+    ViewParams view = GetView();
+    double eye[3], direction[3];
+    viewRay(view, width * 0.5, height * 0.5, eye, direction);
+    meshBuilder.Build(lines3D, eye, 0.5 * viewUnitsPerPixel(view), meshBatch);
+}
+
+void Canvas::SetProfiler(FrameProfiler* frameProfiler)
+{
+    profiler = frameProfiler;
+}
+
+void Canvas::InstanceLine3D(double x1, double y1, double z1, double x2, double y2, double z2)
+{
+    instanceLines3D.Add(x1, y1, z1, x2, y2, z2, curColorR, curColorG, curColorB, curLineWidth);
+}
+
+void Canvas::AddInstance(const double matrix[16])
+{
+    instanceMatrices.insert(instanceMatrices.end(), matrix, matrix + 16);
+}
+
+void Canvas::ClearInstances()
+{
+    instanceLines3D.Clear();
+    instanceMatrices.clear();
+}
+
+void Canvas::SwapLines3D(CompactSegmentStore& lines)
+{
+    lines3D.Swap(lines);
+}
+
+void Canvas::SwapInstances(CompactSegmentStore& lines, std::vector<double>& matrices)
+{
+    instanceLines3D.Swap(lines);
+    instanceMatrices.swap(matrices);
+}
+
+void Canvas::SwapLineBatch(LineBatch& lines)
+{
+    packedLines.vertices.swap(lines.vertices);
+    packedLines.ranges.swap(lines.ranges);
+}
+
+void Canvas::SetStaticLines(const LineBatchView& lines)
+{
+    staticLines = lines;
+    staticLinesUploaded = false;
+}
+
+void Canvas::ClearStaticLines()
+{
+    staticLines = LineBatchView();
+    staticLinesUploaded = false;
+}
+
 // ... existing code ...
 
 void Canvas::addLine(int x1, int y1, int x2, int y2)
@@ -266,76 +309,101 @@ void Canvas::SetFont(Font fontID)
 void Canvas::Clear()
 {
     lines.clear();
-    lines3D.clear();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    lines3D.Clear();
+    if (software) {
+        software->Clear(0.0f, 0.0f, 0.0f);
+    }
+#ifdef BOOM_WITH_GL
+    else {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+#endif
 }
 
-void Canvas::drawStoredLines()
+void Canvas::Show()
 {
-    for (const auto& line : lines) {
-        glColor3f(line.r, line.g, line.b);
-        glLineWidth((GLfloat)line.width);
-        
-        glBegin(GL_LINES);
-        glVertex2i(line.x1, line.y1);
-        glVertex2i(line.x2, line.y2);
-        glEnd();
+    if (software) {
+        renderSoftware();
+        return;
     }
+#ifdef BOOM_WITH_GL
+    presentWindow(false);
+#endif
 }
 
-void Canvas::drawStoredLines3D()
+bool Canvas::ShouldClose()
 {
-    for (const auto& line : lines3D) {
-        glColor3f(line.r, line.g, line.b);
-        glLineWidth((GLfloat)line.width);
-        
-        glBegin(GL_LINES);
-        glVertex3d(line.x1, line.y1, line.z1);
-        glVertex3d(line.x2, line.y2, line.z2);
-        glEnd();
+#ifdef BOOM_WITH_GL
+    if (!software) {
+        return glfwWindowShouldClose(window);
     }
+#endif
+    return false;
 }
 
-void Canvas::Show()
+bool Canvas::TakeClick(double& x, double& y)
 {
-    glfwMakeContextCurrent(window);
-    
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    glTranslated(0.0, 0.0, -300.0);
-    glRotated(rotationX, 1.0, 0.0, 0.0);
-    glRotated(rotationY, 0.0, 1.0, 0.0);
-    
-    drawStoredLines3D();
-    glfwSwapBuffers(window);
+#ifdef BOOM_WITH_GL
+    if (!software) {
+        return pollClick(x, y);
+    }
+#endif
+    (void)x;
+    (void)y;
+    return false;
 }
 
-bool Canvas::ShouldClose()
+void Canvas::Update()
 {
-    return glfwWindowShouldClose(window);
+    if (software) {
+        renderSoftware();
+        return;
+    }
+#ifdef BOOM_WITH_GL
+    presentWindow(true);
+#endif
 }
 
-void Canvas::Update()
+// The rasterizer has no separate packing step: projecting and drawing
+// all counts as submission. Only the MESH path builds something first.
+void Canvas::renderSoftware()
 {
-    glfwMakeContextCurrent(window);
-    glfwPollEvents();
-    
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    glTranslated(0.0, 0.0, -300.0);
-    glRotated(rotationX, 1.0, 0.0, 0.0);
-    glRotated(rotationY, 0.0, 1.0, 0.0);
-    
-    drawStoredLines3D();
-    glfwSwapBuffers(window);
+    if (renderPath == MESH) {
+        ProfileScope scope(profiler, PROFILE_BUILD);
+        buildMesh();
+    }
+    ProfileScope scope(profiler, PROFILE_SUBMIT);
+    software->SetView(GetView());
+    software->Clear(0.0f, 0.0f, 0.0f);
+    if (staticLines.vertexCount > 0) {
+        software->DrawBatch(staticLines);
+    }
+    if (!packedLines.ranges.empty()) {
+        software->DrawBatch(packedLines.View());
+    }
+    if (renderPath == MESH) {
+        software->DrawTriangles(meshBatch);
+    } else {
+        software->DrawLines(lines3D);
+    }
+    if (!instanceMatrices.empty()) {
+        software->DrawLines(instanceLines3D, instanceMatrices.data(), instanceMatrices.size() / 16);
+    }
+}
+
+const uint8_t* Canvas::FramePixels() const
+{
+    return software ? software->Pixels().data() : nullptr;
+}
+
+bool Canvas::SaveFrame(const char* path) const
+{
+    if (!software) return false;
+    return writeImage(path, width, height, software->Pixels().data());
 }
 
 void Canvas::ClearLines()
 {
     lines.clear();
-    lines3D.clear();
+    lines3D.Clear();
 }
@@ -6,9 +6,24 @@
 #ifndef CANVAS_H
 #define CANVAS_H
 
+#ifdef BOOM_WITH_GL
 #include <GLFW/glfw3.h>
+#else
+struct GLFWwindow;
+typedef unsigned int GLuint;
+#endif
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
+#include "BranchMesh.h"
+#include "CompactSegments.h"
+#include "IndexedLines.h"
+#include "LineBatch.h"
+#include "Profiler.h"
+#include "SegmentSink.h"
+#include "SoftwareRasterizer.h"
+#include "View.h"
 
 class Canvas
 {
@@ -16,8 +31,17 @@ class Canvas
         enum Color {BLACK, RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN, WHITE};
         enum LineStyle {SOLID, DASHED};
         enum Font {SMALL, NORMAL, BIG};
+        // INDEXED draws the 3D lines with shared endpoints (glDrawElements)
+        // MESH draws them as tapered triangles with world-space thickness
+        // (see BranchMeshBuilder) in one glDrawElements
+        enum RenderPath {IMMEDIATE, BATCHED, INDEXED, MESH};
 
-        Canvas(int, int);
+        // OPENGL opens a window (GL builds only), OPENGL_HIDDEN the same
+        // without showing it (for benchmarks); SOFTWARE renders
+        // Show/Update into an in-memory framebuffer on the CPU
+        enum Backend {OPENGL, OPENGL_HIDDEN, SOFTWARE};
+
+        Canvas(int, int, Backend=OPENGL);
         ~Canvas();
 
         void Clear(void);
@@ -46,12 +70,65 @@ class Canvas
         bool ShouldClose();
         void Update();
         void ClearLines();
+        // Time the last Update spent presenting, vsync wait included
+        double PresentMs() const { return presentMs; }
+
+        // True once per left click since the last call, with the cursor
+        // position in pixels from the top left (never with SOFTWARE)
+        bool TakeClick(double& x, double& y);
 
         // 3D methods
         void Line3D(double x1, double y1, double z1, double x2, double y2, double z2);
         void Line3DColored(double x1, double y1, double z1, double x2, double y2, double z2,
                           float r, float g, float b);
+        void Lines3D(const Segment3D* segments, size_t count);
+
+        // Room for count more 3D lines, so deep trees fill without
+        // reallocating (see treeSegmentCount)
+        void ReserveLines3D(size_t count);
+        size_t Lines3DCount() const { return lines3D.Size(); }
+        const CompactSegmentStore& StoredLines3D() const { return lines3D; }
+        size_t Lines3DByteSize() const { return lines3D.ByteSize(); }
         void SetRotation(double angleX, double angleY);
+        void SetRenderPath(RenderPath path);
+        // Sides of the MESH path's branches (0: camera-facing quads)
+        void SetMeshSides(int sides);
+        size_t MeshTriangleCount() const { return meshBatch.TriangleCount(); }
+
+        // Times batch building, draw submission and the buffer swap into
+        // the profiler's current frame (null: no timing)
+        void SetProfiler(FrameProfiler* frameProfiler);
+
+        // Camera, projection and rotation the next frame is drawn with
+        ViewParams GetView() const;
+
+        // Last frame of the software backend: RGBA rows top to bottom
+        // (null with OpenGL), and PNG/PPM output of it
+        const uint8_t* FramePixels() const;
+        bool SaveFrame(const char* path) const;
+
+        // Instanced 3D geometry: one shared set of lines drawn once per
+        // instance matrix (column-major 4x4, as glMultMatrixd takes it)
+        void InstanceLine3D(double x1, double y1, double z1, double x2, double y2, double z2);
+        void AddInstance(const double matrix[16]);
+        void ClearInstances();
+
+        // Takes 3D lines (or instance geometry) built elsewhere, e.g. on
+        // a generator thread, in exchange for the canvas's current ones;
+        // both sides keep their allocations for reuse
+        void SwapLines3D(CompactSegmentStore& lines);
+        void SwapInstances(CompactSegmentStore& lines, std::vector<double>& matrices);
+
+        // Same for lines already packed into world space (a baked
+        // forest), streamed every frame as they are
+        void SwapLineBatch(LineBatch& lines);
+
+        // Static geometry drawn every frame under the current rotation,
+        // straight from memory the caller keeps alive (a mapped tree
+        // cache): the GL backend uploads it once, the software backend
+        // reads it in place. Survives ClearLines.
+        void SetStaticLines(const LineBatchView& lines);
+        void ClearStaticLines();
 
     private:
         struct LineSegment {
@@ -59,13 +136,8 @@ class Canvas
             float r, g, b;
             int width;
         };
-        
-        struct LineSegment3D {
-            double x1, y1, z1, x2, y2, z2;
-            float r, g, b;
-            int width;
-        };
 
+        Backend backend;
         int width;
         int height;
         int curPosX;
@@ -76,14 +148,63 @@ class Canvas
 
         GLFWwindow* window;
         std::vector<LineSegment> lines;
-        std::vector<LineSegment3D> lines3D;
+        CompactSegmentStore lines3D;
         
         double rotationX;
         double rotationY;
 
+        RenderPath renderPath;
+        LineBatch batch;
+        GLuint vertexBuffer;
+
+        IndexedLineBuilder indexedBuilder;
+        IndexedLineBatch indexedBatch;
+        GLuint indexBuffer;
+
+        BranchMeshBuilder meshBuilder;
+        TriangleBatch meshBatch;
+
+        CompactSegmentStore instanceLines3D;
+        std::vector<double> instanceMatrices;
+        LineBatch instanceBatch;
+        GLuint instanceVertexBuffer;
+
+        LineBatchView staticLines;
+        GLuint staticVertexBuffer;
+
+        LineBatch packedLines;
+        GLuint packedVertexBuffer;
+        bool staticLinesUploaded;
+
+        std::unique_ptr<SoftwareRasterizer> software;
+        FrameProfiler* profiler;
+        double presentMs;
+        bool mouseDown;
+
         void addLine(int x1, int y1, int x2, int y2);
+        void renderSoftware();
+        void buildMesh();
+
+        // OpenGL backend (CanvasGL.cpp)
+        void openWindow(bool visible);
+        void closeWindow();
+        void presentWindow(bool pollEvents);
+        bool pollClick(double& x, double& y);
         void drawStoredLines();
         void drawStoredLines3D();
+        void drawStoredLines3DImmediate();
+        void drawInstancesImmediate();
+        void drawInstancesBatched();
+        void drawStaticLines();
+        static void drawLinesImmediate(const CompactSegmentStore& segments);
+        static void buildLineBatch(const CompactSegmentStore& segments, LineBatch& out);
+        static void drawLineBatch(const LineBatch& source, GLuint& buffer);
+        static void drawIndexedLineBatch(const IndexedLineBatch& source, GLuint& vertices,
+                                         GLuint& indices);
+        static void drawTriangleBatch(const TriangleBatch& source, GLuint& vertices,
+                                      GLuint& indices);
+        static void uploadLineBatch(const LineBatch& source, GLuint& buffer);
+        static void drawLineRanges(const LineBatchView& source, const float* vertices);
 };
 
 #endif // CANVAS_H
@@ -0,0 +1,463 @@
+/*========================================================================
+ * File: CanvasGL.cpp
+ * Purpose: OpenGL/GLFW backend of the Canvas class (only built into the
+ *          windowed viewer)
+ *======================================================================*/
+#define GL_SILENCE_DEPRECATION
+#include "Canvas.h"
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER         0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STREAM_DRAW          0x88E0
+#define GL_STATIC_DRAW          0x88E4
+#endif
+
+#ifdef _WIN32
+#define BOOM_GL_CALL __stdcall
+#else
+#define BOOM_GL_CALL
+#endif
+
+namespace {
+    // Buffer objects are OpenGL 1.5, past what Windows' opengl32 exports,
+    // so they are looked up in the context instead of linked. Without
+    // them every render path falls back to the immediate one.
+    typedef void (BOOM_GL_CALL *GenBuffersProc)(GLsizei, GLuint*);
+    typedef void (BOOM_GL_CALL *DeleteBuffersProc)(GLsizei, const GLuint*);
+    typedef void (BOOM_GL_CALL *BindBufferProc)(GLenum, GLuint);
+    typedef void (BOOM_GL_CALL *BufferDataProc)(GLenum, ptrdiff_t, const void*, GLenum);
+    typedef void (BOOM_GL_CALL *BufferSubDataProc)(GLenum, ptrdiff_t, ptrdiff_t, const void*);
+
+    GenBuffersProc genBuffers = nullptr;
+    DeleteBuffersProc deleteBuffers = nullptr;
+    BindBufferProc bindBuffer = nullptr;
+    BufferDataProc bufferData = nullptr;
+    BufferSubDataProc bufferSubData = nullptr;
+
+    bool hasBufferObjects()
+    {
+        return genBuffers && deleteBuffers && bindBuffer && bufferData && bufferSubData;
+    }
+
+    // Needs a current context
+    bool loadBufferFunctions()
+    {
+        genBuffers = (GenBuffersProc)glfwGetProcAddress("glGenBuffers");
+        deleteBuffers = (DeleteBuffersProc)glfwGetProcAddress("glDeleteBuffers");
+        bindBuffer = (BindBufferProc)glfwGetProcAddress("glBindBuffer");
+        bufferData = (BufferDataProc)glfwGetProcAddress("glBufferData");
+        bufferSubData = (BufferSubDataProc)glfwGetProcAddress("glBufferSubData");
+        return hasBufferObjects();
+    }
+}
+
+void Canvas::openWindow(bool visible)
+{
+    if (!glfwInit()) {
+        std::cerr << "Failed to initialize GLFW" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+    
+    window = glfwCreateWindow(width, height, "Boom - 3D Recursive Tree", nullptr, nullptr);
+    if (!window) {
+        std::cerr << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    
+    glfwMakeContextCurrent(window);
+    if (!loadBufferFunctions()) {
+        std::cerr << "OpenGL buffer objects unavailable: drawing the immediate way" << std::endl;
+    }
+
+    // Pace frames by the display refresh instead of a fixed sleep
+    glfwSwapInterval(1);
+    
+    // Enable depth testing for 3D
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    
+    // Enable line smoothing for better appearance
+    glEnable(GL_LINE_SMOOTH);
+    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Set up perspective projection for 3D
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    ViewParams view = GetView();
+    double right, top;
+    viewFrustumSlopes(view, right, top);
+    glFrustum(-right * view.nearPlane, right * view.nearPlane,
+              -top * view.nearPlane, top * view.nearPlane,
+              view.nearPlane, view.farPlane);
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    // Set background to black
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void Canvas::closeWindow()
+{
+    if (window) {
+        glfwMakeContextCurrent(window);
+        if (vertexBuffer) {
+            deleteBuffers(1, &vertexBuffer);
+        }
+        if (indexBuffer) {
+            deleteBuffers(1, &indexBuffer);
+        }
+        if (instanceVertexBuffer) {
+            deleteBuffers(1, &instanceVertexBuffer);
+        }
+        if (staticVertexBuffer) {
+            deleteBuffers(1, &staticVertexBuffer);
+        }
+        if (packedVertexBuffer) {
+            deleteBuffers(1, &packedVertexBuffer);
+        }
+        glfwDestroyWindow(window);
+    }
+    glfwTerminate();
+}
+
+// Draws the stored 3D lines with the current rotation; Update also
+// polls window events first
+void Canvas::presentWindow(bool pollEvents)
+{
+    glfwMakeContextCurrent(window);
+    if (pollEvents) {
+        glfwPollEvents();
+    }
+    
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslated(0.0, 0.0, -VIEW_CAMERA_DISTANCE);
+    glRotated(rotationX, 1.0, 0.0, 0.0);
+    glRotated(rotationY, 0.0, 1.0, 0.0);
+    
+    drawStoredLines3D();
+
+    ProfileScope scope(profiler, PROFILE_SWAP);
+    auto swapStart = std::chrono::steady_clock::now();
+    glfwSwapBuffers(window);
+    presentMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - swapStart).count();
+}
+
+// Button state is polled once per call (events are pumped by Update),
+// so a click is reported on the frame the button goes down
+bool Canvas::pollClick(double& x, double& y)
+{
+    bool down = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    bool clicked = down && !mouseDown;
+    mouseDown = down;
+    if (clicked) {
+        glfwGetCursorPos(window, &x, &y);
+    }
+    return clicked;
+}
+
+void Canvas::drawStoredLines()
+{
+    for (const auto& line : lines) {
+        glColor3f(line.r, line.g, line.b);
+        glLineWidth((GLfloat)line.width);
+        
+        glBegin(GL_LINES);
+        glVertex2i(line.x1, line.y1);
+        glVertex2i(line.x2, line.y2);
+        glEnd();
+    }
+}
+
+void Canvas::drawStoredLines3D()
+{
+    if (renderPath == IMMEDIATE || !hasBufferObjects()) {
+        ProfileScope scope(profiler, PROFILE_SUBMIT);
+        drawStaticLines();
+        drawLineBatch(packedLines, packedVertexBuffer);
+        drawStoredLines3DImmediate();
+        drawInstancesImmediate();
+        return;
+    }
+    {
+        ProfileScope scope(profiler, PROFILE_BUILD);
+        if (renderPath == INDEXED) {
+            indexedBuilder.Build(lines3D, indexedBatch);
+        } else if (renderPath == MESH) {
+            buildMesh();
+        } else {
+            buildLineBatch(lines3D, batch);
+        }
+        if (!instanceMatrices.empty() && !instanceLines3D.Empty()) {
+            buildLineBatch(instanceLines3D, instanceBatch);
+        }
+    }
+    ProfileScope scope(profiler, PROFILE_SUBMIT);
+    drawStaticLines();
+    drawLineBatch(packedLines, packedVertexBuffer);
+    if (renderPath == INDEXED) {
+        drawIndexedLineBatch(indexedBatch, vertexBuffer, indexBuffer);
+    } else if (renderPath == MESH) {
+        drawTriangleBatch(meshBatch, vertexBuffer, indexBuffer);
+    } else {
+        drawLineBatch(batch, vertexBuffer);
+    }
+    drawInstancesBatched();
+}
+
+// Reference path: one glBegin/glEnd pair per segment
+void Canvas::drawStoredLines3DImmediate()
+{
+    drawLinesImmediate(lines3D);
+}
+
+void Canvas::drawLinesImmediate(const CompactSegmentStore& segments)
+{
+    float p[6];
+    for (const auto& line : segments.Segments()) {
+        const SegmentStyle& style = segments.StyleOf(line);
+        segments.Decode(line, p);
+        glColor3f(style.r, style.g, style.b);
+        glLineWidth((GLfloat)style.width);
+        
+        glBegin(GL_LINES);
+        glVertex3f(p[0], p[1], p[2]);
+        glVertex3f(p[3], p[4], p[5]);
+        glEnd();
+    }
+}
+
+void Canvas::drawInstancesImmediate()
+{
+    for (size_t i = 0; i + 16 <= instanceMatrices.size(); i += 16) {
+        glPushMatrix();
+        glMultMatrixd(&instanceMatrices[i]);
+        drawLinesImmediate(instanceLines3D);
+        glPopMatrix();
+    }
+}
+
+// The shared geometry (packed by drawStoredLines3D) is uploaded once per
+// frame; each instance then costs a matrix change and one draw per
+// width run
+void Canvas::drawInstancesBatched()
+{
+    if (instanceMatrices.empty() || instanceLines3D.Empty()) return;
+
+    uploadLineBatch(instanceBatch, instanceVertexBuffer);
+    for (size_t i = 0; i + 16 <= instanceMatrices.size(); i += 16) {
+        glPushMatrix();
+        glMultMatrixd(&instanceMatrices[i]);
+        drawLineRanges(instanceBatch.View(), nullptr);
+        glPopMatrix();
+    }
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Static lines go to the GPU once and are drawn from there every frame,
+// whichever render path the dynamic lines take
+void Canvas::drawStaticLines()
+{
+    if (staticLines.vertexCount == 0) return;
+    if (!hasBufferObjects()) {
+        drawLineRanges(staticLines, staticLines.vertices);
+        return;
+    }
+
+    if (!staticVertexBuffer) {
+        genBuffers(1, &staticVertexBuffer);
+    }
+    bindBuffer(GL_ARRAY_BUFFER, staticVertexBuffer);
+    if (!staticLinesUploaded) {
+        bufferData(GL_ARRAY_BUFFER,
+                     staticLines.vertexCount * LineBatch::FLOATS_PER_VERTEX * sizeof(float),
+                     staticLines.vertices, GL_STATIC_DRAW);
+        staticLinesUploaded = true;
+    }
+    drawLineRanges(staticLines, nullptr);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Pack segments into interleaved floats, grouped by line width so each
+// width needs a single draw call. Widths are small integers, so a
+// counting pass over the palette gives the run offsets without sorting.
+void Canvas::buildLineBatch(const CompactSegmentStore& segments, LineBatch& out)
+{
+    out.Clear();
+    if (segments.Empty()) return;
+
+    const std::vector<SegmentStyle>& styles = segments.Styles();
+    std::vector<int> styleCounts(styles.size(), 0);
+    for (const auto& line : segments.Segments()) {
+        styleCounts[line.style]++;
+    }
+
+    std::vector<int> widthCounts;
+    for (size_t i = 0; i < styles.size(); i++) {
+        int w = styles[i].width < 0 ? 0 : styles[i].width;
+        if (w >= (int)widthCounts.size()) widthCounts.resize(w + 1, 0);
+        widthCounts[w] += styleCounts[i];
+    }
+
+    std::vector<int> widthOffsets(widthCounts.size(), 0);
+    int vertexOffset = 0;
+    for (size_t w = 0; w < widthCounts.size(); w++) {
+        if (widthCounts[w] == 0) continue;
+        LineWidthRange range;
+        range.width = (int)w;
+        range.first = vertexOffset;
+        range.count = widthCounts[w] * 2;
+        out.ranges.push_back(range);
+        widthOffsets[w] = vertexOffset;
+        vertexOffset += range.count;
+    }
+
+    out.vertices.resize((size_t)vertexOffset * LineBatch::FLOATS_PER_VERTEX);
+    float* base = out.vertices.data();
+    float p[6];
+    for (const auto& line : segments.Segments()) {
+        const SegmentStyle& style = styles[line.style];
+        int w = style.width < 0 ? 0 : style.width;
+        float* v = base + (size_t)widthOffsets[w] * LineBatch::FLOATS_PER_VERTEX;
+        widthOffsets[w] += 2;
+        segments.Decode(line, p);
+        v[0] = p[0];    v[1] = p[1];     v[2] = p[2];
+        v[3] = style.r; v[4] = style.g;  v[5] = style.b;
+        v[6] = p[3];    v[7] = p[4];     v[8] = p[5];
+        v[9] = style.r; v[10] = style.g; v[11] = style.b;
+    }
+}
+
+// Upload into a streaming buffer, orphaning last frame's storage, and
+// leave it bound for drawLineRanges
+void Canvas::uploadLineBatch(const LineBatch& source, GLuint& buffer)
+{
+    if (!buffer) {
+        genBuffers(1, &buffer);
+    }
+    bindBuffer(GL_ARRAY_BUFFER, buffer);
+    bufferData(GL_ARRAY_BUFFER, source.ByteSize(), nullptr, GL_STREAM_DRAW);
+    bufferSubData(GL_ARRAY_BUFFER, 0, source.ByteSize(), source.vertices.data());
+}
+
+// One glDrawArrays per width run, from client memory at vertices or, if
+// that is null, from the bound buffer
+void Canvas::drawLineRanges(const LineBatchView& source, const float* vertices)
+{
+    const GLsizei stride = LineBatch::FLOATS_PER_VERTEX * sizeof(float);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, vertices);
+    glColorPointer(3, GL_FLOAT, stride, vertices ? (const void*)(vertices + 3)
+                                                 : (const void*)(uintptr_t)(3 * sizeof(float)));
+
+    for (size_t i = 0; i < source.rangeCount; i++) {
+        const LineWidthRange& range = source.ranges[i];
+        glLineWidth((GLfloat)range.width);
+        glDrawArrays(GL_LINES, range.first, range.count);
+    }
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void Canvas::drawLineBatch(const LineBatch& source, GLuint& buffer)
+{
+    if (source.ranges.empty()) return;
+    if (!hasBufferObjects()) {
+        drawLineRanges(source.View(), source.vertices.data());
+        return;
+    }
+
+    uploadLineBatch(source, buffer);
+    drawLineRanges(source.View(), nullptr);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Vertices and indices stream like the plain batch; each width run is
+// one glDrawElements over its slice of the index buffer
+void Canvas::drawIndexedLineBatch(const IndexedLineBatch& source, GLuint& vertices,
+                                  GLuint& indices)
+{
+    if (source.ranges.empty()) return;
+
+    if (!vertices) {
+        genBuffers(1, &vertices);
+    }
+    if (!indices) {
+        genBuffers(1, &indices);
+    }
+    bindBuffer(GL_ARRAY_BUFFER, vertices);
+    bufferData(GL_ARRAY_BUFFER, source.VertexByteSize(), nullptr, GL_STREAM_DRAW);
+    bufferSubData(GL_ARRAY_BUFFER, 0, source.VertexByteSize(), source.vertices.data());
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices);
+    bufferData(GL_ELEMENT_ARRAY_BUFFER, source.IndexByteSize(), nullptr, GL_STREAM_DRAW);
+    bufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, source.IndexByteSize(), source.indices.data());
+
+    const GLsizei stride = LineBatch::FLOATS_PER_VERTEX * sizeof(float);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, (const void*)0);
+    glColorPointer(3, GL_FLOAT, stride, (const void*)(uintptr_t)(3 * sizeof(float)));
+
+    for (const auto& range : source.ranges) {
+        glLineWidth((GLfloat)range.width);
+        glDrawElements(GL_LINES, range.count, GL_UNSIGNED_INT,
+                       (const void*)(uintptr_t)(range.first * sizeof(uint32_t)));
+    }
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Same streaming as the indexed lines, but with no width runs every
+// triangle goes out in a single glDrawElements
+void Canvas::drawTriangleBatch(const TriangleBatch& source, GLuint& vertices,
+                               GLuint& indices)
+{
+    if (source.indices.empty()) return;
+
+    if (!vertices) {
+        genBuffers(1, &vertices);
+    }
+    if (!indices) {
+        genBuffers(1, &indices);
+    }
+    bindBuffer(GL_ARRAY_BUFFER, vertices);
+    bufferData(GL_ARRAY_BUFFER, source.VertexByteSize(), nullptr, GL_STREAM_DRAW);
+    bufferSubData(GL_ARRAY_BUFFER, 0, source.VertexByteSize(), source.vertices.data());
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices);
+    bufferData(GL_ELEMENT_ARRAY_BUFFER, source.IndexByteSize(), nullptr, GL_STREAM_DRAW);
+    bufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, source.IndexByteSize(), source.indices.data());
+
+    const GLsizei stride = LineBatch::FLOATS_PER_VERTEX * sizeof(float);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, (const void*)0);
+    glColorPointer(3, GL_FLOAT, stride, (const void*)(uintptr_t)(3 * sizeof(float)));
+
+    glDrawElements(GL_TRIANGLES, (GLsizei)source.indices.size(), GL_UNSIGNED_INT, (const void*)0);
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,43 @@
+/*========================================================================
+ * File: CanvasSink.h
+ * Purpose: adapter that feeds generated segments into a Canvas
+ *======================================================================*/
+#ifndef CANVASSINK_H
+#define CANVASSINK_H
+
+#include "Canvas.h"
+#include "SegmentSink.h"
+
+class CanvasSink : public SegmentSink
+{
+    public:
+        // instanceGeometry sends segments to the shared instance lines
+        explicit CanvasSink(Canvas& c, bool instanceGeometry = false)
+            : canvas(c), instanced(instanceGeometry) {}
+
+        void AddSegment(const Segment3D& s) override
+        {
+            canvas.SetLineWidth(s.width);
+            canvas.SetColorRGB(s.r, s.g, s.b);
+            if (instanced) {
+                canvas.InstanceLine3D(s.x1, s.y1, s.z1, s.x2, s.y2, s.z2);
+            } else {
+                canvas.Line3D(s.x1, s.y1, s.z1, s.x2, s.y2, s.z2);
+            }
+        }
+
+        void AddSegments(const Segment3D* segments, size_t count) override
+        {
+            if (instanced) {
+                SegmentSink::AddSegments(segments, count);
+            } else {
+                canvas.Lines3D(segments, count);
+            }
+        }
+
+    private:
+        Canvas& canvas;
+        bool instanced;
+};
+
+#endif // CANVASSINK_H
@@ -0,0 +1,71 @@
+/*========================================================================
+ * File: CommandLine.cpp
+ * Purpose: implementation of the shared command line helpers
+ *======================================================================*/
+#include "CommandLine.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+const char* nextArg(int argc, char** argv, int& i)
+{
+    if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << argv[i] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return argv[++i];
+}
+
+int nextIntArg(int argc, char** argv, int& i)
+{
+    const char* flag = argv[i];
+    const char* value = nextArg(argc, argv, i);
+    char* end = nullptr;
+    long result = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0') {
+        std::cerr << "Invalid integer for " << flag << ": " << value << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return (int)result;
+}
+
+double nextDoubleArg(int argc, char** argv, int& i)
+{
+    const char* flag = argv[i];
+    const char* value = nextArg(argc, argv, i);
+    char* end = nullptr;
+    double result = strtod(value, &end);
+    if (*value == '\0' || *end != '\0') {
+        std::cerr << "Invalid number for " << flag << ": " << value << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return result;
+}
+
+bool parseTreeOption(int argc, char** argv, int& i, TreeParams& params, int& maxDepth)
+{
+    const char* arg = argv[i];
+    if (strcmp(arg, "--depth") == 0) {
+        maxDepth = nextIntArg(argc, argv, i);
+    } else if (strcmp(arg, "--lambda") == 0) {
+        params.lambda = nextDoubleArg(argc, argv, i);
+    } else if (strcmp(arg, "--angle") == 0) {
+        params.angle = nextDoubleArg(argc, argv, i);
+    } else if (strcmp(arg, "--factor") == 0) {
+        params.factor = nextDoubleArg(argc, argv, i);
+    } else if (strcmp(arg, "--branches") == 0) {
+        params.numBranches = nextIntArg(argc, argv, i);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void printTreeOptionsUsage(std::ostream& out)
+{
+    out << "  --depth N        recursion depth" << std::endl;
+    out << "  --lambda X       length reduction per level" << std::endl;
+    out << "  --angle DEG      branch angle from trunk" << std::endl;
+    out << "  --factor X       branch position along trunk (0..1)" << std::endl;
+    out << "  --branches N     maximum branches at trunk level" << std::endl;
+}
@@ -0,0 +1,22 @@
+/*========================================================================
+ * File: CommandLine.h
+ * Purpose: command line helpers shared by the boom executables
+ *======================================================================*/
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <ostream>
+#include "TreeGenerator.h"
+
+// Value following argv[i]; advances i. Exits with a message when missing
+// or malformed.
+const char* nextArg(int argc, char** argv, int& i);
+int nextIntArg(int argc, char** argv, int& i);
+double nextDoubleArg(int argc, char** argv, int& i);
+
+// Handles --depth, --lambda, --angle, --factor and --branches.
+// Returns false when argv[i] is not one of them.
+bool parseTreeOption(int argc, char** argv, int& i, TreeParams& params, int& maxDepth);
+void printTreeOptionsUsage(std::ostream& out);
+
+#endif // COMMANDLINE_H
@@ -0,0 +1,207 @@
+/*========================================================================
+ * File: CompactSegments.cpp
+ * Purpose: implementation of the quantized segment store
+ *======================================================================*/
+#include "CompactSegments.h"
+#include <cmath>
+#include <utility>
+
+CompactSegmentStore::CompactSegmentStore(double smallest)
+    : minExtent(smallest > 0.0 ? smallest : 1.0), extent(0.0), scale(0.0), lastStyle(-1)
+{
+    Clear();
+}
+
+void CompactSegmentStore::Clear()
+{
+    segments.clear();
+    styles.clear();
+    lastStyle = -1;
+    extent = minExtent;
+    scale = QUANT_MAX / extent;
+}
+
+void CompactSegmentStore::Swap(CompactSegmentStore& other)
+{
+    std::swap(minExtent, other.minExtent);
+    std::swap(extent, other.extent);
+    std::swap(scale, other.scale);
+    segments.swap(other.segments);
+    styles.swap(other.styles);
+    std::swap(lastStyle, other.lastStyle);
+}
+
+size_t CompactSegmentStore::ByteSize() const
+{
+    return segments.size() * sizeof(CompactSegment) + styles.size() * sizeof(SegmentStyle);
+}
+
+// Doubling halves every stored value; one rounding step per doubling
+void CompactSegmentStore::fit(double largest)
+{
+    if (largest <= extent || !std::isfinite(largest)) return;
+
+    int doublings = 0;
+    while (extent < largest) {
+        extent *= 2.0;
+        doublings++;
+    }
+    scale = QUANT_MAX / extent;
+
+    const double shrink = ldexp(1.0, -doublings);
+    for (auto& s : segments) {
+        int16_t* v[6] = {&s.x1, &s.y1, &s.z1, &s.x2, &s.y2, &s.z2};
+        for (int i = 0; i < 6; i++) {
+            *v[i] = (int16_t)lround(*v[i] * shrink);
+        }
+    }
+}
+
+int16_t CompactSegmentStore::quantize(double v) const
+{
+    double q = v * scale;
+    if (!(q > -QUANT_MAX)) return -QUANT_MAX;   // also NaN
+    if (q > QUANT_MAX) return QUANT_MAX;
+    return (int16_t)lround(q);
+}
+
+uint16_t CompactSegmentStore::styleIndex(float r, float g, float b, int width)
+{
+    // Consecutive segments usually share a style
+    if (lastStyle >= 0) {
+        const SegmentStyle& last = styles[lastStyle];
+        if (last.r == r && last.g == g && last.b == b && last.width == width) {
+            return (uint16_t)lastStyle;
+        }
+    }
+    for (size_t i = 0; i < styles.size(); i++) {
+        const SegmentStyle& s = styles[i];
+        if (s.r == r && s.g == g && s.b == b && s.width == width) {
+            lastStyle = (int)i;
+            return (uint16_t)i;
+        }
+    }
+
+    if (styles.size() <= 0xFFFF) {
+        SegmentStyle style;
+        style.r = r;
+        style.g = g;
+        style.b = b;
+        style.width = width;
+        styles.push_back(style);
+        lastStyle = (int)styles.size() - 1;
+        return (uint16_t)lastStyle;
+    }
+
+    // Palette full: closest color among the styles of this width
+    int best = 0;
+    double bestDistance = -1.0;
+    for (size_t i = 0; i < styles.size(); i++) {
+        const SegmentStyle& s = styles[i];
+        double distance = (s.r - r) * (s.r - r) + (s.g - g) * (s.g - g) + (s.b - b) * (s.b - b);
+        if (s.width != width) distance += 1000.0;
+        if (bestDistance < 0.0 || distance < bestDistance) {
+            best = (int)i;
+            bestDistance = distance;
+        }
+    }
+    return (uint16_t)best;
+}
+
+void CompactSegmentStore::Add(double x1, double y1, double z1, double x2, double y2, double z2,
+                              float r, float g, float b, int width)
+{
+    double largest = fabs(x1);
+    const double others[5] = {y1, z1, x2, y2, z2};
+    for (int i = 0; i < 5; i++) {
+        if (fabs(others[i]) > largest) largest = fabs(others[i]);
+    }
+    fit(largest);
+
+    CompactSegment s;
+    s.x1 = quantize(x1);
+    s.y1 = quantize(y1);
+    s.z1 = quantize(z1);
+    s.x2 = quantize(x2);
+    s.y2 = quantize(y2);
+    s.z2 = quantize(z2);
+    s.style = styleIndex(r, g, b, width);
+    segments.push_back(s);
+}
+
+void CompactSegmentStore::AddSegment(const Segment3D& s)
+{
+    Add(s.x1, s.y1, s.z1, s.x2, s.y2, s.z2, s.r, s.g, s.b, s.width);
+}
+
+void CompactSegmentStore::AddSegments(const Segment3D* source, size_t count)
+{
+    size_t needed = segments.size() + count;
+    if (segments.capacity() < needed) {
+        segments.reserve(needed > 2 * segments.capacity() ? needed : 2 * segments.capacity());
+    }
+    for (size_t i = 0; i < count; i++) {
+        AddSegment(source[i]);
+    }
+}
+
+void CompactSegmentStore::Decode(const CompactSegment& s, float out[6]) const
+{
+    const float step = (float)(extent / QUANT_MAX);
+    out[0] = s.x1 * step;
+    out[1] = s.y1 * step;
+    out[2] = s.z1 * step;
+    out[3] = s.x2 * step;
+    out[4] = s.y2 * step;
+    out[5] = s.z2 * step;
+}
+
+void CompactSegmentStore::Blend(const CompactSegmentStore* const* sources, const double* weights,
+                                int count)
+{
+    segments.clear();
+    if (count <= 0) return;
+
+    // The blend stays inside the largest source cube
+    extent = minExtent;
+    for (int k = 0; k < count; k++) {
+        if (sources[k]->extent > extent) extent = sources[k]->extent;
+    }
+    scale = QUANT_MAX / extent;
+    styles = sources[0]->styles;
+    lastStyle = -1;
+
+    const int maxSources = 8;
+    float coefficients[maxSources];
+    const CompactSegment* data[maxSources];
+    size_t size = sources[0]->segments.size();
+    count = count < maxSources ? count : maxSources;
+    for (int k = 0; k < count; k++) {
+        coefficients[k] = (float)(weights[k] * sources[k]->extent / extent);
+        data[k] = sources[k]->segments.data();
+        if (sources[k]->segments.size() < size) size = sources[k]->segments.size();
+    }
+
+    segments.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        float p[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; k < count; k++) {
+            const CompactSegment& s = data[k][i];
+            const float c = coefficients[k];
+            p[0] += s.x1 * c;
+            p[1] += s.y1 * c;
+            p[2] += s.z1 * c;
+            p[3] += s.x2 * c;
+            p[4] += s.y2 * c;
+            p[5] += s.z2 * c;
+        }
+        CompactSegment& out = segments[i];
+        out.x1 = (int16_t)lrintf(p[0]);
+        out.y1 = (int16_t)lrintf(p[1]);
+        out.z1 = (int16_t)lrintf(p[2]);
+        out.x2 = (int16_t)lrintf(p[3]);
+        out.y2 = (int16_t)lrintf(p[4]);
+        out.z2 = (int16_t)lrintf(p[5]);
+        out.style = data[0][i].style;
+    }
+}
@@ -0,0 +1,87 @@
+/*========================================================================
+ * File: CompactSegments.h
+ * Purpose: quantized segment storage with a shared color/width palette
+ *======================================================================*/
+#ifndef COMPACTSEGMENTS_H
+#define COMPACTSEGMENTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "SegmentSink.h"
+
+// Color and width shared by many segments (one per tree depth)
+struct SegmentStyle {
+    float r, g, b;
+    int width;
+};
+
+// 14 bytes: endpoints as 16-bit fixed point inside the store's box,
+// plus an index into the store's style palette
+struct CompactSegment {
+    int16_t x1, y1, z1, x2, y2, z2;
+    uint16_t style;
+};
+
+// Segments stored in a centred cube of half-size Extent(). The cube
+// starts at minExtent and doubles whenever a point falls outside it,
+// requantizing what is already stored, so the step size, Extent() / 32767,
+// always follows the largest coordinate seen. The default tree grows the
+// cube to 128 units, a step of about 0.0039.
+// At most 65536 distinct styles are kept; further ones reuse the
+// closest existing color of the same width.
+class CompactSegmentStore : public SegmentSink
+{
+    public:
+        explicit CompactSegmentStore(double minExtent = 1.0);
+
+        void Reserve(size_t count) { segments.reserve(count); }
+        void Clear();
+
+        // Exchanges contents and storage with other, without copying
+        void Swap(CompactSegmentStore& other);
+
+        void Add(double x1, double y1, double z1, double x2, double y2, double z2,
+                 float r, float g, float b, int width);
+
+        void AddSegment(const Segment3D& s) override;
+        void AddSegments(const Segment3D* source, size_t count) override;
+
+        // Replaces the contents with the weighted sum (weights adding up
+        // to 1) of stores that list corresponding segments in the same
+        // order: the same tree layout, not just the same branch count and
+        // depth (see ShapeCache). Works on the quantized values directly;
+        // styles come from the first store.
+        void Blend(const CompactSegmentStore* const* sources, const double* weights, int count);
+
+        size_t Size() const { return segments.size(); }
+        bool Empty() const { return segments.empty(); }
+        size_t Capacity() const { return segments.capacity(); }
+        size_t ByteSize() const;
+
+        double Extent() const { return extent; }
+        double Step() const { return extent / QUANT_MAX; }
+
+        const std::vector<CompactSegment>& Segments() const { return segments; }
+        const std::vector<SegmentStyle>& Styles() const { return styles; }
+        const SegmentStyle& StyleOf(const CompactSegment& s) const { return styles[s.style]; }
+
+        // World coordinates of a stored segment: x1 y1 z1 x2 y2 z2
+        void Decode(const CompactSegment& s, float out[6]) const;
+
+    private:
+        static const int QUANT_MAX = 32767;
+
+        double minExtent;
+        double extent;
+        double scale;               // QUANT_MAX / extent
+        std::vector<CompactSegment> segments;
+        std::vector<SegmentStyle> styles;
+        int lastStyle;
+
+        void fit(double largest);
+        int16_t quantize(double v) const;
+        uint16_t styleIndex(float r, float g, float b, int width);
+};
+
+#endif // COMPACTSEGMENTS_H
@@ -0,0 +1,296 @@
+/*========================================================================
+ * File: Forest.cpp
+ * Purpose: implementation of the forest of tree instances
+ *======================================================================*/
+#include "Forest.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <map>
+#include <random>
+#include <tuple>
+
+namespace {
+    // Trees per bake task; enough to amortize the task, small enough to
+    // balance the uneven tree sizes
+    const size_t BAKE_CHUNK = 64;
+
+    typedef std::tuple<double, double, double, int, int> ShapeKey;
+
+    ShapeKey shapeKey(const TreeParams& params, int maxDepth)
+    {
+        return ShapeKey(params.lambda, params.angle, params.factor, params.numBranches, maxDepth);
+    }
+
+    Transform3D rotationY(double degrees)
+    {
+        double a = degrees * M_PI / 180.0;
+        Transform3D r = Transform3D::Identity();
+        r.col[0][0] = cos(a);  r.col[0][2] = -sin(a);
+        r.col[2][0] = sin(a);  r.col[2][2] = cos(a);
+        return r;
+    }
+
+    Transform3D rotationZ(double degrees)
+    {
+        double a = degrees * M_PI / 180.0;
+        Transform3D r = Transform3D::Identity();
+        r.col[0][0] = cos(a);  r.col[0][1] = sin(a);
+        r.col[1][0] = -sin(a); r.col[1][1] = cos(a);
+        return r;
+    }
+
+    Transform3D translation(double x, double y, double z)
+    {
+        Transform3D t = Transform3D::Identity();
+        t.t[0] = x;
+        t.t[1] = y;
+        t.t[2] = z;
+        return t;
+    }
+
+    // Uniform in [0, 1), the same on every standard library
+    double unit(std::mt19937& rng)
+    {
+        return rng() / 4294967296.0;
+    }
+}
+
+Forest::Forest(int threads)
+    : swayDegrees(3.0), swayRate(1.5), widthSlots(0), vertexCount(0)
+{
+    if (threads > 1) {
+        pool.reset(new WorkStealingPool(threads));
+    }
+}
+
+void Forest::Clear()
+{
+    trees.clear();
+    shapeOf.clear();
+    shapes.clear();
+    ranges.clear();
+    treeOffsets.clear();
+    widthSlots = 0;
+    vertexCount = 0;
+}
+
+void Forest::Add(const ForestTree& tree)
+{
+    trees.push_back(tree);
+}
+
+void Forest::SetSway(double degrees, double radiansPerSecond)
+{
+    swayDegrees = degrees;
+    swayRate = radiansPerSecond;
+}
+
+bool Forest::Build(std::string& error)
+{
+    // Shapes in order of first use, so the result does not depend on
+    // the map's ordering
+    shapes.clear();
+    shapeOf.resize(trees.size());
+    std::map<ShapeKey, uint32_t> known;
+    for (size_t i = 0; i < trees.size(); i++) {
+        ShapeKey key = shapeKey(trees[i].params, trees[i].maxDepth);
+        auto found = known.find(key);
+        if (found == known.end()) {
+            found = known.insert(std::make_pair(key, (uint32_t)shapes.size())).first;
+            Shape shape;
+            shape.params = trees[i].params;
+            shape.maxDepth = trees[i].maxDepth;
+            shape.fits = true;
+            shapes.push_back(shape);
+        }
+        shapeOf[i] = found->second;
+    }
+
+    if (pool) {
+        for (auto& shape : shapes) {
+            Shape* target = &shape;
+            pool->Submit([target]() { generateShape(*target); });
+        }
+        pool->Wait();
+    } else {
+        for (auto& shape : shapes) {
+            generateShape(shape);
+        }
+    }
+
+    // Offsets are ints, as LineWidthRange's and GL's are, so the whole
+    // batch must stay within INT_MAX vertices
+    uint64_t total = 0;
+    for (size_t i = 0; i < trees.size(); i++) {
+        const Shape& shape = shapes[shapeOf[i]];
+        total += shape.fits ? shape.vertices.size() / LineBatch::FLOATS_PER_VERTEX
+                            : (uint64_t)INT_MAX + 1;
+    }
+    if (total > (uint64_t)INT_MAX) {
+        Clear();
+        error = "forest too large for a line batch";
+        return false;
+    }
+
+    // Where every tree's runs go in a baked batch: width by width, and
+    // tree by tree within a width
+    widthSlots = 0;
+    for (const auto& shape : shapes) {
+        widthSlots = std::max(widthSlots, (int)shape.widthCount.size());
+    }
+    ranges.clear();
+    treeOffsets.assign(trees.size() * widthSlots, 0);
+    vertexCount = 0;
+    for (int w = 0; w < widthSlots; w++) {
+        LineWidthRange range;
+        range.width = w;
+        range.first = vertexCount;
+        for (size_t i = 0; i < trees.size(); i++) {
+            const Shape& shape = shapes[shapeOf[i]];
+            treeOffsets[i * widthSlots + w] = vertexCount;
+            if (w < (int)shape.widthCount.size()) vertexCount += shape.widthCount[w];
+        }
+        range.count = vertexCount - range.first;
+        if (range.count > 0) ranges.push_back(range);
+    }
+    return true;
+}
+
+size_t Forest::SegmentCount() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < trees.size(); i++) {
+        count += shapes[shapeOf[i]].vertices.size() / LineBatch::FLOATS_PER_VERTEX / 2;
+    }
+    return count;
+}
+
+void Forest::generateShape(Shape& shape)
+{
+    VectorSink sink;
+    generateTree(shape.params, shape.maxDepth, sink);
+    if (sink.segments.size() > (size_t)INT_MAX / 2) {
+        shape.fits = false;
+        return;
+    }
+
+    int widths = 0;
+    for (const auto& s : sink.segments) {
+        widths = std::max(widths, std::max(s.width, 0) + 1);
+    }
+    shape.widthCount.assign(widths, 0);
+    for (const auto& s : sink.segments) {
+        shape.widthCount[std::max(s.width, 0)] += 2;
+    }
+    shape.widthFirst.assign(widths, 0);
+    for (int w = 1; w < widths; w++) {
+        shape.widthFirst[w] = shape.widthFirst[w - 1] + shape.widthCount[w - 1];
+    }
+
+    std::vector<int> next = shape.widthFirst;
+    shape.vertices.resize(sink.segments.size() * 2 * LineBatch::FLOATS_PER_VERTEX);
+    for (const auto& s : sink.segments) {
+        float* v = &shape.vertices[(size_t)next[std::max(s.width, 0)] * LineBatch::FLOATS_PER_VERTEX];
+        next[std::max(s.width, 0)] += 2;
+        v[0] = (float)s.x1; v[1] = (float)s.y1;  v[2] = (float)s.z1;
+        v[3] = s.r;         v[4] = s.g;          v[5] = s.b;
+        v[6] = (float)s.x2; v[7] = (float)s.y2;  v[8] = (float)s.z2;
+        v[9] = s.r;         v[10] = s.g;         v[11] = s.b;
+    }
+}
+
+// Scale and turn about the root, lean with the wind (about Z), then
+// move the root to the tree's place on the ground
+Transform3D Forest::treeTransform(const ForestTree& tree, double time) const
+{
+    Transform3D scale = Transform3D::Identity();
+    for (int i = 0; i < 3; i++) {
+        scale.col[i][i] = tree.scale;
+    }
+    double sway = swayDegrees * sin(swayRate * time + tree.phase);
+    return translation(TREE_ROOT_X + tree.x, TREE_ROOT_Y, TREE_ROOT_Z + tree.z)
+         * rotationZ(sway) * rotationY(tree.yaw) * scale
+         * translation(-TREE_ROOT_X, -TREE_ROOT_Y, -TREE_ROOT_Z);
+}
+
+void Forest::Bake(double time, LineBatch& out)
+{
+    out.ranges = ranges;
+    out.vertices.resize((size_t)vertexCount * LineBatch::FLOATS_PER_VERTEX);
+    if (trees.empty()) return;
+
+    if (pool && trees.size() > BAKE_CHUNK) {
+        for (size_t first = 0; first < trees.size(); first += BAKE_CHUNK) {
+            size_t last = std::min(first + BAKE_CHUNK, trees.size());
+            pool->Submit([this, first, last, time, &out]() { bakeTrees(first, last, time, out); });
+        }
+        pool->Wait();
+    } else {
+        bakeTrees(0, trees.size(), time, out);
+    }
+}
+
+void Forest::bakeTrees(size_t first, size_t last, double time, LineBatch& out) const
+{
+    const int stride = LineBatch::FLOATS_PER_VERTEX;
+    for (size_t i = first; i < last; i++) {
+        const Shape& shape = shapes[shapeOf[i]];
+        Transform3D m = treeTransform(trees[i], time);
+        float c[3][3], t[3];
+        for (int col = 0; col < 3; col++) {
+            for (int row = 0; row < 3; row++) {
+                c[col][row] = (float)m.col[col][row];
+            }
+            t[col] = (float)m.t[col];
+        }
+
+        for (size_t w = 0; w < shape.widthCount.size(); w++) {
+            const float* source = &shape.vertices[(size_t)shape.widthFirst[w] * stride];
+            float* target = &out.vertices[(size_t)treeOffsets[i * widthSlots + w] * stride];
+            for (int v = 0; v < shape.widthCount[w]; v++, source += stride, target += stride) {
+                for (int row = 0; row < 3; row++) {
+                    target[row] = c[0][row] * source[0] + c[1][row] * source[1]
+                                + c[2][row] * source[2] + t[row];
+                }
+                target[3] = source[3];
+                target[4] = source[4];
+                target[5] = source[5];
+            }
+        }
+    }
+}
+
+void scatterForest(size_t count, const TreeParams& base, int minDepth, int maxDepth,
+                   double radius, uint32_t seed, std::vector<ForestTree>& out)
+{
+    static const int BRANCH_VARIANTS[] = {-2, -1, 0, 1};
+    static const double ANGLE_VARIANTS[] = {-10.0, -5.0, 0.0, 5.0};
+    static const double LAMBDA_VARIANTS[] = {-0.05, 0.0, 0.05};
+
+    if (minDepth > maxDepth) std::swap(minDepth, maxDepth);
+    double spacing = count > 0 ? radius * sqrt(M_PI / count) : radius;
+    double baseScale = std::min(1.0, spacing / 40.0);
+
+    std::mt19937 rng(seed);
+    out.clear();
+    out.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        ForestTree tree;
+        tree.params = base;
+        tree.params.numBranches = std::max(2, base.numBranches + BRANCH_VARIANTS[rng() % 4]);
+        tree.params.angle = base.angle + ANGLE_VARIANTS[rng() % 4];
+        tree.params.lambda = base.lambda + LAMBDA_VARIANTS[rng() % 3];
+        tree.maxDepth = minDepth + (int)(rng() % (uint32_t)(maxDepth - minDepth + 1));
+
+        // Uniform over the disc
+        double r = radius * sqrt(unit(rng));
+        double theta = 2.0 * M_PI * unit(rng);
+        tree.x = r * cos(theta);
+        tree.z = r * sin(theta);
+        tree.yaw = 360.0 * unit(rng);
+        tree.scale = baseScale * (0.7 + 0.6 * unit(rng));
+        tree.phase = 2.0 * M_PI * unit(rng);
+        out.push_back(tree);
+    }
+}
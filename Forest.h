@@ -0,0 +1,102 @@
+/*========================================================================
+ * File: Forest.h
+ * Purpose: scenes of many trees, each with its own parameters, baked
+ *          into one batch for a few draw calls
+ *======================================================================*/
+#ifndef FOREST_H
+#define FOREST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "InstancedTree.h"
+#include "LineBatch.h"
+#include "ThreadPool.h"
+#include "TreeGenerator.h"
+
+// One tree of the forest. The tree grows from the ground at (x, z),
+// turned by yaw and scaled about its root; it sways by up to the
+// forest's sway angle, phase radians apart from its neighbours.
+struct ForestTree {
+    TreeParams params;
+    int maxDepth;
+    double x, z;
+    double yaw;             // degrees about the vertical
+    double scale;
+    double phase;
+};
+
+// Trees with equal shape parameters (lambda, angle, factor, branch
+// count and depth) share one generated shape, so a forest costs one
+// generation per distinct shape. The shapes are generated in parallel
+// and kept packed into width runs.
+//
+// Bake writes every tree, transformed and swaying at a given time, into
+// a single LineBatch with one run per line width. However many trees
+// there are, the batch takes one draw call per width. Trees are
+// transformed in parallel chunks, each writing to offsets known in
+// advance, so the output does not depend on the thread count, and a
+// reused batch does not reallocate.
+class Forest
+{
+    public:
+        // threads <= 1 builds and bakes on the calling thread
+        explicit Forest(int threads = 1);
+
+        void Clear();
+        void Add(const ForestTree& tree);
+        void SetSway(double degrees, double radiansPerSecond);
+
+        // Generates the distinct shapes; call after adding trees. Fails,
+        // and clears the forest, when the trees together have more
+        // vertices than a batch can address (INT_MAX).
+        bool Build(std::string& error);
+
+        size_t TreeCount() const { return trees.size(); }
+        size_t ShapeCount() const { return shapes.size(); }
+        size_t SegmentCount() const;        // over all trees
+
+        // Every tree at time seconds, in tree order
+        void Bake(double time, LineBatch& out);
+
+    private:
+        // A generated shape: vertices (as in LineBatch) sorted into
+        // width runs, in the tree's own frame
+        struct Shape {
+            TreeParams params;
+            int maxDepth;
+            std::vector<float> vertices;
+            std::vector<int> widthFirst;    // first vertex of each width
+            std::vector<int> widthCount;    // vertices of each width
+            bool fits;                      // false if over INT_MAX vertices
+        };
+
+        std::unique_ptr<WorkStealingPool> pool;
+        std::vector<ForestTree> trees;
+        std::vector<uint32_t> shapeOf;      // per tree
+        std::vector<Shape> shapes;
+        double swayDegrees;
+        double swayRate;
+
+        // Layout of a baked batch, fixed by Build: its width runs, and
+        // the first vertex of every tree in each width run
+        std::vector<LineWidthRange> ranges;
+        std::vector<int> treeOffsets;       // [tree * widthSlots + width]
+        int widthSlots;
+        int vertexCount;
+
+        static void generateShape(Shape& shape);
+        Transform3D treeTransform(const ForestTree& tree, double time) const;
+        void bakeTrees(size_t first, size_t last, double time, LineBatch& out) const;
+};
+
+// Scatters count trees over a disc of the given radius, deterministic
+// for a seed. Shapes vary around base (branch count, angle, lambda and
+// depth between minDepth and maxDepth) from a small set of variants, so
+// many trees share a shape; trees are scaled to their spacing.
+void scatterForest(size_t count, const TreeParams& base, int minDepth, int maxDepth,
+                   double radius, uint32_t seed, std::vector<ForestTree>& out);
+
+#endif // FOREST_H
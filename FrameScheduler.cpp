@@ -0,0 +1,81 @@
+/*========================================================================
+ * File: FrameScheduler.cpp
+ * Purpose: implementation of the frame scheduler and frame clock
+ *======================================================================*/
+#include "FrameScheduler.h"
+
+namespace {
+    // Weight of the newest frame in the smoothed cost
+    const double COST_SMOOTHING = 0.2;
+}
+
+const int FrameScheduler::DROP_FRAMES;
+const int FrameScheduler::RAISE_FRAMES;
+const int FrameScheduler::HOLD_FRAMES;
+constexpr double FrameScheduler::RAISE_FRACTION;
+
+FrameScheduler::FrameScheduler(double budgetMs, int minimum, int maximum)
+    : budget(budgetMs), minDepth(minimum < 1 ? 1 : minimum),
+      maxDepth(maximum < minDepth ? minDepth : maximum), depth(maxDepth),
+      costPerSegment(0.0), overBudgetFrames(0), headroomFrames(0), holdFrames(0)
+{
+}
+
+void FrameScheduler::Report(double costMs, size_t segments)
+{
+    if (segments == 0 || costMs <= 0.0) return;
+
+    double perSegment = costMs / segments;
+    costPerSegment = costPerSegment == 0.0
+                   ? perSegment
+                   : costPerSegment + COST_SMOOTHING * (perSegment - costPerSegment);
+}
+
+bool FrameScheduler::Update(const std::function<size_t(int)>& segmentsAt)
+{
+    if (budget <= 0.0 || costPerSegment == 0.0) return false;
+
+    if (holdFrames > 0) {
+        holdFrames--;
+        return false;
+    }
+
+    double current = costPerSegment * segmentsAt(depth);
+    overBudgetFrames = current > budget ? overBudgetFrames + 1 : 0;
+
+    bool roomToGrow = depth < maxDepth
+                   && costPerSegment * segmentsAt(depth + 1) < budget * RAISE_FRACTION;
+    headroomFrames = roomToGrow ? headroomFrames + 1 : 0;
+
+    int next = depth;
+    if (overBudgetFrames >= DROP_FRAMES && depth > minDepth) {
+        next = depth - 1;
+    } else if (headroomFrames >= RAISE_FRAMES) {
+        next = depth + 1;
+    }
+    if (next == depth) return false;
+
+    depth = next;
+    overBudgetFrames = 0;
+    headroomFrames = 0;
+    holdFrames = HOLD_FRAMES;
+    return true;
+}
+
+FrameClock::FrameClock(double maxStepSeconds)
+    : maxStep(maxStepSeconds), started(false)
+{
+}
+
+double FrameClock::Tick()
+{
+    auto now = std::chrono::steady_clock::now();
+    double step = 0.0;
+    if (started) {
+        step = std::chrono::duration<double>(now - last).count();
+        if (step > maxStep) step = maxStep;
+    }
+    last = now;
+    started = true;
+    return step;
+}
@@ -0,0 +1,74 @@
+/*========================================================================
+ * File: FrameScheduler.h
+ * Purpose: wall-clock frame timing and budget-driven tree depth
+ *======================================================================*/
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+
+// Picks the tree depth of each frame so that its cost (generation plus
+// drawing, as measured) fits a frame budget. Cost is modelled per
+// segment, so the scheduler can predict a depth it has not drawn yet
+// from the tree's segment count there.
+//
+// Hysteresis keeps the depth from flickering:
+//  - it drops one level only after DROP_FRAMES frames in a row are
+//    predicted to overrun the budget;
+//  - it rises one level only after RAISE_FRAMES frames in a row in which
+//    the deeper tree is predicted to take less than RAISE_FRACTION of
+//    the budget;
+//  - after any change it holds for HOLD_FRAMES frames.
+class FrameScheduler
+{
+    public:
+        static const int DROP_FRAMES = 3;
+        static const int RAISE_FRAMES = 30;
+        static const int HOLD_FRAMES = 30;
+        static constexpr double RAISE_FRACTION = 0.7;
+
+        // Starts at maxDepth; a budget <= 0 keeps it there
+        FrameScheduler(double budgetMs, int minDepth, int maxDepth);
+
+        int Depth() const { return depth; }
+        double BudgetMs() const { return budget; }
+        double CostPerSegmentMs() const { return costPerSegment; }
+
+        // Cost of a finished frame that drew segments at Depth()
+        void Report(double costMs, size_t segments);
+
+        // Depth for the next frame. segmentsAt(d) is the segment count
+        // at depth d with the next frame's parameters. Returns true if
+        // the depth changed.
+        bool Update(const std::function<size_t(int)>& segmentsAt);
+
+    private:
+        double budget;
+        int minDepth;
+        int maxDepth;
+        int depth;
+        double costPerSegment;      // smoothed, 0 until the first report
+        int overBudgetFrames;
+        int headroomFrames;
+        int holdFrames;
+};
+
+// Seconds between successive calls of Tick, for advancing animation by
+// real time. The first call returns 0, and longer pauses are clamped to
+// maxStep so a stall does not make the animation jump.
+class FrameClock
+{
+    public:
+        explicit FrameClock(double maxStepSeconds = 0.1);
+
+        double Tick();
+
+    private:
+        std::chrono::steady_clock::time_point last;
+        double maxStep;
+        bool started;
+};
+
+#endif // FRAMESCHEDULER_H
@@ -0,0 +1,160 @@
+/*========================================================================
+ * File: ImageWriter.cpp
+ * Purpose: implementation of the PPM and PNG writers
+ *======================================================================*/
+#include "ImageWriter.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+    // Closes a file written with unchecked writes: any of them failing
+    // (a full disk, say) sets the stream's error flag, and fclose
+    // reports what was still buffered
+    bool closeWritten(FILE* out)
+    {
+        bool failed = ferror(out) != 0;
+        if (fclose(out) != 0) failed = true;
+        return !failed;
+    }
+}
+
+bool writePPM(const char* path, int width, int height, const uint8_t* rgba)
+{
+    FILE* out = fopen(path, "wb");
+    if (!out) return false;
+
+    fprintf(out, "P6\n%d %d\n255\n", width, height);
+    std::vector<uint8_t> row((size_t)width * 3);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* source = rgba + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        fwrite(row.data(), 1, row.size(), out);
+    }
+    return closeWritten(out);
+}
+
+namespace {
+    struct CrcTable {
+        uint32_t entries[256];
+
+        CrcTable()
+        {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                entries[n] = c;
+            }
+        }
+    };
+
+    // Built once, on first use; the initialization of a function-local
+    // static is thread-safe, so sweep workers can write PNGs at once
+    const CrcTable& crcTable()
+    {
+        static const CrcTable table;
+        return table;
+    }
+
+    uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+    {
+        const uint32_t* table = crcTable().entries;
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void putBigEndian(std::vector<uint8_t>& out, uint32_t v)
+    {
+        out.push_back((uint8_t)(v >> 24));
+        out.push_back((uint8_t)(v >> 16));
+        out.push_back((uint8_t)(v >> 8));
+        out.push_back((uint8_t)v);
+    }
+
+    void writeChunk(FILE* out, const char* type, const std::vector<uint8_t>& data)
+    {
+        std::vector<uint8_t> chunk;
+        putBigEndian(chunk, (uint32_t)data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        uint32_t crc = crc32(0, chunk.data() + 4, chunk.size() - 4);
+        putBigEndian(chunk, crc);
+        fwrite(chunk.data(), 1, chunk.size(), out);
+    }
+}
+
+bool writePNG(const char* path, int width, int height, const uint8_t* rgba)
+{
+    FILE* out = fopen(path, "wb");
+    if (!out) return false;
+
+    const uint8_t signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    fwrite(signature, 1, sizeof(signature), out);
+
+    std::vector<uint8_t> header;
+    putBigEndian(header, (uint32_t)width);
+    putBigEndian(header, (uint32_t)height);
+    header.push_back(8);        // bits per channel
+    header.push_back(6);        // RGBA
+    header.push_back(0);        // deflate
+    header.push_back(0);        // adaptive filtering
+    header.push_back(0);        // no interlace
+    writeChunk(out, "IHDR", header);
+
+    // Scanlines, each prefixed with filter type 0
+    const size_t rowBytes = (size_t)width * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + y * rowBytes, rgba + (y + 1) * rowBytes);
+    }
+
+    // zlib stream of stored blocks, at most 65535 bytes each
+    std::vector<uint8_t> z;
+    z.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    z.push_back(0x78);
+    z.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t size = raw.size() - offset;
+        if (size > 65535) size = 65535;
+        bool last = offset + size == raw.size();
+        z.push_back(last ? 1 : 0);
+        z.push_back((uint8_t)size);
+        z.push_back((uint8_t)(size >> 8));
+        z.push_back((uint8_t)~size);
+        z.push_back((uint8_t)(~size >> 8));
+        z.insert(z.end(), raw.begin() + offset, raw.begin() + offset + size);
+        offset += size;
+    } while (offset < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBigEndian(z, (b << 16) | a);
+    writeChunk(out, "IDAT", z);
+    writeChunk(out, "IEND", std::vector<uint8_t>());
+
+    return closeWritten(out);
+}
+
+bool writeImage(const char* path, int width, int height, const uint8_t* rgba)
+{
+    size_t length = strlen(path);
+    if (length >= 4 && strcmp(path + length - 4, ".png") == 0) {
+        return writePNG(path, width, height, rgba);
+    }
+    return writePPM(path, width, height, rgba);
+}
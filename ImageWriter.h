@@ -0,0 +1,22 @@
+/*========================================================================
+ * File: ImageWriter.h
+ * Purpose: dependency-free PPM and PNG output of RGBA framebuffers
+ *======================================================================*/
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <cstdint>
+
+// Pixels are RGBA8, rows from top to bottom. All writers return false
+// if the file cannot be written.
+
+// Binary PPM (P6); alpha is dropped
+bool writePPM(const char* path, int width, int height, const uint8_t* rgba);
+
+// RGBA PNG with uncompressed (stored) deflate blocks
+bool writePNG(const char* path, int width, int height, const uint8_t* rgba);
+
+// PNG for names ending in .png, PPM otherwise
+bool writeImage(const char* path, int width, int height, const uint8_t* rgba);
+
+#endif // IMAGEWRITER_H
@@ -0,0 +1,100 @@
+/*========================================================================
+ * File: IndexedLines.cpp
+ * Purpose: implementation of the endpoint-sharing line builder
+ *======================================================================*/
+#include "IndexedLines.h"
+#include <algorithm>
+
+namespace {
+    // Position and style fill the 64 bits exactly
+    uint64_t vertexKey(int16_t x, int16_t y, int16_t z, uint16_t style)
+    {
+        return (uint64_t)(uint16_t)x
+             | (uint64_t)(uint16_t)y << 16
+             | (uint64_t)(uint16_t)z << 32
+             | (uint64_t)style << 48;
+    }
+
+    size_t hashKey(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return (size_t)key;
+    }
+}
+
+void IndexedLineBuilder::Build(const CompactSegmentStore& segments, IndexedLineBatch& out)
+{
+    out.Clear();
+    if (segments.Empty()) return;
+
+    // Open addressing at most half full, even with no endpoint shared
+    size_t tableSize = 16;
+    while (tableSize < segments.Size() * 4) tableSize *= 2;
+    if (slots.size() != tableSize) {
+        keys.resize(tableSize);
+        slots.assign(tableSize, 0);
+    } else {
+        std::fill(slots.begin(), slots.end(), 0);
+    }
+
+    // Width runs as in the non-indexed batch: one counting pass over
+    // the palette gives each run's offset into the index list
+    const std::vector<SegmentStyle>& styles = segments.Styles();
+    std::vector<int> styleCounts(styles.size(), 0);
+    for (const auto& line : segments.Segments()) {
+        styleCounts[line.style]++;
+    }
+
+    std::vector<int> widthCounts;
+    for (size_t i = 0; i < styles.size(); i++) {
+        int w = styles[i].width < 0 ? 0 : styles[i].width;
+        if (w >= (int)widthCounts.size()) widthCounts.resize(w + 1, 0);
+        widthCounts[w] += styleCounts[i];
+    }
+
+    std::vector<int> widthOffsets(widthCounts.size(), 0);
+    int indexOffset = 0;
+    for (size_t w = 0; w < widthCounts.size(); w++) {
+        if (widthCounts[w] == 0) continue;
+        LineWidthRange range;
+        range.width = (int)w;
+        range.first = indexOffset;
+        range.count = widthCounts[w] * 2;
+        out.ranges.push_back(range);
+        widthOffsets[w] = indexOffset;
+        indexOffset += range.count;
+    }
+
+    out.indices.resize(indexOffset);
+    for (const auto& line : segments.Segments()) {
+        int w = styles[line.style].width < 0 ? 0 : styles[line.style].width;
+        uint32_t* pair = &out.indices[widthOffsets[w]];
+        widthOffsets[w] += 2;
+        pair[0] = vertexFor(segments, line.x1, line.y1, line.z1, line.style, out);
+        pair[1] = vertexFor(segments, line.x2, line.y2, line.z2, line.style, out);
+    }
+}
+
+uint32_t IndexedLineBuilder::vertexFor(const CompactSegmentStore& segments, int16_t x, int16_t y,
+                                       int16_t z, uint16_t style, IndexedLineBatch& out)
+{
+    uint64_t key = vertexKey(x, y, z, style);
+    size_t mask = slots.size() - 1;
+    size_t i = hashKey(key) & mask;
+    while (slots[i] != 0) {
+        if (keys[i] == key) return slots[i] - 1;
+        i = (i + 1) & mask;
+    }
+
+    uint32_t index = (uint32_t)out.VertexCount();
+    keys[i] = key;
+    slots[i] = index + 1;
+
+    const float step = (float)segments.Step();
+    const SegmentStyle& s = segments.Styles()[style];
+    const float v[LineBatch::FLOATS_PER_VERTEX] = {x * step, y * step, z * step, s.r, s.g, s.b};
+    out.vertices.insert(out.vertices.end(), v, v + LineBatch::FLOATS_PER_VERTEX);
+    return index;
+}
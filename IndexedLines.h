@@ -0,0 +1,34 @@
+/*========================================================================
+ * File: IndexedLines.h
+ * Purpose: endpoint-sharing line geometry built from stored segments
+ *======================================================================*/
+#ifndef INDEXEDLINES_H
+#define INDEXEDLINES_H
+
+#include <cstdint>
+#include <vector>
+#include "CompactSegments.h"
+#include "LineBatch.h"
+
+// Packs segments into an IndexedLineBatch, merging endpoints that have
+// the same quantized position and style. All children of a branch start
+// at the same point with the same color, so a node with k children
+// stores its branch point once instead of k times: the tree needs about
+// (1 + 1/k) vertices per segment instead of 2.
+//
+// The builder keeps its hash table between calls, so rebuilding every
+// frame does not allocate once the largest frame has been seen.
+class IndexedLineBuilder
+{
+    public:
+        void Build(const CompactSegmentStore& segments, IndexedLineBatch& out);
+
+    private:
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> slots;    // vertex index + 1, 0 when empty
+
+        uint32_t vertexFor(const CompactSegmentStore& segments, int16_t x, int16_t y,
+                           int16_t z, uint16_t style, IndexedLineBatch& out);
+};
+
+#endif // INDEXEDLINES_H
@@ -0,0 +1,227 @@
+/*========================================================================
+ * File: InstancedTree.cpp
+ * Purpose: implementation of the instanced (IFS) tree representation
+ *======================================================================*/
+#include "InstancedTree.h"
+#include <cmath>
+
+Transform3D Transform3D::Identity()
+{
+    Transform3D result;
+    for (int c = 0; c < 3; c++) {
+        for (int r = 0; r < 3; r++) {
+            result.col[c][r] = (c == r) ? 1.0 : 0.0;
+        }
+        result.t[c] = 0.0;
+    }
+    return result;
+}
+
+Transform3D Transform3D::operator*(const Transform3D& other) const
+{
+    Transform3D result;
+    for (int c = 0; c < 3; c++) {
+        for (int r = 0; r < 3; r++) {
+            result.col[c][r] = col[0][r] * other.col[c][0]
+                             + col[1][r] * other.col[c][1]
+                             + col[2][r] * other.col[c][2];
+        }
+    }
+    Apply(other.t[0], other.t[1], other.t[2], result.t);
+    return result;
+}
+
+void Transform3D::Apply(double x, double y, double z, double out[3]) const
+{
+    for (int r = 0; r < 3; r++) {
+        out[r] = col[0][r] * x + col[1][r] * y + col[2][r] * z + t[r];
+    }
+}
+
+void Transform3D::ToMatrix(double out[16]) const
+{
+    for (int c = 0; c < 3; c++) {
+        out[c * 4 + 0] = col[c][0];
+        out[c * 4 + 1] = col[c][1];
+        out[c * 4 + 2] = col[c][2];
+        out[c * 4 + 3] = 0.0;
+    }
+    out[12] = t[0];
+    out[13] = t[1];
+    out[14] = t[2];
+    out[15] = 1.0;
+}
+
+InstancedTree::InstancedTree()
+    : maxDepth(0), root(Transform3D::Identity())
+{
+}
+
+// Trunk frame: X and Z are the perpendiculars the recursive generator
+// derives for the trunk, Y is the trunk itself, all scaled by its length
+static Transform3D trunkFrame(const BranchNode& trunk)
+{
+    Vec3 dir(trunk.dirX, trunk.dirY, trunk.dirZ);
+    Vec3 perp1(0, 0, 0), perp2(0, 0, 0);
+    branchBasis(dir, perp1, perp2);
+
+    const Vec3 axes[3] = {perp1, dir, perp2};
+    Transform3D frame;
+    for (int c = 0; c < 3; c++) {
+        frame.col[c][0] = axes[c].x * trunk.length;
+        frame.col[c][1] = axes[c].y * trunk.length;
+        frame.col[c][2] = axes[c].z * trunk.length;
+    }
+    frame.t[0] = trunk.x;
+    frame.t[1] = trunk.y;
+    frame.t[2] = trunk.z;
+    return frame;
+}
+
+// Child i of n in the parent's unit frame: rotate about the branch axis,
+// tilt away from it, move to the branch point and shrink by lambda
+static Transform3D childTransform(int i, int n, const TreeParams& params)
+{
+    double rotAngle = (2.0 * M_PI * i) / n;
+    double branchAngle = params.angle * M_PI / 180.0;
+    double cosRot = cos(rotAngle), sinRot = sin(rotAngle);
+    double cosBranch = cos(branchAngle), sinBranch = sin(branchAngle);
+
+    const double radial[3] = {cosRot, 0.0, sinRot};
+    const double tangent[3] = {-sinRot, 0.0, cosRot};
+
+    Transform3D child;
+    for (int r = 0; r < 3; r++) {
+        double axis = (r == 1) ? 1.0 : 0.0;
+        child.col[0][r] = (cosBranch * radial[r] - sinBranch * axis) * params.lambda;
+        child.col[1][r] = (cosBranch * axis + sinBranch * radial[r]) * params.lambda;
+        child.col[2][r] = tangent[r] * params.lambda;
+    }
+    child.t[0] = 0.0;
+    child.t[1] = params.factor;
+    child.t[2] = 0.0;
+    return child;
+}
+
+void InstancedTree::Build(const TreeParams& params, int depth)
+{
+    maxDepth = depth;
+    levels.assign(maxDepth + 1, Level());
+    if (maxDepth <= 0) return;
+
+    BranchNode trunk = rootBranch(maxDepth);
+    root = trunkFrame(trunk);
+
+    // Lengths shrink by the same repeated multiplication as the recursion
+    double length = trunk.length;
+    for (int d = maxDepth; d >= 1; d--) {
+        Level& level = levels[d];
+        level.live = length >= 0.5 && (d == maxDepth || levels[d + 1].live);
+        level.width = getLineWidthForLength(length);
+        level.color = getColorForDepth(d, maxDepth);
+
+        int n = getBranchCountForDepth(d, maxDepth, params.numBranches);
+        for (int i = 0; i < n; i++) {
+            level.children.push_back(childTransform(i, n, params));
+        }
+        length *= params.lambda;
+    }
+}
+
+size_t InstancedTree::NodeCountAtDepth(int depth) const
+{
+    if (depth < 1 || depth > maxDepth || !levels[depth].live) return 0;
+    size_t count = 1;
+    for (int d = maxDepth; d > depth; d--) {
+        count *= levels[d].children.size();
+    }
+    return count;
+}
+
+size_t InstancedTree::SegmentCount() const
+{
+    size_t total = 0;
+    for (int d = 1; d <= maxDepth; d++) {
+        total += NodeCountAtDepth(d);
+    }
+    return total;
+}
+
+size_t InstancedTree::TransformCount() const
+{
+    size_t total = 0;
+    for (const auto& level : levels) {
+        total += level.children.size();
+    }
+    return total;
+}
+
+int InstancedTree::ChooseInstanceDepth(size_t maxInstances) const
+{
+    for (int d = 1; d < maxDepth; d++) {
+        size_t count = NodeCountAtDepth(d);
+        if (count > 0 && count <= maxInstances) return d;
+    }
+    return maxDepth;
+}
+
+void InstancedTree::emit(const Transform3D& frame, int depth, SegmentSink& sink) const
+{
+    const Level& level = levels[depth];
+    Segment3D segment;
+    segment.x1 = frame.t[0];
+    segment.y1 = frame.t[1];
+    segment.z1 = frame.t[2];
+    segment.x2 = frame.t[0] + frame.col[1][0];
+    segment.y2 = frame.t[1] + frame.col[1][1];
+    segment.z2 = frame.t[2] + frame.col[1][2];
+    segment.r = level.color.r;
+    segment.g = level.color.g;
+    segment.b = level.color.b;
+    segment.width = level.width;
+    sink.AddSegment(segment);
+}
+
+void InstancedTree::expand(const Transform3D& frame, int depth, int stopDepth,
+                           SegmentSink& sink) const
+{
+    if (depth <= stopDepth || !levels[depth].live) return;
+
+    emit(frame, depth, sink);
+    for (const auto& child : levels[depth].children) {
+        expand(frame * child, depth - 1, stopDepth, sink);
+    }
+}
+
+void InstancedTree::collect(const Transform3D& frame, int depth, int target,
+                            std::vector<Transform3D>& out) const
+{
+    if (depth < target || !levels[depth].live) return;
+
+    if (depth == target) {
+        out.push_back(frame);
+        return;
+    }
+    for (const auto& child : levels[depth].children) {
+        collect(frame * child, depth - 1, target, out);
+    }
+}
+
+void InstancedTree::CollectInstances(int depth, std::vector<Transform3D>& out) const
+{
+    out.clear();
+    if (maxDepth <= 0) return;
+    collect(root, maxDepth, depth, out);
+}
+
+void InstancedTree::ExpandCanonical(int depth, SegmentSink& sink) const
+{
+    if (depth < 1 || depth > maxDepth) return;
+    expand(Transform3D::Identity(), depth, 0, sink);
+}
+
+void InstancedTree::ExpandAbove(int cutDepth, SegmentSink& sink) const
+{
+    if (maxDepth <= 0) return;
+    expand(root, maxDepth, cutDepth, sink);
+}
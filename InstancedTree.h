@@ -0,0 +1,82 @@
+/*========================================================================
+ * File: InstancedTree.h
+ * Purpose: IFS representation of the tree, one transform list per depth
+ *======================================================================*/
+#ifndef INSTANCEDTREE_H
+#define INSTANCEDTREE_H
+
+#include <cstddef>
+#include <vector>
+#include "TreeGenerator.h"
+
+// Similarity transform: linear part (rotation times uniform scale)
+// stored as columns, plus translation
+struct Transform3D {
+    double col[3][3];
+    double t[3];
+
+    static Transform3D Identity();
+
+    Transform3D operator*(const Transform3D& other) const;
+    void Apply(double x, double y, double z, double out[3]) const;
+
+    // Column-major 4x4, as glMultMatrixd expects
+    void ToMatrix(double out[16]) const;
+};
+
+// Every node is the unit branch (0,0,0)-(0,1,0) placed by a transform.
+// A child differs from its parent only by a fixed transform that depends
+// on its depth and slot, so storing one child list per depth describes
+// the whole tree in O(maxDepth * branches) memory. The child frame is
+// transported with the branch (rotate about the axis, then tilt), which
+// makes all subtrees at a depth exactly congruent; the recursive
+// generator instead re-derives its frame from a world up vector, so the
+// two agree on the first level and differ only by a twist about each
+// branch axis below it.
+class InstancedTree
+{
+    public:
+        InstancedTree();
+
+        void Build(const TreeParams& params, int maxDepth);
+
+        int MaxDepth() const { return maxDepth; }
+        size_t SegmentCount() const;
+        size_t TransformCount() const;          // stored child transforms
+        size_t NodeCountAtDepth(int depth) const;
+
+        // Depth closest to the tips whose node count fits in maxInstances
+        int ChooseInstanceDepth(size_t maxInstances) const;
+
+        // World transforms of every node at depth, in pre-order
+        void CollectInstances(int depth, std::vector<Transform3D>& out) const;
+
+        // Subtree rooted at depth, in the node's unit frame
+        void ExpandCanonical(int depth, SegmentSink& sink) const;
+
+        // World segments of every node deeper than cutDepth (closer to the trunk)
+        void ExpandAbove(int cutDepth, SegmentSink& sink) const;
+
+        // Full world-space tree, in pre-order
+        void Expand(SegmentSink& sink) const { ExpandAbove(0, sink); }
+
+    private:
+        struct Level {
+            bool live;                          // branches of this length are drawn
+            int width;
+            Color color;
+            std::vector<Transform3D> children;  // relative to the parent frame
+            Level() : live(false), width(1), color(0, 0, 0) {}
+        };
+
+        int maxDepth;
+        Transform3D root;
+        std::vector<Level> levels;              // indexed by depth
+
+        void emit(const Transform3D& frame, int depth, SegmentSink& sink) const;
+        void expand(const Transform3D& frame, int depth, int stopDepth, SegmentSink& sink) const;
+        void collect(const Transform3D& frame, int depth, int target,
+                     std::vector<Transform3D>& out) const;
+};
+
+#endif // INSTANCEDTREE_H
@@ -0,0 +1,94 @@
+/*========================================================================
+ * File: LineBatch.h
+ * Purpose: packed line geometry ready for a single vertex buffer upload
+ *======================================================================*/
+#ifndef LINEBATCH_H
+#define LINEBATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Contiguous run of vertices that share one line width
+struct LineWidthRange {
+    int width;
+    int first;      // first vertex of the run
+    int count;      // number of vertices (two per line)
+};
+
+// Non-owning view of batch data (e.g. a memory-mapped tree cache)
+struct LineBatchView {
+    const float* vertices;
+    size_t vertexCount;
+    const LineWidthRange* ranges;
+    size_t rangeCount;
+};
+
+// Interleaved x, y, z, r, g, b floats per vertex, sorted into width runs
+struct LineBatch {
+    static const int FLOATS_PER_VERTEX = 6;
+
+    std::vector<float> vertices;
+    std::vector<LineWidthRange> ranges;
+
+    void Clear()
+    {
+        vertices.clear();
+        ranges.clear();
+    }
+
+    size_t VertexCount() const { return vertices.size() / FLOATS_PER_VERTEX; }
+    size_t ByteSize() const { return vertices.size() * sizeof(float); }
+
+    LineBatchView View() const
+    {
+        LineBatchView view;
+        view.vertices = vertices.data();
+        view.vertexCount = VertexCount();
+        view.ranges = ranges.data();
+        view.rangeCount = ranges.size();
+        return view;
+    }
+};
+
+// Same vertex layout with each distinct vertex stored once; lines are
+// pairs of 32-bit indices, and the width runs count indices instead of
+// vertices
+struct IndexedLineBatch {
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<LineWidthRange> ranges;
+
+    void Clear()
+    {
+        vertices.clear();
+        indices.clear();
+        ranges.clear();
+    }
+
+    size_t VertexCount() const { return vertices.size() / LineBatch::FLOATS_PER_VERTEX; }
+    size_t VertexByteSize() const { return vertices.size() * sizeof(float); }
+    size_t IndexByteSize() const { return indices.size() * sizeof(uint32_t); }
+    size_t ByteSize() const { return VertexByteSize() + IndexByteSize(); }
+};
+
+// Same vertex layout again, as indexed triangles (three indices each)
+// drawn in one call; branch meshes have no width runs
+struct TriangleBatch {
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+
+    void Clear()
+    {
+        vertices.clear();
+        indices.clear();
+    }
+
+    size_t VertexCount() const { return vertices.size() / LineBatch::FLOATS_PER_VERTEX; }
+    size_t TriangleCount() const { return indices.size() / 3; }
+    size_t VertexByteSize() const { return vertices.size() * sizeof(float); }
+    size_t IndexByteSize() const { return indices.size() * sizeof(uint32_t); }
+    size_t ByteSize() const { return VertexByteSize() + IndexByteSize(); }
+};
+
+#endif // LINEBATCH_H
@@ -0,0 +1,140 @@
+/*========================================================================
+ * File: ParallelGenerator.cpp
+ * Purpose: implementation of the parallel tree generator
+ *======================================================================*/
+#include "ParallelGenerator.h"
+
+namespace {
+    // Appends into a buffer owned by one worker
+    class BufferSink : public SegmentSink
+    {
+        public:
+            explicit BufferSink(std::vector<Segment3D>& b) : buffer(b) {}
+
+            void AddSegment(const Segment3D& segment) override
+            {
+                buffer.push_back(segment);
+            }
+
+        private:
+            std::vector<Segment3D>& buffer;
+    };
+
+    // Aim for this many subtree tasks per worker so stealing can
+    // balance the uneven subtree sizes
+    const int TASKS_PER_THREAD = 8;
+}
+
+ParallelTreeGenerator::ParallelTreeGenerator(int threads)
+    : pool(threads), splitLevels(0)
+{
+    workerBuffers.resize(pool.ThreadCount());
+}
+
+int ParallelTreeGenerator::chooseSplitLevels(const TreeParams& params, int maxDepth) const
+{
+    if (splitLevels > 0) return splitLevels;
+
+    long tasks = 1;
+    int levels = 0;
+    for (int depth = maxDepth; depth > 1; depth--) {
+        if (tasks >= (long)pool.ThreadCount() * TASKS_PER_THREAD) break;
+        tasks *= getBranchCountForDepth(depth, maxDepth, params.numBranches);
+        levels++;
+    }
+    return levels;
+}
+
+void ParallelTreeGenerator::split(const StochasticNode& node, int levels, const TreeParams& params,
+                                  const TreeVariation* variation, int maxDepth)
+{
+    if (isTerminalBranch(node.branch)) return;
+
+    if (levels == 0) {
+        Piece piece;
+        piece.isTask = true;
+        piece.root = node;
+        piece.first = 0;
+        piece.count = 0;
+        piece.worker = -1;
+        pieces.push_back(piece);
+        return;
+    }
+
+    // This node's own segment goes inline, merged with a preceding inline piece
+    if (pieces.empty() || pieces.back().isTask) {
+        Piece piece;
+        piece.isTask = false;
+        piece.root = node;
+        piece.first = inlineSegments.size();
+        piece.count = 0;
+        piece.worker = -1;
+        pieces.push_back(piece);
+    }
+    BufferSink inlineSink(inlineSegments);
+    size_t before = inlineSegments.size();
+    emitBranchSegment(node.branch, maxDepth, inlineSink);
+    pieces.back().count += inlineSegments.size() - before;
+
+    int numBranches = getBranchCountForDepth(node.branch.depth, maxDepth, params.numBranches);
+    StochasticNode child;
+    for (int i = 0; i < numBranches; i++) {
+        if (variation) {
+            if (!stochasticChild(node, i, numBranches, params, *variation, child)) continue;
+        } else {
+            child.branch = childBranch(node.branch, i, numBranches, params);
+        }
+        split(child, levels - 1, params, variation, maxDepth);
+    }
+}
+
+void ParallelTreeGenerator::Generate(const TreeParams& params, int maxDepth, SegmentSink& sink)
+{
+    run(params, nullptr, maxDepth, sink);
+}
+
+void ParallelTreeGenerator::Generate(const TreeParams& params, const TreeVariation& variation,
+                                     int maxDepth, SegmentSink& sink)
+{
+    run(params, &variation, maxDepth, sink);
+}
+
+void ParallelTreeGenerator::run(const TreeParams& params, const TreeVariation* variation,
+                                int maxDepth, SegmentSink& sink)
+{
+    pieces.clear();
+    inlineSegments.clear();
+    for (auto& buffer : workerBuffers) {
+        buffer.clear();
+    }
+
+    split(stochasticRoot(maxDepth), chooseSplitLevels(params, maxDepth), params, variation, maxDepth);
+
+    for (auto& piece : pieces) {
+        if (!piece.isTask) continue;
+        Piece* target = &piece;
+        pool.Submit([this, target, &params, variation, maxDepth]() {
+            int worker = WorkStealingPool::CurrentWorker();
+            std::vector<Segment3D>& buffer = workerBuffers[worker];
+            BufferSink local(buffer);
+            target->worker = worker;
+            target->first = buffer.size();
+            if (variation) {
+                generateStochasticSubtree(target->root, params, *variation, maxDepth, local);
+            } else {
+                generateSubtree(target->root.branch, params, maxDepth, local);
+            }
+            target->count = buffer.size() - target->first;
+        });
+    }
+    pool.Wait();
+
+    // Concatenate in serial recursion order
+    for (const auto& piece : pieces) {
+        if (piece.count == 0) continue;
+        const Segment3D* source = piece.isTask
+            ? &workerBuffers[piece.worker][piece.first]
+            : &inlineSegments[piece.first];
+        sink.AddSegments(source, piece.count);
+    }
+}
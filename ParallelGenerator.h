@@ -0,0 +1,59 @@
+/*========================================================================
+ * File: ParallelGenerator.h
+ * Purpose: multi-threaded tree generation with serial output order
+ *======================================================================*/
+#ifndef PARALLELGENERATOR_H
+#define PARALLELGENERATOR_H
+
+#include <vector>
+#include "StochasticTree.h"
+#include "ThreadPool.h"
+#include "TreeGenerator.h"
+
+// Splits the top levels of the recursion into subtree tasks on a
+// work-stealing pool. Each worker appends into its own buffer; the
+// pieces are then forwarded in the order the serial recursion would
+// have produced them, so the output is bit-identical to generateTree.
+class ParallelTreeGenerator
+{
+    public:
+        // threads <= 0 uses the hardware concurrency
+        explicit ParallelTreeGenerator(int threads = 0);
+
+        // splitLevels <= 0 picks enough levels to keep every worker busy
+        void SetSplitLevels(int levels) { splitLevels = levels; }
+        int ThreadCount() const { return pool.ThreadCount(); }
+
+        void Generate(const TreeParams& params, int maxDepth, SegmentSink& sink);
+
+        // generateStochasticTree's output, bit for bit: the tasks carry
+        // their node's level index, so no random state is shared
+        void Generate(const TreeParams& params, const TreeVariation& variation,
+                      int maxDepth, SegmentSink& sink);
+
+    private:
+        // One piece of the output: either segments emitted while
+        // splitting, or the result of one subtree task
+        struct Piece {
+            bool isTask;
+            StochasticNode root;
+            size_t first;       // in inlineSegments or the worker buffer
+            size_t count;
+            int worker;
+        };
+
+        WorkStealingPool pool;
+        int splitLevels;
+        std::vector<Piece> pieces;
+        std::vector<Segment3D> inlineSegments;
+        std::vector<std::vector<Segment3D>> workerBuffers;
+
+        int chooseSplitLevels(const TreeParams& params, int maxDepth) const;
+        // variation is null for the regular tree
+        void split(const StochasticNode& node, int levels, const TreeParams& params,
+                   const TreeVariation* variation, int maxDepth);
+        void run(const TreeParams& params, const TreeVariation* variation,
+                 int maxDepth, SegmentSink& sink);
+};
+
+#endif // PARALLELGENERATOR_H
@@ -0,0 +1,179 @@
+/*========================================================================
+ * File: ParameterSweep.cpp
+ * Purpose: implementation of the parallel parameter sweep
+ *======================================================================*/
+#include "ParameterSweep.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "CompactSegments.h"
+#include "ImageWriter.h"
+#include "SegmentSink.h"
+#include "SoftwareRasterizer.h"
+
+double SweepRange::Value(int step) const
+{
+    if (steps <= 1) return first;
+    return first + (last - first) * step / (steps - 1);
+}
+
+size_t SweepSpec::Count() const
+{
+    size_t count = 1;
+    for (const SweepRange* range : {&lambda, &angle, &factor, &branches, &depth}) {
+        count *= (size_t)std::max(range->steps, 1);
+    }
+    return count;
+}
+
+void SweepSpec::Point(size_t index, TreeParams& params, int& maxDepth) const
+{
+    auto next = [&index](const SweepRange& range) {
+        int steps = std::max(range.steps, 1);
+        int step = (int)(index % steps);
+        index /= steps;
+        return range.Value(step);
+    };
+    params = defaultTreeParams();
+    params.factor = next(factor);
+    params.angle = next(angle);
+    params.lambda = next(lambda);
+    params.numBranches = (int)lround(next(branches));
+    maxDepth = (int)lround(next(depth));
+}
+
+SweepSpec defaultSweepSpec()
+{
+    TreeParams params = defaultTreeParams();
+    SweepSpec spec;
+    spec.lambda = {params.lambda, params.lambda, 1};
+    spec.angle = {params.angle, params.angle, 1};
+    spec.factor = {params.factor, params.factor, 1};
+    spec.branches = {(double)params.numBranches, (double)params.numBranches, 1};
+    spec.depth = {7.0, 7.0, 1};
+    return spec;
+}
+
+// Buffers kept by one pool thread between tasks
+struct ParameterSweep::Worker {
+    VectorSink segments;
+    CompactSegmentStore lines;
+    std::unique_ptr<SoftwareRasterizer> rasterizer;
+};
+
+ParameterSweep::ParameterSweep(int threads)
+    : pool(threads), thumbnailSize(160), view(defaultViewParams(160, 160)),
+      requestedColumns(0), columns(0), sheetWidth(0), sheetHeight(0)
+{
+    view.rotationX = 20.0;
+    for (int i = 0; i < pool.ThreadCount(); i++) {
+        workers.emplace_back(new Worker());
+    }
+}
+
+ParameterSweep::~ParameterSweep()
+{
+}
+
+void ParameterSweep::SetThumbnail(int size, double rotationX, double rotationY)
+{
+    thumbnailSize = std::max(size, 0);
+    view = defaultViewParams(std::max(size, 1), std::max(size, 1));
+    view.rotationX = rotationX;
+    view.rotationY = rotationY;
+}
+
+void ParameterSweep::SetColumns(int count)
+{
+    requestedColumns = std::max(count, 0);
+}
+
+void ParameterSweep::SetImageDirectory(const std::string& directory)
+{
+    imageDirectory = directory;
+}
+
+std::string ParameterSweep::ImagePath(size_t index) const
+{
+    if (imageDirectory.empty()) return std::string();
+    return imageDirectory + "/tree_" + std::to_string(index) + ".png";
+}
+
+bool ParameterSweep::Run(const SweepSpec& spec, std::vector<SweepResult>& results)
+{
+    size_t count = spec.Count();
+    results.assign(count, SweepResult());
+
+    columns = requestedColumns > 0 ? requestedColumns
+                                   : (int)std::ceil(std::sqrt((double)count));
+    int rows = (int)((count + columns - 1) / columns);
+    sheetWidth = thumbnailSize > 0 ? columns * thumbnailSize : 0;
+    sheetHeight = thumbnailSize > 0 ? rows * thumbnailSize : 0;
+    sheet.assign((size_t)sheetWidth * sheetHeight * 4, 0);
+    for (size_t i = 3; i < sheet.size(); i += 4) {
+        sheet[i] = 255;
+    }
+
+    for (auto& worker : workers) {
+        if (thumbnailSize > 0 && (!worker->rasterizer
+                                  || worker->rasterizer->Width() != thumbnailSize)) {
+            worker->rasterizer.reset(new SoftwareRasterizer(thumbnailSize, thumbnailSize, 1));
+        }
+    }
+
+    std::atomic<bool> ok(true);
+    for (size_t i = 0; i < count; i++) {
+        pool.Submit([this, &spec, &results, &ok, i]() {
+            Worker& worker = *workers[WorkStealingPool::CurrentWorker()];
+            if (!runOne(worker, spec, i, results[i])) ok = false;
+        });
+    }
+    pool.Wait();
+    return ok;
+}
+
+bool ParameterSweep::runOne(Worker& worker, const SweepSpec& spec, size_t index,
+                            SweepResult& result)
+{
+    spec.Point(index, result.params, result.maxDepth);
+
+    auto start = std::chrono::steady_clock::now();
+    worker.segments.segments.clear();
+    generateTree(result.params, result.maxDepth, worker.segments);
+    auto generated = std::chrono::steady_clock::now();
+    result.generateMs = std::chrono::duration<double, std::milli>(generated - start).count();
+
+    const std::vector<Segment3D>& segments = worker.segments.segments;
+    StatsSink stats;
+    stats.AddSegments(segments.data(), segments.size());
+    result.segments = stats.count;
+    result.lo[0] = stats.minX; result.lo[1] = stats.minY; result.lo[2] = stats.minZ;
+    result.hi[0] = stats.maxX; result.hi[1] = stats.maxY; result.hi[2] = stats.maxZ;
+    result.renderMs = 0.0;
+    if (thumbnailSize <= 0) return true;
+
+    SoftwareRasterizer& rasterizer = *worker.rasterizer;
+    worker.lines.Clear();
+    worker.lines.AddSegments(segments.data(), segments.size());
+    rasterizer.SetView(view);
+    rasterizer.Clear(0.0f, 0.0f, 0.0f);
+    rasterizer.DrawLines(worker.lines);
+    result.renderMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - generated).count();
+
+    // Copy into the cell, row by row
+    const uint8_t* pixels = rasterizer.Pixels().data();
+    size_t row = index / columns;
+    size_t column = index % columns;
+    size_t rowBytes = (size_t)thumbnailSize * 4;
+    for (int y = 0; y < thumbnailSize; y++) {
+        uint8_t* target = &sheet[((row * thumbnailSize + y) * sheetWidth
+                                  + column * thumbnailSize) * 4];
+        memcpy(target, pixels + y * rowBytes, rowBytes);
+    }
+
+    if (imageDirectory.empty()) return true;
+    return writeImage(ImagePath(index).c_str(), thumbnailSize, thumbnailSize, pixels);
+}
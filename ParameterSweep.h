@@ -0,0 +1,104 @@
+/*========================================================================
+ * File: ParameterSweep.h
+ * Purpose: batch generation and rendering of every combination of
+ *          tree parameter ranges, in parallel
+ *======================================================================*/
+#ifndef PARAMETERSWEEP_H
+#define PARAMETERSWEEP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+#include "TreeGenerator.h"
+#include "View.h"
+
+// steps evenly spaced values from first to last (both included); one
+// step is just first
+struct SweepRange {
+    double first;
+    double last;
+    int steps;
+
+    double Value(int step) const;
+};
+
+// The ranges swept. Branch counts and depths are rounded to integers;
+// factor varies fastest and depth slowest.
+struct SweepSpec {
+    SweepRange lambda;
+    SweepRange angle;
+    SweepRange factor;
+    SweepRange branches;
+    SweepRange depth;
+
+    size_t Count() const;
+    void Point(size_t index, TreeParams& params, int& maxDepth) const;
+};
+
+// Defaults to a single point: the viewer's parameters at depth 7
+SweepSpec defaultSweepSpec();
+
+struct SweepResult {
+    TreeParams params;
+    int maxDepth;
+    size_t segments;
+    double lo[3], hi[3];        // bounding box of the segment end points
+    double generateMs;
+    double renderMs;            // 0 without rendering
+};
+
+// Every combination is one task on a work-stealing pool. A worker keeps
+// its segment buffers and its rasterizer from one task to the next, so
+// after warming up a task allocates nothing. Each thumbnail is drawn on
+// the worker's own single-threaded rasterizer and copied into its cell
+// of the contact sheet. Cells do not overlap, so the sheet needs no
+// locking and does not depend on the thread count.
+class ParameterSweep
+{
+    public:
+        // threads <= 0 uses the hardware concurrency
+        explicit ParameterSweep(int threads = 0);
+        ~ParameterSweep();
+
+        // Thumbnails of size x size pixels seen as in the viewer; size 0
+        // only collects the statistics
+        void SetThumbnail(int size, double rotationX, double rotationY);
+        void SetColumns(int columns);               // 0: about square
+        // Also writes every thumbnail as DIR/tree_<index>.png
+        void SetImageDirectory(const std::string& directory);
+
+        // Results in index order. Returns false if an image could not be
+        // written.
+        bool Run(const SweepSpec& spec, std::vector<SweepResult>& results);
+
+        int ThreadCount() const { return pool.ThreadCount(); }
+        int Columns() const { return columns; }
+        int SheetWidth() const { return sheetWidth; }
+        int SheetHeight() const { return sheetHeight; }
+        const std::vector<uint8_t>& Sheet() const { return sheet; }
+
+        std::string ImagePath(size_t index) const;
+
+    private:
+        struct Worker;
+
+        WorkStealingPool pool;
+        std::vector<std::unique_ptr<Worker>> workers;
+        int thumbnailSize;
+        ViewParams view;
+        int requestedColumns;
+        int columns;
+        std::string imageDirectory;
+        int sheetWidth, sheetHeight;
+        std::vector<uint8_t> sheet;
+
+        bool runOne(Worker& worker, const SweepSpec& spec, size_t index, SweepResult& result);
+
+        ParameterSweep(const ParameterSweep&);
+        ParameterSweep& operator=(const ParameterSweep&);
+};
+
+#endif // PARAMETERSWEEP_H
@@ -0,0 +1,199 @@
+/*========================================================================
+ * File: Profiler.cpp
+ * Purpose: implementation of the frame profiler
+ *======================================================================*/
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "AllocationCounter.h"
+
+// Only AllocationCounter.cpp adds to these; without it they stay zero
+std::atomic<int> allocationCountingProfilers(0);
+std::atomic<uint64_t> allocationCountedBytes(0);
+
+namespace {
+
+    double percentileOf(std::vector<double> values, double p)
+    {
+        if (values.empty()) return 0.0;
+        size_t rank = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+        if (rank >= values.size()) rank = values.size() - 1;
+        std::nth_element(values.begin(), values.begin() + rank, values.end());
+        return values[rank];
+    }
+
+    bool endsWith(const char* text, const char* suffix)
+    {
+        size_t length = strlen(text);
+        size_t suffixLength = strlen(suffix);
+        return length >= suffixLength && strcmp(text + length - suffixLength, suffix) == 0;
+    }
+}
+
+uint64_t allocatedBytes()
+{
+    return allocationCountedBytes.load(std::memory_order_relaxed);
+}
+
+const char* profileStageName(ProfileStage stage)
+{
+    switch (stage) {
+        case PROFILE_GENERATE: return "generate";
+        case PROFILE_BUILD:    return "build";
+        case PROFILE_SUBMIT:   return "submit";
+        case PROFILE_SWAP:     return "swap";
+        case PROFILE_IDLE:     return "idle";
+        case PROFILE_FRAME:    return "frame";
+        case PROFILE_STAGE_COUNT: break;
+    }
+    return "?";
+}
+
+const char* profileCounterName(ProfileCounter counter)
+{
+    switch (counter) {
+        case PROFILE_SEGMENTS:        return "segments";
+        case PROFILE_RECURSION_CALLS: return "recursion_calls";
+        case PROFILE_BYTES_ALLOCATED: return "bytes_allocated";
+        case PROFILE_SHAPE_CACHE_HITS:   return "shape_cache_hits";
+        case PROFILE_SHAPE_CACHE_MISSES: return "shape_cache_misses";
+        case PROFILE_COUNTER_COUNT:   break;
+    }
+    return "?";
+}
+
+FrameProfiler::FrameProfiler(size_t windowFrames)
+    : allocatedAtStart(0), window(windowFrames > 0 ? windowFrames : 1), recentNext(0)
+{
+    allocationCountingProfilers.fetch_add(1);
+    for (auto& ring : recent) {
+        ring.reserve(window);
+    }
+    BeginFrame();
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    allocationCountingProfilers.fetch_sub(1);
+}
+
+void FrameProfiler::BeginFrame()
+{
+    memset(&current, 0, sizeof(current));
+    frameStart = std::chrono::steady_clock::now();
+    allocatedAtStart = allocatedBytes();
+}
+
+void FrameProfiler::AddTime(ProfileStage stage, double ms)
+{
+    current.ms[stage] += ms;
+}
+
+void FrameProfiler::AddCount(ProfileCounter counter, uint64_t count)
+{
+    current.counts[counter] += count;
+}
+
+void FrameProfiler::EndFrame()
+{
+    current.ms[PROFILE_FRAME] = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - frameStart).count();
+    current.counts[PROFILE_BYTES_ALLOCATED] = allocatedBytes() - allocatedAtStart;
+    records.push_back(current);
+
+    for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+        if (recent[s].size() < window) {
+            recent[s].push_back(current.ms[s]);
+        } else {
+            recent[s][recentNext] = current.ms[s];
+        }
+    }
+    recentNext = (recentNext + 1) % window;
+    BeginFrame();
+}
+
+double FrameProfiler::Percentile(ProfileStage stage, double p) const
+{
+    return percentileOf(recent[stage], p);
+}
+
+void FrameProfiler::PrintSummary(std::ostream& out) const
+{
+    char line[128];
+    snprintf(line, sizeof(line), "%-10s %9s %9s %9s  (last %zu frames)",
+             "stage ms", "p50", "p95", "p99", recent[0].size());
+    out << line << std::endl;
+    for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+        ProfileStage stage = (ProfileStage)s;
+        snprintf(line, sizeof(line), "%-10s %9.3f %9.3f %9.3f", profileStageName(stage),
+                 Percentile(stage, 50), Percentile(stage, 95), Percentile(stage, 99));
+        out << line << std::endl;
+    }
+}
+
+bool FrameProfiler::Write(const char* path) const
+{
+    return endsWith(path, ".json") ? writeJson(path) : writeCsv(path);
+}
+
+bool FrameProfiler::writeCsv(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+
+    fprintf(file, "frame");
+    for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+        fprintf(file, ",%s_ms", profileStageName((ProfileStage)s));
+    }
+    for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) {
+        fprintf(file, ",%s", profileCounterName((ProfileCounter)c));
+    }
+    fprintf(file, "\n");
+
+    for (size_t f = 0; f < records.size(); f++) {
+        fprintf(file, "%zu", f);
+        for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+            fprintf(file, ",%.4f", records[f].ms[s]);
+        }
+        for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) {
+            fprintf(file, ",%llu", (unsigned long long)records[f].counts[c]);
+        }
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
+
+bool FrameProfiler::writeJson(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+
+    fprintf(file, "{\n  \"summary\": {");
+    std::vector<double> values(records.size());
+    for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+        for (size_t f = 0; f < records.size(); f++) {
+            values[f] = records[f].ms[s];
+        }
+        fprintf(file, "%s\n    \"%s_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f}",
+                s ? "," : "", profileStageName((ProfileStage)s),
+                percentileOf(values, 50), percentileOf(values, 95), percentileOf(values, 99));
+    }
+    fprintf(file, "\n  },\n  \"frames\": [");
+
+    for (size_t f = 0; f < records.size(); f++) {
+        fprintf(file, "%s\n    {\"frame\": %zu", f ? "," : "", f);
+        for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+            fprintf(file, ", \"%s_ms\": %.4f", profileStageName((ProfileStage)s), records[f].ms[s]);
+        }
+        for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) {
+            fprintf(file, ", \"%s\": %llu", profileCounterName((ProfileCounter)c),
+                    (unsigned long long)records[f].counts[c]);
+        }
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,115 @@
+/*========================================================================
+ * File: Profiler.h
+ * Purpose: per-frame stage timers, counters and percentile summaries
+ *======================================================================*/
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+enum ProfileStage {
+    PROFILE_GENERATE,       // building the frame's segments
+    PROFILE_BUILD,          // packing them for the GPU (or rasterizer)
+    PROFILE_SUBMIT,         // issuing the draws
+    PROFILE_SWAP,           // presenting, including the vsync wait
+    PROFILE_IDLE,           // waiting for a new frame
+    PROFILE_FRAME,          // whole frame, filled in by EndFrame
+    PROFILE_STAGE_COUNT
+};
+
+enum ProfileCounter {
+    PROFILE_SEGMENTS,
+    PROFILE_RECURSION_CALLS,
+    PROFILE_BYTES_ALLOCATED,
+    PROFILE_SHAPE_CACHE_HITS,       // grid points found in the shape cache
+    PROFILE_SHAPE_CACHE_MISSES,     // and generated into it
+    PROFILE_COUNTER_COUNT
+};
+
+const char* profileStageName(ProfileStage stage);
+const char* profileCounterName(ProfileCounter counter);
+
+// Bytes allocated through operator new (on any thread) while counting is
+// on. Counting is off unless a FrameProfiler exists. Only programs that
+// link AllocationCounter.cpp count at all; in the others this is 0.
+uint64_t allocatedBytes();
+
+// Collects one record per frame: time per stage and the counters. All
+// records are kept for export; percentiles cover the last window frames.
+// Every call comes from the thread that draws. A profiler that was never
+// created costs nothing: instrumented code takes a FrameProfiler pointer
+// and skips even the clock reads when it is null.
+class FrameProfiler
+{
+    public:
+        explicit FrameProfiler(size_t window = 512);
+        ~FrameProfiler();
+
+        void BeginFrame();
+        void AddTime(ProfileStage stage, double ms);
+        void AddCount(ProfileCounter counter, uint64_t count);
+        void EndFrame();
+
+        size_t FrameCount() const { return records.size(); }
+
+        // p in [0, 100] over the rolling window
+        double Percentile(ProfileStage stage, double p) const;
+
+        // p50/p95/p99 of every stage over the rolling window
+        void PrintSummary(std::ostream& out) const;
+
+        // Per-frame records plus a whole-run summary: JSON for .json
+        // paths, CSV otherwise
+        bool Write(const char* path) const;
+
+    private:
+        struct FrameRecord {
+            double ms[PROFILE_STAGE_COUNT];
+            uint64_t counts[PROFILE_COUNTER_COUNT];
+        };
+
+        std::vector<FrameRecord> records;
+        FrameRecord current;
+        std::chrono::steady_clock::time_point frameStart;
+        uint64_t allocatedAtStart;
+
+        size_t window;
+        std::vector<double> recent[PROFILE_STAGE_COUNT];   // ring buffers
+        size_t recentNext;
+
+        bool writeCsv(const char* path) const;
+        bool writeJson(const char* path) const;
+};
+
+// Times the enclosing scope into one stage; nothing at all with a null
+// profiler
+class ProfileScope
+{
+    public:
+        ProfileScope(FrameProfiler* p, ProfileStage s) : profiler(p), stage(s)
+        {
+            if (profiler) start = std::chrono::steady_clock::now();
+        }
+
+        ~ProfileScope()
+        {
+            if (profiler) {
+                profiler->AddTime(stage, std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count());
+            }
+        }
+
+    private:
+        FrameProfiler* profiler;
+        ProfileStage stage;
+        std::chrono::steady_clock::time_point start;
+
+        ProfileScope(const ProfileScope&);
+        ProfileScope& operator=(const ProfileScope&);
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,106 @@
+/*========================================================================
+ * File: SegmentSink.h
+ * Purpose: destinations for generated tree segments (no window needed)
+ *======================================================================*/
+#ifndef SEGMENTSINK_H
+#define SEGMENTSINK_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// One generated branch with its display attributes
+struct Segment3D {
+    double x1, y1, z1, x2, y2, z2;
+    float r, g, b;
+    int width;
+};
+
+// Abstract receiver of generated segments
+class SegmentSink
+{
+    public:
+        virtual ~SegmentSink() {}
+
+        virtual void AddSegment(const Segment3D& segment) = 0;
+
+        // Bulk entry point; sinks with cheaper bulk paths override it
+        virtual void AddSegments(const Segment3D* segments, size_t count)
+        {
+            for (size_t i = 0; i < count; i++) {
+                AddSegment(segments[i]);
+            }
+        }
+};
+
+// Collects segments into a vector
+class VectorSink : public SegmentSink
+{
+    public:
+        std::vector<Segment3D> segments;
+
+        void AddSegment(const Segment3D& segment) override
+        {
+            segments.push_back(segment);
+        }
+
+        void AddSegments(const Segment3D* first, size_t count) override
+        {
+            segments.insert(segments.end(), first, first + count);
+        }
+};
+
+// Forwards every segment to a callable
+class CallbackSink : public SegmentSink
+{
+    public:
+        typedef std::function<void(const Segment3D&)> Callback;
+
+        explicit CallbackSink(Callback cb) : callback(cb) {}
+
+        void AddSegment(const Segment3D& segment) override
+        {
+            callback(segment);
+        }
+
+    private:
+        Callback callback;
+};
+
+// Keeps only the segment count and bounding box
+class StatsSink : public SegmentSink
+{
+    public:
+        size_t count;
+        double minX, minY, minZ;
+        double maxX, maxY, maxZ;
+
+        StatsSink() : count(0),
+                      minX(0), minY(0), minZ(0),
+                      maxX(0), maxY(0), maxZ(0) {}
+
+        void AddSegment(const Segment3D& s) override
+        {
+            if (count == 0) {
+                minX = maxX = s.x1;
+                minY = maxY = s.y1;
+                minZ = maxZ = s.z1;
+            }
+            include(s.x1, s.y1, s.z1);
+            include(s.x2, s.y2, s.z2);
+            count++;
+        }
+
+    private:
+        void include(double x, double y, double z)
+        {
+            if (x < minX) minX = x;
+            if (x > maxX) maxX = x;
+            if (y < minY) minY = y;
+            if (y > maxY) maxY = y;
+            if (z < minZ) minZ = z;
+            if (z > maxZ) maxZ = z;
+        }
+};
+
+#endif // SEGMENTSINK_H
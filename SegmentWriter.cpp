@@ -0,0 +1,271 @@
+/*========================================================================
+ * File: SegmentWriter.cpp
+ * Purpose: implementation of the streaming PLY, OBJ and raw writers
+ *======================================================================*/
+#include "SegmentWriter.h"
+#include <cstring>
+#include <string>
+
+ExportFormat exportFormatForPath(const char* path)
+{
+    size_t length = strlen(path);
+    if (length >= 4 && strcmp(path + length - 4, ".ply") == 0) return EXPORT_PLY;
+    if (length >= 4 && strcmp(path + length - 4, ".obj") == 0) return EXPORT_OBJ;
+    return EXPORT_RAW;
+}
+
+const char* exportFormatName(ExportFormat format)
+{
+    switch (format) {
+        case EXPORT_PLY: return "ply";
+        case EXPORT_OBJ: return "obj";
+        case EXPORT_RAW: return "raw";
+    }
+    return "?";
+}
+
+SegmentFileWriter::SegmentFileWriter(size_t bufferBytes)
+    : segmentCount(0), file(nullptr), buffer(bufferBytes > 256 ? bufferBytes : 256),
+      used(0), bytesWritten(0), failed(false)
+{
+}
+
+SegmentFileWriter::~SegmentFileWriter()
+{
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool SegmentFileWriter::Open(const char* path)
+{
+    file = fopen(path, "wb");
+    if (!file) return false;
+
+    segmentCount = 0;
+    used = 0;
+    bytesWritten = 0;
+    failed = false;
+    writeHeader();
+    return !failed;
+}
+
+bool SegmentFileWriter::Close()
+{
+    if (!file) return false;
+
+    writeFooter();
+    flush();
+    if (fclose(file) != 0) failed = true;
+    file = nullptr;
+    return !failed;
+}
+
+void SegmentFileWriter::AddSegment(const Segment3D& s)
+{
+    writeSegment(s);
+    segmentCount++;
+}
+
+void SegmentFileWriter::write(const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+    while (size > 0) {
+        if (used == buffer.size()) flush();
+        size_t room = buffer.size() - used;
+        size_t n = size < room ? size : room;
+        memcpy(&buffer[used], bytes, n);
+        used += n;
+        bytes += n;
+        size -= n;
+    }
+}
+
+void SegmentFileWriter::flush()
+{
+    if (used == 0) return;
+    if (fwrite(buffer.data(), 1, used, file) != used) failed = true;
+    bytesWritten += used;
+    used = 0;
+}
+
+// Overwrites bytes already written, then returns to the end
+void SegmentFileWriter::patch(long offset, const void* data, size_t size)
+{
+    flush();
+    if (fseek(file, offset, SEEK_SET) != 0 || fwrite(data, 1, size, file) != size
+        || fseek(file, 0, SEEK_END) != 0) {
+        failed = true;
+    }
+}
+
+namespace {
+    void putLittleEndian(unsigned char* out, uint64_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++) {
+            out[i] = (unsigned char)(v >> (8 * i));
+        }
+    }
+
+    void putFloat(unsigned char* out, float f)
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        putLittleEndian(out, bits, 4);
+    }
+
+    unsigned char toByte(float c)
+    {
+        if (c <= 0.0f) return 0;
+        if (c >= 1.0f) return 255;
+        return (unsigned char)(c * 255.0f + 0.5f);
+    }
+
+    // Binary PLY: two colored vertices per segment, then one edge per
+    // segment joining them. Counts are fixed-width so they can be
+    // patched once the stream ends.
+    class PlyWriter : public SegmentFileWriter
+    {
+        public:
+            explicit PlyWriter(size_t bufferBytes) : SegmentFileWriter(bufferBytes) {}
+
+        protected:
+            static const int VERTEX_BYTES = 15;
+            long vertexCountOffset = 0;
+            long edgeCountOffset = 0;
+
+            void writeHeader() override
+            {
+                std::string header = "ply\nformat binary_little_endian 1.0\n"
+                                     "comment boom tree segments\nelement vertex ";
+                vertexCountOffset = (long)header.size();
+                header += countField(0);
+                header += "\nproperty float x\nproperty float y\nproperty float z\n"
+                          "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+                          "element edge ";
+                edgeCountOffset = (long)header.size();
+                header += countField(0);
+                header += "\nproperty uint vertex1\nproperty uint vertex2\nend_header\n";
+                write(header.data(), header.size());
+            }
+
+            void writeSegment(const Segment3D& s) override
+            {
+                unsigned char v[2 * VERTEX_BYTES];
+                const double points[2][3] = {{s.x1, s.y1, s.z1}, {s.x2, s.y2, s.z2}};
+                for (int e = 0; e < 2; e++) {
+                    unsigned char* p = v + e * VERTEX_BYTES;
+                    putFloat(p + 0, (float)points[e][0]);
+                    putFloat(p + 4, (float)points[e][1]);
+                    putFloat(p + 8, (float)points[e][2]);
+                    p[12] = toByte(s.r);
+                    p[13] = toByte(s.g);
+                    p[14] = toByte(s.b);
+                }
+                write(v, sizeof(v));
+            }
+
+            void writeFooter() override
+            {
+                // Segment i joins vertices 2i and 2i + 1
+                unsigned char edge[8];
+                for (uint64_t i = 0; i < segmentCount; i++) {
+                    putLittleEndian(edge, 2 * i, 4);
+                    putLittleEndian(edge + 4, 2 * i + 1, 4);
+                    write(edge, sizeof(edge));
+                }
+                std::string vertices = countField(2 * segmentCount);
+                std::string edges = countField(segmentCount);
+                patch(vertexCountOffset, vertices.data(), vertices.size());
+                patch(edgeCountOffset, edges.data(), edges.size());
+            }
+
+            static std::string countField(uint64_t count)
+            {
+                char text[32];
+                snprintf(text, sizeof(text), "%020llu", (unsigned long long)count);
+                return text;
+            }
+    };
+
+    // Wavefront OBJ: colored vertices (the common "v x y z r g b"
+    // extension) and an "l" element per segment using relative indices,
+    // so nothing needs to be remembered between segments. OBJ has no
+    // line width.
+    class ObjWriter : public SegmentFileWriter
+    {
+        public:
+            explicit ObjWriter(size_t bufferBytes) : SegmentFileWriter(bufferBytes) {}
+
+        protected:
+            void writeHeader() override
+            {
+                const char header[] = "# boom tree segments\n";
+                write(header, sizeof(header) - 1);
+            }
+
+            void writeSegment(const Segment3D& s) override
+            {
+                char text[256];
+                int n = snprintf(text, sizeof(text),
+                                 "v %.6f %.6f %.6f %.4f %.4f %.4f\n"
+                                 "v %.6f %.6f %.6f %.4f %.4f %.4f\n"
+                                 "l -2 -1\n",
+                                 s.x1, s.y1, s.z1, s.r, s.g, s.b,
+                                 s.x2, s.y2, s.z2, s.r, s.g, s.b);
+                write(text, (size_t)n);
+            }
+
+            void writeFooter() override {}
+    };
+
+    class RawWriter : public SegmentFileWriter
+    {
+        public:
+            explicit RawWriter(size_t bufferBytes) : SegmentFileWriter(bufferBytes) {}
+
+        protected:
+            void writeHeader() override
+            {
+                unsigned char header[24];
+                memcpy(header, "BOOMSEG1", 8);
+                putLittleEndian(header + 8, RAW_SEGMENT_VERSION, 4);
+                putLittleEndian(header + 12, RAW_SEGMENT_RECORD_SIZE, 4);
+                putLittleEndian(header + 16, 0, 8);
+                write(header, sizeof(header));
+            }
+
+            void writeSegment(const Segment3D& s) override
+            {
+                unsigned char record[RAW_SEGMENT_RECORD_SIZE];
+                putFloat(record + 0, (float)s.x1);
+                putFloat(record + 4, (float)s.y1);
+                putFloat(record + 8, (float)s.z1);
+                putFloat(record + 12, (float)s.x2);
+                putFloat(record + 16, (float)s.y2);
+                putFloat(record + 20, (float)s.z2);
+                record[24] = toByte(s.r);
+                record[25] = toByte(s.g);
+                record[26] = toByte(s.b);
+                record[27] = (unsigned char)(s.width < 0 ? 0 : s.width > 255 ? 255 : s.width);
+                write(record, sizeof(record));
+            }
+
+            void writeFooter() override
+            {
+                unsigned char count[8];
+                putLittleEndian(count, segmentCount, 8);
+                patch(16, count, sizeof(count));
+            }
+    };
+}
+
+std::unique_ptr<SegmentFileWriter> createSegmentWriter(ExportFormat format, size_t bufferBytes)
+{
+    switch (format) {
+        case EXPORT_PLY: return std::unique_ptr<SegmentFileWriter>(new PlyWriter(bufferBytes));
+        case EXPORT_OBJ: return std::unique_ptr<SegmentFileWriter>(new ObjWriter(bufferBytes));
+        case EXPORT_RAW: break;
+    }
+    return std::unique_ptr<SegmentFileWriter>(new RawWriter(bufferBytes));
+}
@@ -0,0 +1,69 @@
+/*========================================================================
+ * File: SegmentWriter.h
+ * Purpose: streaming segment export to binary PLY, OBJ or raw files
+ *======================================================================*/
+#ifndef SEGMENTWRITER_H
+#define SEGMENTWRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "SegmentSink.h"
+
+enum ExportFormat {EXPORT_PLY, EXPORT_OBJ, EXPORT_RAW};
+
+// .ply and .obj by extension, raw otherwise
+ExportFormat exportFormatForPath(const char* path);
+const char* exportFormatName(ExportFormat format);
+
+// Raw format: a 24-byte header, then one 28-byte little-endian record
+// per segment
+//   header: "BOOMSEG1", uint32 version (1), uint32 record size (28),
+//           uint64 segment count
+//   record: float x1 y1 z1 x2 y2 z2, uint8 r g b, uint8 width
+const uint32_t RAW_SEGMENT_VERSION = 1;
+const uint32_t RAW_SEGMENT_RECORD_SIZE = 28;
+
+// Sink that streams segments to a file through a fixed-size buffer,
+// so memory use does not depend on the number of segments. Counts that
+// file headers need are patched in when the file is closed, which
+// requires a seekable file (not a pipe).
+class SegmentFileWriter : public SegmentSink
+{
+    public:
+        virtual ~SegmentFileWriter();
+
+        bool Open(const char* path);
+        bool Close();               // false if any write failed
+
+        void AddSegment(const Segment3D& s) override;
+
+        uint64_t SegmentCount() const { return segmentCount; }
+        uint64_t BytesWritten() const { return bytesWritten; }
+
+    protected:
+        explicit SegmentFileWriter(size_t bufferBytes);
+
+        void write(const void* data, size_t size);
+        void flush();
+        void patch(long offset, const void* data, size_t size);
+
+        virtual void writeHeader() = 0;
+        virtual void writeSegment(const Segment3D& s) = 0;
+        virtual void writeFooter() = 0;     // after the last segment
+
+        uint64_t segmentCount;
+
+    private:
+        FILE* file;
+        std::vector<char> buffer;
+        size_t used;
+        uint64_t bytesWritten;
+        bool failed;
+};
+
+std::unique_ptr<SegmentFileWriter> createSegmentWriter(ExportFormat format,
+                                                       size_t bufferBytes = 1 << 20);
+
+#endif // SEGMENTWRITER_H
@@ -0,0 +1,165 @@
+/*========================================================================
+ * File: ShapeCache.cpp
+ * Purpose: implementation of the quantized tree shape cache
+ *======================================================================*/
+#include "ShapeCache.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // FNV-1a over the segment count and each segment's color, which
+    // the generators take from the branch depth: trees with the same
+    // signature have the same shape in recursion order
+    uint64_t layoutSignature(const CompactSegmentStore& lines)
+    {
+        uint64_t hash = 1469598103934665603ULL;
+        auto mix = [&hash](const void* data, size_t size) {
+            const unsigned char* bytes = (const unsigned char*)data;
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ bytes[i]) * 1099511628211ULL;
+            }
+        };
+        size_t count = lines.Size();
+        mix(&count, sizeof(count));
+        for (const CompactSegment& s : lines.Segments()) {
+            const SegmentStyle& style = lines.StyleOf(s);
+            const float color[3] = {style.r, style.g, style.b};
+            mix(color, sizeof(color));
+        }
+        return hash;
+    }
+}
+
+ShapeGrid defaultShapeGrid()
+{
+    ShapeGrid grid;
+    grid.lambdaStep = 0.01;
+    grid.angleStep = 1.0;
+    grid.factorStep = 0.02;
+    return grid;
+}
+
+ShapeCache::ShapeCache(size_t maxSize, const ShapeGrid& shapeGrid, Lookup mode)
+    : maxBytes(maxSize), grid(shapeGrid), lookup(mode),
+      generator([](const TreeParams& params, int maxDepth, CompactSegmentStore& out) {
+          generateTree(params, maxDepth, out);
+      }),
+      bytes(0), hits(0), misses(0), evictions(0), fallbacks(0)
+{
+}
+
+void ShapeCache::SetGenerator(const Generator& g)
+{
+    generator = g;
+}
+
+void ShapeCache::Clear()
+{
+    entries.clear();
+    index.clear();
+    bytes = 0;
+}
+
+void ShapeCache::ResetStats()
+{
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+    fallbacks = 0;
+}
+
+// The tree at a grid point, moved to the front of the LRU list; params
+// carry the grid point's values
+const ShapeCache::Entry& ShapeCache::fetch(const Key& key, const TreeParams& params)
+{
+    auto found = index.find(key);
+    if (found != index.end()) {
+        hits++;
+        entries.splice(entries.begin(), entries, found->second);
+        return *found->second;
+    }
+
+    misses++;
+    entries.push_front(Entry());
+    Entry& entry = entries.front();
+    entry.key = key;
+    generator(params, std::get<4>(key), entry.lines);
+    entry.layout = layoutSignature(entry.lines);
+    index[key] = entries.begin();
+    bytes += entry.lines.ByteSize();
+    return entry;
+}
+
+// Drops least recently used trees until the budget holds, keeping the
+// first keep entries
+void ShapeCache::evict(size_t keep)
+{
+    while (bytes > maxBytes && entries.size() > keep) {
+        const Entry& last = entries.back();
+        bytes -= last.lines.ByteSize();
+        index.erase(last.key);
+        entries.pop_back();
+        evictions++;
+    }
+}
+
+void ShapeCache::Get(const TreeParams& params, int maxDepth, CompactSegmentStore& out)
+{
+    // Cell coordinates: the lower corner and the position inside the cell
+    const double values[3] = {params.lambda, params.angle, params.factor};
+    const double steps[3] = {grid.lambdaStep, grid.angleStep, grid.factorStep};
+    int64_t low[3];
+    double t[3];
+    for (int k = 0; k < 3; k++) {
+        double cell = values[k] / steps[k];
+        if (lookup == NEAREST) {
+            low[k] = (int64_t)std::llround(cell);
+            t[k] = 0.0;
+        } else {
+            low[k] = (int64_t)std::floor(cell);
+            t[k] = cell - low[k];
+        }
+    }
+
+    // Corners with a weight, each fetched (and kept) once
+    const CompactSegmentStore* corners[8];
+    bool sameLayout = true;
+    uint64_t layout = 0;
+    double weights[8];
+    int cornerCount = 0;
+    for (int c = 0; c < 8; c++) {
+        double weight = 1.0;
+        int64_t point[3];
+        for (int k = 0; k < 3; k++) {
+            bool upper = (c >> k) & 1;
+            weight *= upper ? t[k] : 1.0 - t[k];
+            point[k] = low[k] + (upper ? 1 : 0);
+        }
+        if (weight <= 0.0) continue;
+
+        TreeParams corner = params;
+        corner.lambda = point[0] * steps[0];
+        corner.angle = point[1] * steps[1];
+        corner.factor = point[2] * steps[2];
+        Key key(point[0], point[1], point[2], params.numBranches, maxDepth);
+        const Entry& entry = fetch(key, corner);
+        if (cornerCount > 0 && entry.layout != layout) sameLayout = false;
+        layout = entry.layout;
+        corners[cornerCount] = &entry.lines;
+        weights[cornerCount] = weight;
+        cornerCount++;
+    }
+
+    if (cornerCount == 1) {
+        out = *corners[0];
+    } else if (sameLayout) {
+        out.Blend(corners, weights, cornerCount);
+    } else {
+        // Segments do not correspond across the cutoff
+        fallbacks++;
+        out.Clear();
+        generator(params, maxDepth, out);
+    }
+
+    evict((size_t)cornerCount);
+}
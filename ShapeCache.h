@@ -0,0 +1,114 @@
+/*========================================================================
+ * File: ShapeCache.h
+ * Purpose: bounded LRU cache of generated trees keyed by quantized
+ *          shape parameters, for animations that revisit their shapes
+ *======================================================================*/
+#ifndef SHAPECACHE_H
+#define SHAPECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <tuple>
+#include "CompactSegments.h"
+#include "TreeGenerator.h"
+
+// Grid the continuous shape parameters are snapped to (all positive)
+struct ShapeGrid {
+    double lambdaStep;
+    double angleStep;       // degrees
+    double factorStep;
+};
+
+// 0.01 in lambda, 1 degree and 0.02 in factor
+ShapeGrid defaultShapeGrid();
+
+// The viewer's animation moves lambda, angle and factor along
+// sinusoids, so the same shapes come back again and again. The cache
+// keeps trees generated at grid points of (lambda, angle, factor),
+// for an exact branch count and depth, and answers a frame from them.
+//
+// NEAREST copies the tree at the closest grid point, so the shape moves
+// in steps of the grid. INTERPOLATE blends the corners of the grid
+// cell around the parameters (up to 8, fewer when a parameter sits on
+// the grid) segment by segment. The blend follows the parameters
+// smoothly, but is not the exact tree; finer grids bring it closer and
+// cost more misses.
+//
+// Segments only correspond when the corners have the same layout. The
+// same branch count and depth is not enough: the recursion stops at
+// branches shorter than 0.5, so corners on either side of that cutoff
+// (in lambda, or through a stochastic tree's length jitter) have
+// different segment counts and orders. Each cached tree keeps a layout
+// signature: its segment count and the depth colors in recursion
+// order. A cell whose corners disagree is not blended; the frame is
+// generated exactly instead (counted by Fallbacks).
+//
+// Trees are stored compact (14 bytes per segment). When the cache goes
+// over its byte budget, the least recently used trees are dropped, but
+// never the ones the current frame was built from.
+class ShapeCache
+{
+    public:
+        enum Lookup {NEAREST, INTERPOLATE};
+
+        // Fills a store with the tree for the parameters; the default
+        // is generateTree
+        typedef std::function<void(const TreeParams&, int, CompactSegmentStore&)> Generator;
+
+        explicit ShapeCache(size_t maxBytes, const ShapeGrid& grid = defaultShapeGrid(),
+                            Lookup lookup = INTERPOLATE);
+
+        void SetGenerator(const Generator& generator);
+        void Clear();
+
+        // The tree for params at maxDepth, from cached grid points;
+        // generates the missing ones
+        void Get(const TreeParams& params, int maxDepth, CompactSegmentStore& out);
+
+        // Grid point lookups (one per corner used) and how many of them
+        // had to be generated
+        uint64_t Lookups() const { return hits + misses; }
+        uint64_t Hits() const { return hits; }
+        uint64_t Misses() const { return misses; }
+        uint64_t Evictions() const { return evictions; }
+        // Interpolated lookups generated exactly because the corners'
+        // layouts differ
+        uint64_t Fallbacks() const { return fallbacks; }
+        double HitRate() const { return Lookups() ? (double)hits / Lookups() : 0.0; }
+        void ResetStats();
+
+        size_t EntryCount() const { return entries.size(); }
+        size_t ByteSize() const { return bytes; }
+        size_t MaxBytes() const { return maxBytes; }
+        const ShapeGrid& Grid() const { return grid; }
+        Lookup GetLookup() const { return lookup; }
+
+    private:
+        typedef std::tuple<int64_t, int64_t, int64_t, int, int> Key;
+
+        struct Entry {
+            Key key;
+            CompactSegmentStore lines;
+            uint64_t layout;
+        };
+
+        size_t maxBytes;
+        ShapeGrid grid;
+        Lookup lookup;
+        Generator generator;
+        std::list<Entry> entries;                   // most recently used first
+        std::map<Key, std::list<Entry>::iterator> index;
+        size_t bytes;
+        uint64_t hits, misses, evictions, fallbacks;
+
+        const Entry& fetch(const Key& key, const TreeParams& params);
+        void evict(size_t keep);
+
+        ShapeCache(const ShapeCache&);
+        ShapeCache& operator=(const ShapeCache&);
+};
+
+#endif // SHAPECACHE_H
@@ -0,0 +1,173 @@
+/*========================================================================
+ * File: SimdGenerator.cpp
+ * Purpose: implementation of the level-order generator and CPU dispatch
+ *======================================================================*/
+#include "SimdGenerator.h"
+#include "SimdKernel.h"
+#include <cstring>
+
+void computeChildrenScalar(const ChildKernelArgs& args)
+{
+    computeChildrenWith<ScalarPack<double>>(args);
+}
+
+void computeChildrenScalar(const ChildKernelArgsF& args)
+{
+    computeChildrenWith<ScalarPack<float>>(args);
+}
+
+SimdLevel detectSimdLevel()
+{
+#if defined(BOOM_X86_SIMD) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_SCALAR: return "scalar";
+        case SIMD_SSE2:   return "sse2";
+        case SIMD_AVX2:   return "avx2";
+    }
+    return "?";
+}
+
+bool parseSimdLevel(const char* name, SimdLevel& level)
+{
+    if (strcmp(name, "scalar") == 0) level = SIMD_SCALAR;
+    else if (strcmp(name, "sse2") == 0) level = SIMD_SSE2;
+    else if (strcmp(name, "avx2") == 0) level = SIMD_AVX2;
+    else return false;
+    return true;
+}
+
+template <typename Scalar>
+void LevelOrderGenerator::Frontier<Scalar>::Resize(size_t n)
+{
+    size = n;
+    if (x.size() < n) {
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+        dirX.resize(n);
+        dirY.resize(n);
+        dirZ.resize(n);
+    }
+}
+
+LevelOrderGenerator::LevelOrderGenerator(SimdLevel requested, TreePrecision requestedPrecision)
+    : level(requested), precision(requestedPrecision)
+{
+    SimdLevel supported = detectSimdLevel();
+    if (level > supported) level = supported;
+
+    switch (level) {
+        case SIMD_AVX2:
+            kernel = computeChildrenAvx2;
+            floatKernel = computeChildrenAvx2;
+            break;
+        case SIMD_SSE2:
+            kernel = computeChildrenSse2;
+            floatKernel = computeChildrenSse2;
+            break;
+        default:
+            kernel = computeChildrenScalar;
+            floatKernel = computeChildrenScalar;
+            break;
+    }
+}
+
+void LevelOrderGenerator::Generate(const TreeParams& params, int maxDepth, SegmentSink& sink)
+{
+    if (precision == PRECISION_FLOAT) {
+        generate<float>(params, maxDepth, sink, floatKernel, currentFloat, nextFloat);
+    } else {
+        generate<double>(params, maxDepth, sink, kernel, current, next);
+    }
+}
+
+// Parameters are rounded to Scalar exactly where childBranch rounds them
+template <typename Scalar>
+void LevelOrderGenerator::generate(const TreeParams& params, int maxDepth, SegmentSink& sink,
+                                   void (*levelKernel)(const ChildKernelArgsT<Scalar>&),
+                                   Frontier<Scalar>& current, Frontier<Scalar>& next)
+{
+    BranchNodeT<Scalar> trunk = rootBranch<Scalar>(maxDepth);
+    current.Resize(1);
+    current.x[0] = trunk.x;
+    current.y[0] = trunk.y;
+    current.z[0] = trunk.z;
+    current.dirX[0] = trunk.dirX;
+    current.dirY[0] = trunk.dirY;
+    current.dirZ[0] = trunk.dirZ;
+
+    double branchAngle = params.angle * M_PI / 180.0;
+    std::vector<Scalar> cosRot, sinRot;
+
+    Scalar length = trunk.length;
+    for (int depth = maxDepth; depth >= 1; depth--) {
+        // Same cutoff as isTerminalBranch
+        if (length < Scalar(0.5)) break;
+
+        // Every node of a level shares color, width and length
+        Color color = getColorForDepth(depth, maxDepth);
+        int width = getLineWidthForLength(length);
+        segments.resize(current.size);
+        for (size_t i = 0; i < current.size; i++) {
+            Segment3D& s = segments[i];
+            s.x1 = current.x[i];
+            s.y1 = current.y[i];
+            s.z1 = current.z[i];
+            s.x2 = current.x[i] + current.dirX[i] * length;
+            s.y2 = current.y[i] + current.dirY[i] * length;
+            s.z2 = current.z[i] + current.dirZ[i] * length;
+            s.r = color.r;
+            s.g = color.g;
+            s.b = color.b;
+            s.width = width;
+        }
+        sink.AddSegments(segments.data(), segments.size());
+
+        if (depth == 1) break;
+
+        int n = getBranchCountForDepth(depth, maxDepth, params.numBranches);
+        cosRot.resize(n);
+        sinRot.resize(n);
+        for (int i = 0; i < n; i++) {
+            double rotAngle = (2.0 * M_PI * i) / n;
+            cosRot[i] = (Scalar)cos(rotAngle);
+            sinRot[i] = (Scalar)sin(rotAngle);
+        }
+
+        next.Resize(current.size * n);
+        ChildKernelArgsT<Scalar> args;
+        args.x = current.x.data();
+        args.y = current.y.data();
+        args.z = current.z.data();
+        args.dirX = current.dirX.data();
+        args.dirY = current.dirY.data();
+        args.dirZ = current.dirZ.data();
+        args.count = current.size;
+        args.length = length;
+        args.factor = (Scalar)params.factor;
+        args.cosBranch = (Scalar)cos(branchAngle);
+        args.sinBranch = (Scalar)sin(branchAngle);
+        args.cosRot = cosRot.data();
+        args.sinRot = sinRot.data();
+        args.numBranches = n;
+        args.outX = next.x.data();
+        args.outY = next.y.data();
+        args.outZ = next.z.data();
+        args.outDirX = next.dirX.data();
+        args.outDirY = next.dirY.data();
+        args.outDirZ = next.dirZ.data();
+        levelKernel(args);
+
+        std::swap(current, next);
+        length *= (Scalar)params.lambda;
+    }
+}
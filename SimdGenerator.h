@@ -0,0 +1,63 @@
+/*========================================================================
+ * File: SimdGenerator.h
+ * Purpose: breadth-first tree generator with vectorized branch kernels
+ *======================================================================*/
+#ifndef SIMDGENERATOR_H
+#define SIMDGENERATOR_H
+
+#include <vector>
+#include "TreeGenerator.h"
+
+template <typename Scalar> struct ChildKernelArgsT;
+
+enum SimdLevel {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+
+// Best instruction set the running CPU supports
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
+// Parses "scalar", "sse2" or "avx2"; returns false on anything else
+bool parseSimdLevel(const char* name, SimdLevel& level);
+
+// Generates the tree one depth at a time. Each level's frontier is kept
+// as structure-of-arrays and all children of the frontier are computed
+// by a vector kernel chosen at run time. Every segment is bit-identical
+// to the recursion at the same precision; only the order differs: level
+// by level, and within a level grouped by child slot. Float kernels take
+// twice the lanes per instruction and read half the bytes.
+class LevelOrderGenerator
+{
+    public:
+        // Levels above what the CPU supports are lowered to what it has
+        explicit LevelOrderGenerator(SimdLevel level = detectSimdLevel(),
+                                     TreePrecision precision = PRECISION_DOUBLE);
+
+        SimdLevel Level() const { return level; }
+        TreePrecision Precision() const { return precision; }
+
+        void Generate(const TreeParams& params, int maxDepth, SegmentSink& sink);
+
+    private:
+        template <typename Scalar>
+        struct Frontier {
+            std::vector<Scalar> x, y, z, dirX, dirY, dirZ;
+            size_t size;
+
+            Frontier() : size(0) {}
+            void Resize(size_t n);
+        };
+
+        SimdLevel level;
+        TreePrecision precision;
+        void (*kernel)(const ChildKernelArgsT<double>& args);
+        void (*floatKernel)(const ChildKernelArgsT<float>& args);
+        Frontier<double> current, next;
+        Frontier<float> currentFloat, nextFloat;
+        std::vector<Segment3D> segments;
+
+        template <typename Scalar>
+        void generate(const TreeParams& params, int maxDepth, SegmentSink& sink,
+                      void (*levelKernel)(const ChildKernelArgsT<Scalar>&),
+                      Frontier<Scalar>& current, Frontier<Scalar>& next);
+};
+
+#endif // SIMDGENERATOR_H
@@ -0,0 +1,159 @@
+/*========================================================================
+ * File: SimdKernel.h
+ * Purpose: vectorizable child-branch kernel for the level-order generator
+ *          (included by one translation unit per instruction set)
+ *======================================================================*/
+#ifndef SIMDKERNEL_H
+#define SIMDKERNEL_H
+
+#include <cmath>
+#include <cstddef>
+
+// Inputs and outputs of one level step, all structure-of-arrays. Child
+// `slot` of parent p is written to index slot * count + p, so every
+// slot is a contiguous run and the stores stay aligned with the loads.
+// In float a vector holds twice the lanes of double, and the frontier
+// arrays are half the size.
+template <typename Scalar>
+struct ChildKernelArgsT {
+    const Scalar* x;
+    const Scalar* y;
+    const Scalar* z;
+    const Scalar* dirX;
+    const Scalar* dirY;
+    const Scalar* dirZ;
+    size_t count;
+
+    Scalar length;              // of the parents
+    Scalar factor;
+    Scalar cosBranch, sinBranch;
+    const Scalar* cosRot;       // one entry per slot
+    const Scalar* sinRot;
+    int numBranches;
+
+    Scalar* outX;
+    Scalar* outY;
+    Scalar* outZ;
+    Scalar* outDirX;
+    Scalar* outDirY;
+    Scalar* outDirZ;
+};
+
+typedef ChildKernelArgsT<double> ChildKernelArgs;
+typedef ChildKernelArgsT<float> ChildKernelArgsF;
+
+void computeChildrenScalar(const ChildKernelArgs& args);
+void computeChildrenSse2(const ChildKernelArgs& args);
+void computeChildrenAvx2(const ChildKernelArgs& args);
+void computeChildrenScalar(const ChildKernelArgsF& args);
+void computeChildrenSse2(const ChildKernelArgsF& args);
+void computeChildrenAvx2(const ChildKernelArgsF& args);
+
+// Everything below is compiled separately by each per-ISA translation
+// unit. It must not be shared through the linker (a copy built with AVX2
+// enabled would leak into the fallback path), hence the unnamed namespace.
+namespace {
+
+// One lane of plain scalars; also handles the tail of the vector kernels
+template <typename T>
+struct ScalarPack {
+    typedef T Scalar;
+    typedef bool Mask;
+    static const int WIDTH = 1;
+    T v;
+
+    static ScalarPack Load(const T* p) { ScalarPack r; r.v = *p; return r; }
+    static ScalarPack Set(T d) { ScalarPack r; r.v = d; return r; }
+    void Store(T* p) const { *p = v; }
+
+    friend ScalarPack operator+(ScalarPack a, ScalarPack b) { return Set(a.v + b.v); }
+    friend ScalarPack operator-(ScalarPack a, ScalarPack b) { return Set(a.v - b.v); }
+    friend ScalarPack operator*(ScalarPack a, ScalarPack b) { return Set(a.v * b.v); }
+    friend ScalarPack operator/(ScalarPack a, ScalarPack b) { return Set(a.v / b.v); }
+
+    static ScalarPack Sqrt(ScalarPack a) { return Set(std::sqrt(a.v)); }
+    static Mask AbsGreater(ScalarPack a, T limit) { return std::fabs(a.v) > limit; }
+    static Mask Less(ScalarPack a, T limit) { return a.v < limit; }
+    static ScalarPack Select(Mask m, ScalarPack a, ScalarPack b) { return m ? a : b; }
+};
+
+// The same arithmetic, in the same order and precision, as
+// childBranch/normalize in TreeGenerator.cpp, so every lane is
+// bit-identical to the recursion
+template <typename Pack>
+inline void normalizePack(Pack& x, Pack& y, Pack& z)
+{
+    typedef typename Pack::Scalar Scalar;
+    Pack len = Pack::Sqrt(x * x + y * y + z * z);
+    typename Pack::Mask tiny = Pack::Less(len, Scalar(0.0001));
+    x = Pack::Select(tiny, Pack::Set(0), x / len);
+    y = Pack::Select(tiny, Pack::Set(1), y / len);
+    z = Pack::Select(tiny, Pack::Set(0), z / len);
+}
+
+template <typename Pack>
+inline void childrenOfBlock(const ChildKernelArgsT<typename Pack::Scalar>& a, size_t p)
+{
+    typedef typename Pack::Scalar Scalar;
+    Pack x = Pack::Load(a.x + p), y = Pack::Load(a.y + p), z = Pack::Load(a.z + p);
+    Pack dx = Pack::Load(a.dirX + p), dy = Pack::Load(a.dirY + p), dz = Pack::Load(a.dirZ + p);
+
+    // Reference "up" vector, switched when the branch is nearly vertical
+    typename Pack::Mask vertical = Pack::AbsGreater(dy, Scalar(0.99));
+    Pack upX = Pack::Select(vertical, Pack::Set(1), Pack::Set(0));
+    Pack upY = Pack::Select(vertical, Pack::Set(0), Pack::Set(1));
+    Pack upZ = Pack::Set(0);
+
+    Pack p1x = dy * upZ - dz * upY;
+    Pack p1y = dz * upX - dx * upZ;
+    Pack p1z = dx * upY - dy * upX;
+    normalizePack(p1x, p1y, p1z);
+
+    Pack p2x = dy * p1z - dz * p1y;
+    Pack p2y = dz * p1x - dx * p1z;
+    Pack p2z = dx * p1y - dy * p1x;
+    normalizePack(p2x, p2y, p2z);
+
+    // Branch point, shared by all children
+    Pack length = Pack::Set(a.length), factor = Pack::Set(a.factor);
+    Pack bx = x + dx * length * factor;
+    Pack by = y + dy * length * factor;
+    Pack bz = z + dz * length * factor;
+
+    Pack cosBranch = Pack::Set(a.cosBranch), sinBranch = Pack::Set(a.sinBranch);
+    for (int i = 0; i < a.numBranches; i++) {
+        Pack c = Pack::Set(a.cosRot[i]), s = Pack::Set(a.sinRot[i]);
+        Pack rx = p1x * c + p2x * s;
+        Pack ry = p1y * c + p2y * s;
+        Pack rz = p1z * c + p2z * s;
+
+        Pack cx = dx * cosBranch + rx * sinBranch;
+        Pack cy = dy * cosBranch + ry * sinBranch;
+        Pack cz = dz * cosBranch + rz * sinBranch;
+        normalizePack(cx, cy, cz);
+
+        size_t out = (size_t)i * a.count + p;
+        bx.Store(a.outX + out);
+        by.Store(a.outY + out);
+        bz.Store(a.outZ + out);
+        cx.Store(a.outDirX + out);
+        cy.Store(a.outDirY + out);
+        cz.Store(a.outDirZ + out);
+    }
+}
+
+template <typename Pack>
+inline void computeChildrenWith(const ChildKernelArgsT<typename Pack::Scalar>& args)
+{
+    size_t p = 0;
+    for (; p + Pack::WIDTH <= args.count; p += Pack::WIDTH) {
+        childrenOfBlock<Pack>(args, p);
+    }
+    for (; p < args.count; p++) {
+        childrenOfBlock<ScalarPack<typename Pack::Scalar>>(args, p);
+    }
+}
+
+} // namespace
+
+#endif // SIMDKERNEL_H
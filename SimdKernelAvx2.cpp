@@ -0,0 +1,105 @@
+/*========================================================================
+ * File: SimdKernelAvx2.cpp
+ * Purpose: AVX2 build of the child-branch kernel (four doubles or eight
+ *          floats per vector), compiled with AVX2 enabled and only called
+ *          when the CPU has it
+ *======================================================================*/
+#include "SimdKernel.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace {
+    struct Avx2Pack {
+        typedef double Scalar;
+        typedef __m256d Mask;
+        static const int WIDTH = 4;
+        __m256d v;
+
+        static Avx2Pack Make(__m256d m) { Avx2Pack r; r.v = m; return r; }
+        static Avx2Pack Load(const double* p) { return Make(_mm256_loadu_pd(p)); }
+        static Avx2Pack Set(double d) { return Make(_mm256_set1_pd(d)); }
+        void Store(double* p) const { _mm256_storeu_pd(p, v); }
+
+        friend Avx2Pack operator+(Avx2Pack a, Avx2Pack b) { return Make(_mm256_add_pd(a.v, b.v)); }
+        friend Avx2Pack operator-(Avx2Pack a, Avx2Pack b) { return Make(_mm256_sub_pd(a.v, b.v)); }
+        friend Avx2Pack operator*(Avx2Pack a, Avx2Pack b) { return Make(_mm256_mul_pd(a.v, b.v)); }
+        friend Avx2Pack operator/(Avx2Pack a, Avx2Pack b) { return Make(_mm256_div_pd(a.v, b.v)); }
+
+        static Avx2Pack Sqrt(Avx2Pack a) { return Make(_mm256_sqrt_pd(a.v)); }
+        static Mask AbsGreater(Avx2Pack a, double limit)
+        {
+            __m256d abs = _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v);
+            return _mm256_cmp_pd(abs, _mm256_set1_pd(limit), _CMP_GT_OQ);
+        }
+        static Mask Less(Avx2Pack a, double limit)
+        {
+            return _mm256_cmp_pd(a.v, _mm256_set1_pd(limit), _CMP_LT_OQ);
+        }
+        static Avx2Pack Select(Mask m, Avx2Pack a, Avx2Pack b)
+        {
+            return Make(_mm256_blendv_pd(b.v, a.v, m));
+        }
+    };
+
+    struct Avx2FloatPack {
+        typedef float Scalar;
+        typedef __m256 Mask;
+        static const int WIDTH = 8;
+        __m256 v;
+
+        static Avx2FloatPack Make(__m256 m) { Avx2FloatPack r; r.v = m; return r; }
+        static Avx2FloatPack Load(const float* p) { return Make(_mm256_loadu_ps(p)); }
+        static Avx2FloatPack Set(float f) { return Make(_mm256_set1_ps(f)); }
+        void Store(float* p) const { _mm256_storeu_ps(p, v); }
+
+        friend Avx2FloatPack operator+(Avx2FloatPack a, Avx2FloatPack b) { return Make(_mm256_add_ps(a.v, b.v)); }
+        friend Avx2FloatPack operator-(Avx2FloatPack a, Avx2FloatPack b) { return Make(_mm256_sub_ps(a.v, b.v)); }
+        friend Avx2FloatPack operator*(Avx2FloatPack a, Avx2FloatPack b) { return Make(_mm256_mul_ps(a.v, b.v)); }
+        friend Avx2FloatPack operator/(Avx2FloatPack a, Avx2FloatPack b) { return Make(_mm256_div_ps(a.v, b.v)); }
+
+        static Avx2FloatPack Sqrt(Avx2FloatPack a) { return Make(_mm256_sqrt_ps(a.v)); }
+        static Mask AbsGreater(Avx2FloatPack a, float limit)
+        {
+            __m256 abs = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v);
+            return _mm256_cmp_ps(abs, _mm256_set1_ps(limit), _CMP_GT_OQ);
+        }
+        static Mask Less(Avx2FloatPack a, float limit)
+        {
+            return _mm256_cmp_ps(a.v, _mm256_set1_ps(limit), _CMP_LT_OQ);
+        }
+        static Avx2FloatPack Select(Mask m, Avx2FloatPack a, Avx2FloatPack b)
+        {
+            return Make(_mm256_blendv_ps(b.v, a.v, m));
+        }
+    };
+}
+
+void computeChildrenAvx2(const ChildKernelArgs& args)
+{
+    computeChildrenWith<Avx2Pack>(args);
+
+    // Unoptimized builds do not insert this; without it the caller's SSE
+    // code pays an AVX-SSE transition penalty on every instruction
+    _mm256_zeroupper();
+}
+
+void computeChildrenAvx2(const ChildKernelArgsF& args)
+{
+    computeChildrenWith<Avx2FloatPack>(args);
+    _mm256_zeroupper();
+}
+
+#else
+
+void computeChildrenAvx2(const ChildKernelArgs& args)
+{
+    computeChildrenWith<ScalarPack<double>>(args);
+}
+
+void computeChildrenAvx2(const ChildKernelArgsF& args)
+{
+    computeChildrenWith<ScalarPack<float>>(args);
+}
+
+#endif
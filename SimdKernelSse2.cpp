@@ -0,0 +1,99 @@
+/*========================================================================
+ * File: SimdKernelSse2.cpp
+ * Purpose: SSE2 build of the child-branch kernel (two doubles or four
+ *          floats per vector)
+ *======================================================================*/
+#include "SimdKernel.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+
+namespace {
+    struct Sse2Pack {
+        typedef double Scalar;
+        typedef __m128d Mask;
+        static const int WIDTH = 2;
+        __m128d v;
+
+        static Sse2Pack Make(__m128d m) { Sse2Pack r; r.v = m; return r; }
+        static Sse2Pack Load(const double* p) { return Make(_mm_loadu_pd(p)); }
+        static Sse2Pack Set(double d) { return Make(_mm_set1_pd(d)); }
+        void Store(double* p) const { _mm_storeu_pd(p, v); }
+
+        friend Sse2Pack operator+(Sse2Pack a, Sse2Pack b) { return Make(_mm_add_pd(a.v, b.v)); }
+        friend Sse2Pack operator-(Sse2Pack a, Sse2Pack b) { return Make(_mm_sub_pd(a.v, b.v)); }
+        friend Sse2Pack operator*(Sse2Pack a, Sse2Pack b) { return Make(_mm_mul_pd(a.v, b.v)); }
+        friend Sse2Pack operator/(Sse2Pack a, Sse2Pack b) { return Make(_mm_div_pd(a.v, b.v)); }
+
+        static Sse2Pack Sqrt(Sse2Pack a) { return Make(_mm_sqrt_pd(a.v)); }
+        static Mask AbsGreater(Sse2Pack a, double limit)
+        {
+            __m128d abs = _mm_andnot_pd(_mm_set1_pd(-0.0), a.v);
+            return _mm_cmpgt_pd(abs, _mm_set1_pd(limit));
+        }
+        static Mask Less(Sse2Pack a, double limit)
+        {
+            return _mm_cmplt_pd(a.v, _mm_set1_pd(limit));
+        }
+        static Sse2Pack Select(Mask m, Sse2Pack a, Sse2Pack b)
+        {
+            return Make(_mm_or_pd(_mm_and_pd(m, a.v), _mm_andnot_pd(m, b.v)));
+        }
+    };
+
+    struct Sse2FloatPack {
+        typedef float Scalar;
+        typedef __m128 Mask;
+        static const int WIDTH = 4;
+        __m128 v;
+
+        static Sse2FloatPack Make(__m128 m) { Sse2FloatPack r; r.v = m; return r; }
+        static Sse2FloatPack Load(const float* p) { return Make(_mm_loadu_ps(p)); }
+        static Sse2FloatPack Set(float f) { return Make(_mm_set1_ps(f)); }
+        void Store(float* p) const { _mm_storeu_ps(p, v); }
+
+        friend Sse2FloatPack operator+(Sse2FloatPack a, Sse2FloatPack b) { return Make(_mm_add_ps(a.v, b.v)); }
+        friend Sse2FloatPack operator-(Sse2FloatPack a, Sse2FloatPack b) { return Make(_mm_sub_ps(a.v, b.v)); }
+        friend Sse2FloatPack operator*(Sse2FloatPack a, Sse2FloatPack b) { return Make(_mm_mul_ps(a.v, b.v)); }
+        friend Sse2FloatPack operator/(Sse2FloatPack a, Sse2FloatPack b) { return Make(_mm_div_ps(a.v, b.v)); }
+
+        static Sse2FloatPack Sqrt(Sse2FloatPack a) { return Make(_mm_sqrt_ps(a.v)); }
+        static Mask AbsGreater(Sse2FloatPack a, float limit)
+        {
+            __m128 abs = _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v);
+            return _mm_cmpgt_ps(abs, _mm_set1_ps(limit));
+        }
+        static Mask Less(Sse2FloatPack a, float limit)
+        {
+            return _mm_cmplt_ps(a.v, _mm_set1_ps(limit));
+        }
+        static Sse2FloatPack Select(Mask m, Sse2FloatPack a, Sse2FloatPack b)
+        {
+            return Make(_mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v)));
+        }
+    };
+}
+
+void computeChildrenSse2(const ChildKernelArgs& args)
+{
+    computeChildrenWith<Sse2Pack>(args);
+}
+
+void computeChildrenSse2(const ChildKernelArgsF& args)
+{
+    computeChildrenWith<Sse2FloatPack>(args);
+}
+
+#else
+
+void computeChildrenSse2(const ChildKernelArgs& args)
+{
+    computeChildrenWith<ScalarPack<double>>(args);
+}
+
+void computeChildrenSse2(const ChildKernelArgsF& args)
+{
+    computeChildrenWith<ScalarPack<float>>(args);
+}
+
+#endif
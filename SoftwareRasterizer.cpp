@@ -0,0 +1,477 @@
+/*========================================================================
+ * File: SoftwareRasterizer.cpp
+ * Purpose: implementation of the CPU line and triangle rasterizer
+ *======================================================================*/
+#include "SoftwareRasterizer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Segments projected per task
+    const size_t PROJECT_CHUNK = 16384;
+
+    uint8_t toByte(float c)
+    {
+        if (c <= 0.0f) return 0;
+        if (c >= 1.0f) return 255;
+        return (uint8_t)(c * 255.0f + 0.5f);
+    }
+
+    // Column-major 4x4 product of two affine transforms
+    void multiply(const double a[16], const double b[16], double out[16])
+    {
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                out[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1]
+                               + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+            }
+        }
+    }
+
+    void transform(const double m[16], const float p[3], double out[3])
+    {
+        for (int r = 0; r < 3; r++) {
+            out[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+        }
+    }
+
+    // Twice the signed area of a, b, p; positive when p is on the same
+    // side of a -> b for every edge of a positively wound triangle
+    inline float edge(float ax, float ay, float bx, float by, float px, float py)
+    {
+        return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+    }
+
+    // Pixel centres exactly on an edge belong to one of the two
+    // triangles sharing it: the one that walks it upwards, or rightwards
+    // when it is horizontal
+    inline bool ownsEdge(float ax, float ay, float bx, float by)
+    {
+        return by < ay || (by == ay && bx > ax);
+    }
+}
+
+SoftwareRasterizer::SoftwareRasterizer(int w, int h, int threads)
+    : width(w), height(h),
+      tilesX((w + TILE_SIZE - 1) / TILE_SIZE), tilesY((h + TILE_SIZE - 1) / TILE_SIZE),
+      view(defaultViewParams(w, h)),
+      pixels((size_t)w * h * 4, 0), depth((size_t)w * h, 1.0f),
+      bins((size_t)tilesX * tilesY), pool(threads)
+{
+    Clear(0.0f, 0.0f, 0.0f);
+}
+
+void SoftwareRasterizer::SetView(const ViewParams& v)
+{
+    view = v;
+}
+
+void SoftwareRasterizer::Clear(float r, float g, float b)
+{
+    const uint8_t color[4] = {toByte(r), toByte(g), toByte(b), 255};
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        pixels[i + 0] = color[0];
+        pixels[i + 1] = color[1];
+        pixels[i + 2] = color[2];
+        pixels[i + 3] = color[3];
+    }
+    std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void SoftwareRasterizer::setupProjection(const double* model, Projection& out) const
+{
+    viewMatrix(view, out.toEye);
+    if (model) {
+        double viewOnly[16];
+        for (int i = 0; i < 16; i++) viewOnly[i] = out.toEye[i];
+        multiply(viewOnly, model, out.toEye);
+    }
+
+    viewFrustumSlopes(view, out.right, out.top);
+    const double n = view.nearPlane, f = view.farPlane;
+    out.nearPlane = n;
+    out.farPlane = f;
+    out.depthScale = -(f + n) / (f - n);
+    out.depthOffset = -2.0 * f * n / (f - n);
+}
+
+void SoftwareRasterizer::projectLine(const Projection& projection, const float p[6],
+                                     float r, float g, float b, int lineWidth,
+                                     ScreenLine& line) const
+{
+    double a[3], e[3];
+    transform(projection.toEye, p, a);
+    transform(projection.toEye, p + 3, e);
+
+    // Clip against the near and far planes (z = -n and z = -f)
+    const double n = projection.nearPlane, f = projection.farPlane;
+    double t0 = 0.0, t1 = 1.0;
+    const double planes[2][2] = {{-n, -1.0}, {-f, 1.0}};   // inside: side * (z - plane) >= 0
+    line.visible = 0;
+    bool clipped = false;
+    for (int k = 0; k < 2 && !clipped; k++) {
+        double da = planes[k][1] * (a[2] - planes[k][0]);
+        double db = planes[k][1] * (e[2] - planes[k][0]);
+        if (da < 0.0 && db < 0.0) {
+            clipped = true;
+        } else if (da < 0.0) {
+            t0 = std::max(t0, da / (da - db));
+        } else if (db < 0.0) {
+            t1 = std::min(t1, da / (da - db));
+        }
+    }
+    if (clipped || t0 > t1) return;
+
+    double ends[2][3];
+    const double ts[2] = {t0, t1};
+    for (int k = 0; k < 2; k++) {
+        double eye[3];
+        for (int c = 0; c < 3; c++) {
+            eye[c] = a[c] + (e[c] - a[c]) * ts[k];
+        }
+        double w = -eye[2];
+        double ndcX = eye[0] / w / projection.right;
+        double ndcY = eye[1] / w / projection.top;
+        double ndcZ = (projection.depthScale * eye[2] + projection.depthOffset) / w;
+        ends[k][0] = (ndcX + 1.0) * 0.5 * width;
+        ends[k][1] = (1.0 - ndcY) * 0.5 * height;
+        ends[k][2] = (ndcZ + 1.0) * 0.5;
+    }
+
+    line.x0 = (float)ends[0][0];
+    line.y0 = (float)ends[0][1];
+    line.z0 = (float)ends[0][2];
+    line.x1 = (float)ends[1][0];
+    line.y1 = (float)ends[1][1];
+    line.z1 = (float)ends[1][2];
+    line.r = toByte(r);
+    line.g = toByte(g);
+    line.b = toByte(b);
+    line.width = lineWidth < 1 ? 1 : lineWidth;
+    line.visible = 1;
+}
+
+void SoftwareRasterizer::project(const CompactSegmentStore& lines, const double* model,
+                                 size_t first, size_t count, ScreenLine* out) const
+{
+    Projection projection;
+    setupProjection(model, projection);
+
+    const std::vector<CompactSegment>& segments = lines.Segments();
+    float p[6];
+    for (size_t i = 0; i < count; i++) {
+        const CompactSegment& segment = segments[first + i];
+        const SegmentStyle& style = lines.StyleOf(segment);
+        lines.Decode(segment, p);
+        projectLine(projection, p, style.r, style.g, style.b, style.width, out[i]);
+    }
+}
+
+// Lines first .. first + count of the batch; the width comes from the
+// run each line falls in
+void SoftwareRasterizer::projectBatch(const LineBatchView& lines, size_t first, size_t count,
+                                      ScreenLine* out) const
+{
+    Projection projection;
+    setupProjection(nullptr, projection);
+
+    size_t range = 0;
+    float p[6];
+    for (size_t i = 0; i < count; i++) {
+        size_t vertex = 2 * (first + i);
+        while (range + 1 < lines.rangeCount
+               && vertex >= (size_t)lines.ranges[range].first + lines.ranges[range].count) {
+            range++;
+        }
+        const float* v = lines.vertices + vertex * LineBatch::FLOATS_PER_VERTEX;
+        const float* next = v + LineBatch::FLOATS_PER_VERTEX;
+        p[0] = v[0];    p[1] = v[1];    p[2] = v[2];
+        p[3] = next[0]; p[4] = next[1]; p[5] = next[2];
+        projectLine(projection, p, v[3], v[4], v[5], lines.ranges[range].width, out[i]);
+    }
+}
+
+// Vertices first .. first + count of a triangle batch
+void SoftwareRasterizer::projectVertices(const float* vertices, size_t first, size_t count,
+                                         ScreenVertex* out) const
+{
+    Projection projection;
+    setupProjection(nullptr, projection);
+
+    for (size_t i = 0; i < count; i++) {
+        const float* v = vertices + (first + i) * LineBatch::FLOATS_PER_VERTEX;
+        ScreenVertex& vertex = out[i];
+        double eye[3];
+        transform(projection.toEye, v, eye);
+        vertex.visible = -eye[2] >= projection.nearPlane && -eye[2] <= projection.farPlane;
+        if (!vertex.visible) continue;
+
+        double w = -eye[2];
+        double ndcX = eye[0] / w / projection.right;
+        double ndcY = eye[1] / w / projection.top;
+        double ndcZ = (projection.depthScale * eye[2] + projection.depthOffset) / w;
+        vertex.x = (float)((ndcX + 1.0) * 0.5 * width);
+        vertex.y = (float)((1.0 - ndcY) * 0.5 * height);
+        vertex.z = (float)((ndcZ + 1.0) * 0.5);
+        vertex.r = v[3];
+        vertex.g = v[4];
+        vertex.b = v[5];
+    }
+}
+
+void SoftwareRasterizer::bin()
+{
+    for (auto& b : bins) {
+        b.clear();
+    }
+
+    for (size_t i = 0; i < screenLines.size(); i++) {
+        const ScreenLine& line = screenLines[i];
+        if (!line.visible) continue;
+
+        float pad = line.width * 0.5f + 1.0f;
+        float minX = std::min(line.x0, line.x1) - pad;
+        float maxX = std::max(line.x0, line.x1) + pad;
+        float minY = std::min(line.y0, line.y1) - pad;
+        float maxY = std::max(line.y0, line.y1) + pad;
+        if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height) continue;
+
+        int tx0 = std::max(0, (int)(std::max(minX, 0.0f) / TILE_SIZE));
+        int ty0 = std::max(0, (int)(std::max(minY, 0.0f) / TILE_SIZE));
+        int tx1 = std::min(tilesX - 1, (int)(std::min(maxX, (float)width - 1) / TILE_SIZE));
+        int ty1 = std::min(tilesY - 1, (int)(std::min(maxY, (float)height - 1) / TILE_SIZE));
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                bins[(size_t)ty * tilesX + tx].push_back((uint32_t)i);
+            }
+        }
+    }
+}
+
+// Aliased GL-style line: one pixel per column (or row) along the major
+// axis, sampled at pixel centres, widened along the minor axis. Only
+// the part inside [x0, x1) x [y0, y1) is written.
+void SoftwareRasterizer::drawSpan(const ScreenLine& line, int x0, int y0, int x1, int y1)
+{
+    float dx = line.x1 - line.x0;
+    float dy = line.y1 - line.y0;
+    bool xMajor = fabsf(dx) >= fabsf(dy);
+    float major = xMajor ? dx : dy;
+    if (major == 0.0f) return;
+
+    float start = xMajor ? line.x0 : line.y0;
+    float minorStart = xMajor ? line.y0 : line.x0;
+    float minorDelta = xMajor ? dy : dx;
+    float low = std::min(start, start + major);
+    float high = std::max(start, start + major);
+
+    int limitLow = xMajor ? x0 : y0;
+    int limitHigh = xMajor ? x1 : y1;
+    int minorLow = xMajor ? y0 : x0;
+    int minorHigh = xMajor ? y1 : x1;
+    int first = std::max(limitLow, (int)ceilf(std::max(low, (float)limitLow - 1.0f) - 0.5f));
+    int last = std::min(limitHigh, (int)ceilf(std::min(high, (float)limitHigh + 1.0f) - 0.5f));
+
+    const int w = line.width;
+    for (int p = first; p < last; p++) {
+        float t = (p + 0.5f - start) / major;
+        float minor = minorStart + t * minorDelta;
+        float z = line.z0 + t * (line.z1 - line.z0);
+        minor = std::min(std::max(minor, (float)minorLow - w - 1), (float)minorHigh + w + 1);
+        int m0 = (int)floorf(minor) - (w - 1) / 2;
+        int m1 = std::min(m0 + w, minorHigh);
+        for (int m = std::max(m0, minorLow); m < m1; m++) {
+            size_t index = xMajor ? (size_t)m * width + p : (size_t)p * width + m;
+            if (z < depth[index]) {
+                depth[index] = z;
+                uint8_t* pixel = &pixels[index * 4];
+                pixel[0] = line.r;
+                pixel[1] = line.g;
+                pixel[2] = line.b;
+                pixel[3] = 255;
+            }
+        }
+    }
+}
+
+void SoftwareRasterizer::binTriangles(const std::vector<uint32_t>& indices)
+{
+    for (auto& b : bins) {
+        b.clear();
+    }
+
+    const size_t triangleCount = indices.size() / 3;
+    for (size_t i = 0; i < triangleCount; i++) {
+        const ScreenVertex& a = screenVertices[indices[3 * i]];
+        const ScreenVertex& b = screenVertices[indices[3 * i + 1]];
+        const ScreenVertex& c = screenVertices[indices[3 * i + 2]];
+        if (!a.visible || !b.visible || !c.visible) continue;
+
+        float minX = std::min(a.x, std::min(b.x, c.x));
+        float maxX = std::max(a.x, std::max(b.x, c.x));
+        float minY = std::min(a.y, std::min(b.y, c.y));
+        float maxY = std::max(a.y, std::max(b.y, c.y));
+        if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height) continue;
+
+        int tx0 = std::max(0, (int)(std::max(minX, 0.0f) / TILE_SIZE));
+        int ty0 = std::max(0, (int)(std::max(minY, 0.0f) / TILE_SIZE));
+        int tx1 = std::min(tilesX - 1, (int)(std::min(maxX, (float)width - 1) / TILE_SIZE));
+        int ty1 = std::min(tilesY - 1, (int)(std::min(maxY, (float)height - 1) / TILE_SIZE));
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                bins[(size_t)ty * tilesX + tx].push_back((uint32_t)i);
+            }
+        }
+    }
+}
+
+// Fills the part of the triangle inside [x0, x1) x [y0, y1); both
+// windings are drawn
+void SoftwareRasterizer::fillTriangle(const ScreenVertex& a, const ScreenVertex& first,
+                                      const ScreenVertex& second, int x0, int y0, int x1, int y1)
+{
+    float area = edge(a.x, a.y, first.x, first.y, second.x, second.y);
+    if (area == 0.0f) return;
+    const ScreenVertex& b = area > 0.0f ? first : second;
+    const ScreenVertex& c = area > 0.0f ? second : first;
+    area = fabsf(area);
+
+    int minX = std::max(x0, (int)floorf(std::min(a.x, std::min(b.x, c.x))));
+    int maxX = std::min(x1 - 1, (int)ceilf(std::max(a.x, std::max(b.x, c.x))));
+    int minY = std::max(y0, (int)floorf(std::min(a.y, std::min(b.y, c.y))));
+    int maxY = std::min(y1 - 1, (int)ceilf(std::max(a.y, std::max(b.y, c.y))));
+    if (minX > maxX || minY > maxY) return;
+
+    const bool ownsA = ownsEdge(b.x, b.y, c.x, c.y);     // edge opposite a
+    const bool ownsB = ownsEdge(c.x, c.y, a.x, a.y);
+    const bool ownsC = ownsEdge(a.x, a.y, b.x, b.y);
+    // Weight changes per pixel step in x
+    const float stepA = -(c.y - b.y), stepB = -(a.y - c.y), stepC = -(b.y - a.y);
+    const float inverse = 1.0f / area;
+
+    for (int y = minY; y <= maxY; y++) {
+        float px = minX + 0.5f, py = y + 0.5f;
+        float wa = edge(b.x, b.y, c.x, c.y, px, py);
+        float wb = edge(c.x, c.y, a.x, a.y, px, py);
+        float wc = edge(a.x, a.y, b.x, b.y, px, py);
+        for (int x = minX; x <= maxX; x++, wa += stepA, wb += stepB, wc += stepC) {
+            if (wa < 0.0f || wb < 0.0f || wc < 0.0f) continue;
+            if ((wa == 0.0f && !ownsA) || (wb == 0.0f && !ownsB) || (wc == 0.0f && !ownsC)) {
+                continue;
+            }
+            float la = wa * inverse, lb = wb * inverse, lc = wc * inverse;
+            float z = la * a.z + lb * b.z + lc * c.z;
+            size_t index = (size_t)y * width + x;
+            if (z < depth[index]) {
+                depth[index] = z;
+                uint8_t* pixel = &pixels[index * 4];
+                pixel[0] = toByte(la * a.r + lb * b.r + lc * c.r);
+                pixel[1] = toByte(la * a.g + lb * b.g + lc * c.g);
+                pixel[2] = toByte(la * a.b + lb * b.b + lc * c.b);
+                pixel[3] = 255;
+            }
+        }
+    }
+}
+
+void SoftwareRasterizer::rasterizeTile(int tile)
+{
+    int x0 = (tile % tilesX) * TILE_SIZE;
+    int y0 = (tile / tilesX) * TILE_SIZE;
+    int x1 = std::min(x0 + TILE_SIZE, width);
+    int y1 = std::min(y0 + TILE_SIZE, height);
+    for (uint32_t index : bins[tile]) {
+        drawSpan(screenLines[index], x0, y0, x1, y1);
+    }
+}
+
+void SoftwareRasterizer::DrawLines(const CompactSegmentStore& lines,
+                                   const double* models, size_t modelCount)
+{
+    const size_t perModel = lines.Size();
+    const size_t passes = models ? modelCount : 1;
+    screenLines.resize(perModel * passes);
+    if (screenLines.empty()) return;
+
+    for (size_t pass = 0; pass < passes; pass++) {
+        const double* model = models ? models + pass * 16 : nullptr;
+        for (size_t first = 0; first < perModel; first += PROJECT_CHUNK) {
+            size_t count = std::min(PROJECT_CHUNK, perModel - first);
+            ScreenLine* out = &screenLines[pass * perModel + first];
+            pool.Submit([this, &lines, model, first, count, out]() {
+                project(lines, model, first, count, out);
+            });
+        }
+    }
+    pool.Wait();
+
+    rasterize();
+}
+
+void SoftwareRasterizer::DrawBatch(const LineBatchView& lines)
+{
+    const size_t lineCount = lines.vertexCount / 2;
+    screenLines.resize(lineCount);
+    if (screenLines.empty() || lines.rangeCount == 0) return;
+
+    for (size_t first = 0; first < lineCount; first += PROJECT_CHUNK) {
+        size_t count = std::min(PROJECT_CHUNK, lineCount - first);
+        ScreenLine* out = &screenLines[first];
+        pool.Submit([this, &lines, first, count, out]() {
+            projectBatch(lines, first, count, out);
+        });
+    }
+    pool.Wait();
+
+    rasterize();
+}
+
+// Bin the projected lines, then draw the tiles in parallel
+void SoftwareRasterizer::rasterize()
+{
+    bin();
+
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        if (bins[tile].empty()) continue;
+        pool.Submit([this, tile]() {
+            rasterizeTile(tile);
+        });
+    }
+    pool.Wait();
+}
+
+void SoftwareRasterizer::DrawTriangles(const TriangleBatch& triangles)
+{
+    const size_t vertexCount = triangles.VertexCount();
+    screenVertices.resize(vertexCount);
+    if (vertexCount == 0 || triangles.indices.size() < 3) return;
+
+    const float* vertices = triangles.vertices.data();
+    for (size_t first = 0; first < vertexCount; first += PROJECT_CHUNK) {
+        size_t count = std::min(PROJECT_CHUNK, vertexCount - first);
+        ScreenVertex* out = &screenVertices[first];
+        pool.Submit([this, vertices, first, count, out]() {
+            projectVertices(vertices, first, count, out);
+        });
+    }
+    pool.Wait();
+
+    binTriangles(triangles.indices);
+
+    const uint32_t* indices = triangles.indices.data();
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        if (bins[tile].empty()) continue;
+        pool.Submit([this, indices, tile]() {
+            int x0 = (tile % tilesX) * TILE_SIZE;
+            int y0 = (tile / tilesX) * TILE_SIZE;
+            int x1 = std::min(x0 + TILE_SIZE, width);
+            int y1 = std::min(y0 + TILE_SIZE, height);
+            for (uint32_t triangle : bins[tile]) {
+                const uint32_t* corner = indices + 3 * triangle;
+                fillTriangle(screenVertices[corner[0]], screenVertices[corner[1]],
+                             screenVertices[corner[2]], x0, y0, x1, y1);
+            }
+        });
+    }
+    pool.Wait();
+}
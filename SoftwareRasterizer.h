@@ -0,0 +1,112 @@
+/*========================================================================
+ * File: SoftwareRasterizer.h
+ * Purpose: multithreaded CPU line and triangle rasterizer with a depth
+ *          buffer, for rendering frames without a GPU or a display
+ *======================================================================*/
+#ifndef SOFTWARERASTERIZER_H
+#define SOFTWARERASTERIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "CompactSegments.h"
+#include "LineBatch.h"
+#include "ThreadPool.h"
+#include "View.h"
+
+// Reproduces the viewer's fixed-function pipeline: the view matrix and
+// glFrustum projection, clipping at the near and far planes, aliased
+// lines of integer width (no smoothing) and a GL_LESS depth test.
+// Segments are projected in parallel chunks, binned into screen tiles,
+// and the tiles are rasterized in parallel. Every tile draws its lines
+// in submission order and owns its pixels, so the image does not depend
+// on the thread count.
+//
+// Triangles take the same route: vertices are projected in parallel,
+// each triangle is binned by its bounding box, and tiles fill them at
+// pixel centres with the top-left rule, interpolating depth and color
+// linearly on screen. A triangle reaching past the near or far plane
+// is dropped rather than clipped.
+class SoftwareRasterizer
+{
+    public:
+        // threads <= 0 uses the hardware concurrency
+        SoftwareRasterizer(int width, int height, int threads = 0);
+
+        void SetView(const ViewParams& view);
+        void Clear(float r, float g, float b);
+
+        // Draws the lines once per model matrix (column-major 4x4);
+        // no matrices means the identity
+        void DrawLines(const CompactSegmentStore& lines,
+                       const double* models = nullptr, size_t modelCount = 0);
+
+        // Draws packed batch geometry in place, e.g. from a tree cache
+        void DrawBatch(const LineBatchView& lines);
+
+        // Draws indexed triangles, e.g. from a BranchMeshBuilder
+        void DrawTriangles(const TriangleBatch& triangles);
+
+        int Width() const { return width; }
+        int Height() const { return height; }
+        int ThreadCount() const { return pool.ThreadCount(); }
+
+        // RGBA8, rows from top to bottom
+        const std::vector<uint8_t>& Pixels() const { return pixels; }
+
+    private:
+        static const int TILE_SIZE = 64;
+
+        // A line after projection, in pixels (y down) with window depth
+        struct ScreenLine {
+            float x0, y0, z0;
+            float x1, y1, z1;
+            uint8_t r, g, b;
+            uint8_t visible;
+            int width;
+        };
+
+        // A triangle corner after projection
+        struct ScreenVertex {
+            float x, y, z;
+            float r, g, b;
+            uint8_t visible;
+        };
+
+        int width, height;
+        int tilesX, tilesY;
+        ViewParams view;
+        std::vector<uint8_t> pixels;
+        std::vector<float> depth;
+        std::vector<ScreenLine> screenLines;
+        std::vector<ScreenVertex> screenVertices;
+        std::vector<std::vector<uint32_t>> bins;     // line or triangle indices per tile
+        WorkStealingPool pool;
+
+        // Eye transform and frustum constants shared by a projection pass
+        struct Projection {
+            double toEye[16];
+            double right, top;
+            double nearPlane, farPlane;
+            double depthScale, depthOffset;
+        };
+
+        void setupProjection(const double* model, Projection& out) const;
+        void projectLine(const Projection& projection, const float p[6],
+                         float r, float g, float b, int lineWidth, ScreenLine& line) const;
+        void project(const CompactSegmentStore& lines, const double* model,
+                     size_t first, size_t count, ScreenLine* out) const;
+        void projectBatch(const LineBatchView& lines, size_t first, size_t count,
+                          ScreenLine* out) const;
+        void projectVertices(const float* vertices, size_t first, size_t count,
+                             ScreenVertex* out) const;
+        void rasterize();
+        void bin();
+        void rasterizeTile(int tile);
+        void drawSpan(const ScreenLine& line, int x0, int y0, int x1, int y1);
+        void binTriangles(const std::vector<uint32_t>& indices);
+        void fillTriangle(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c,
+                          int x0, int y0, int x1, int y1);
+};
+
+#endif // SOFTWARERASTERIZER_H
@@ -0,0 +1,190 @@
+/*========================================================================
+ * File: SpecializedGenerator.cpp
+ * Purpose: implementation of the per-shape compiled generator kernels
+ *======================================================================*/
+#include "SpecializedGenerator.h"
+#include <cmath>
+#include <utility>
+
+namespace {
+    struct LevelColor {
+        float r, g, b;
+    };
+
+    // getBranchCountForDepth, evaluated by the compiler
+    constexpr int branchCount(int depth, int maxDepth, int maxBranches)
+    {
+        float t = (float)depth / (float)maxDepth;
+        int branches = 2 + (int)((maxBranches - 2) * t);
+        return branches < 2 ? 2 : branches;
+    }
+
+    // getColorForDepth, evaluated by the compiler
+    constexpr LevelColor levelColor(int depth, int maxDepth)
+    {
+        float t = 1.0f - (float)depth / (float)maxDepth;
+        return LevelColor{0.55f + (0.13f - 0.55f) * t,
+                          0.27f + (0.55f - 0.27f) * t,
+                          0.07f + (0.13f - 0.07f) * t};
+    }
+
+    // Rotation of child i of N around its parent, as childBranch computes it
+    template <int N>
+    struct RotationTable {
+        double cosine[N];
+        double sine[N];
+
+        RotationTable()
+        {
+            for (int i = 0; i < N; i++) {
+                double rotAngle = (2.0 * M_PI * i) / N;
+                cosine[i] = cos(rotAngle);
+                sine[i] = sin(rotAngle);
+            }
+        }
+
+        static const RotationTable table;
+    };
+
+    template <int N>
+    const RotationTable<N> RotationTable<N>::table;
+
+    // Parameters the whole tree shares
+    struct TreeConstants {
+        double cosBranch, sinBranch;
+        double factor;
+        double lambda;
+        SegmentSink& sink;
+
+        TreeConstants(const TreeParams& params, SegmentSink& s)
+            : cosBranch(cos(params.angle * M_PI / 180.0)),
+              sinBranch(sin(params.angle * M_PI / 180.0)),
+              factor(params.factor), lambda(params.lambda), sink(s) {}
+    };
+
+    // The subtree of a node Depth levels above the tips
+    template <int Branches, int MaxDepth, int Depth>
+    struct Level {
+        static const int COUNT = branchCount(Depth, MaxDepth, Branches);
+        typedef Level<Branches, MaxDepth, Depth - 1> Below;
+
+        static void Generate(const BranchNode& node, const TreeConstants& k)
+        {
+            if (node.length < 0.5) return;
+
+            constexpr LevelColor color = levelColor(Depth, MaxDepth);
+            Segment3D segment;
+            segment.x1 = node.x;
+            segment.y1 = node.y;
+            segment.z1 = node.z;
+            segment.x2 = node.x + node.dirX * node.length;
+            segment.y2 = node.y + node.dirY * node.length;
+            segment.z2 = node.z + node.dirZ * node.length;
+            segment.r = color.r;
+            segment.g = color.g;
+            segment.b = color.b;
+            segment.width = getLineWidthForLength(node.length);
+            k.sink.AddSegment(segment);
+
+            // Everything but the direction is the same for every child
+            Vec3 perp1(0, 0, 0), perp2(0, 0, 0);
+            branchBasis(Vec3(node.dirX, node.dirY, node.dirZ), perp1, perp2);
+            BranchNode child;
+            child.x = node.x + node.dirX * node.length * k.factor;
+            child.y = node.y + node.dirY * node.length * k.factor;
+            child.z = node.z + node.dirZ * node.length * k.factor;
+            child.length = node.length * k.lambda;
+            child.depth = Depth - 1;
+            children(node, perp1, perp2, child, k, std::make_integer_sequence<int, COUNT>());
+        }
+
+        template <int I>
+        static void Child(const BranchNode& node, const Vec3& perp1, const Vec3& perp2,
+                          BranchNode child, const TreeConstants& k)
+        {
+            const RotationTable<COUNT>& rotation = RotationTable<COUNT>::table;
+            const double cosRot = rotation.cosine[I];
+            const double sinRot = rotation.sine[I];
+            Vec3 radial(perp1.x * cosRot + perp2.x * sinRot,
+                        perp1.y * cosRot + perp2.y * sinRot,
+                        perp1.z * cosRot + perp2.z * sinRot);
+            Vec3 branchDir = normalize(Vec3(node.dirX * k.cosBranch + radial.x * k.sinBranch,
+                                            node.dirY * k.cosBranch + radial.y * k.sinBranch,
+                                            node.dirZ * k.cosBranch + radial.z * k.sinBranch));
+            child.dirX = branchDir.x;
+            child.dirY = branchDir.y;
+            child.dirZ = branchDir.z;
+            Below::Generate(child, k);
+        }
+
+        // One call per child, in order
+        template <int... I>
+        static void children(const BranchNode& node, const Vec3& perp1, const Vec3& perp2,
+                             const BranchNode& child, const TreeConstants& k,
+                             std::integer_sequence<int, I...>)
+        {
+            int order[] = {(Child<I>(node, perp1, perp2, child, k), 0)...};
+            (void)order;
+        }
+    };
+
+    template <int Branches, int MaxDepth>
+    struct Level<Branches, MaxDepth, 0> {
+        static void Generate(const BranchNode&, const TreeConstants&) {}
+    };
+
+    typedef void (*TreeKernel)(const TreeParams&, SegmentSink&);
+
+    template <int Branches, int MaxDepth>
+    void specializedTree(const TreeParams& params, SegmentSink& sink)
+    {
+        TreeConstants k(params, sink);
+        Level<Branches, MaxDepth, MaxDepth>::Generate(rootBranch(MaxDepth), k);
+    }
+
+    // kernels[branches - SPECIALIZED_MIN_BRANCHES][maxDepth - 1]
+    struct KernelTable {
+        static const int ROWS = SPECIALIZED_MAX_BRANCHES - SPECIALIZED_MIN_BRANCHES + 1;
+        TreeKernel kernels[ROWS][SPECIALIZED_MAX_DEPTH];
+
+        KernelTable()
+        {
+            fill(std::make_integer_sequence<int, ROWS>());
+        }
+
+        template <int... Row>
+        void fill(std::integer_sequence<int, Row...>)
+        {
+            int rows[] = {(fillRow<Row + SPECIALIZED_MIN_BRANCHES>(
+                               kernels[Row], std::make_integer_sequence<int, SPECIALIZED_MAX_DEPTH>()),
+                           0)...};
+            (void)rows;
+        }
+
+        template <int Branches, int... Depth>
+        static void fillRow(TreeKernel* row, std::integer_sequence<int, Depth...>)
+        {
+            const TreeKernel kernels[] = {&specializedTree<Branches, Depth + 1>...};
+            for (int d = 0; d < SPECIALIZED_MAX_DEPTH; d++) {
+                row[d] = kernels[d];
+            }
+        }
+    };
+
+    const KernelTable kernelTable;
+}
+
+bool hasSpecializedTree(int numBranches, int maxDepth)
+{
+    return numBranches >= SPECIALIZED_MIN_BRANCHES && numBranches <= SPECIALIZED_MAX_BRANCHES
+        && maxDepth >= 1 && maxDepth <= SPECIALIZED_MAX_DEPTH;
+}
+
+void generateTreeSpecialized(const TreeParams& params, int maxDepth, SegmentSink& sink)
+{
+    if (!hasSpecializedTree(params.numBranches, maxDepth)) {
+        generateTree(params, maxDepth, sink);
+        return;
+    }
+    kernelTable.kernels[params.numBranches - SPECIALIZED_MIN_BRANCHES][maxDepth - 1](params, sink);
+}
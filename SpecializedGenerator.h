@@ -0,0 +1,30 @@
+/*========================================================================
+ * File: SpecializedGenerator.h
+ * Purpose: recursive generator compiled once per branch count and
+ *          depth, picked from a dispatch table at run time
+ *======================================================================*/
+#ifndef SPECIALIZEDGENERATOR_H
+#define SPECIALIZEDGENERATOR_H
+
+#include "SegmentSink.h"
+#include "TreeGenerator.h"
+
+// Range of (numBranches, maxDepth) pairs with a compiled kernel
+const int SPECIALIZED_MIN_BRANCHES = 2;
+const int SPECIALIZED_MAX_BRANCHES = 7;
+const int SPECIALIZED_MAX_DEPTH = 12;
+
+bool hasSpecializedTree(int numBranches, int maxDepth);
+
+// generateTree's double output, bit for bit, from a kernel built for the
+// parameters' branch count and maxDepth. In a kernel, the branch count
+// and color of every level are compile-time constants. Each level's
+// child loop is unrolled, with its rotation table built once at
+// startup. The basis around a branch and the branch angle's sine and
+// cosine are computed once per node and once per tree, where the
+// generic recursion repeats them for every child. Pairs outside the
+// compiled range fall back to generateTree. RecursionCounter does not
+// count kernel calls.
+void generateTreeSpecialized(const TreeParams& params, int maxDepth, SegmentSink& sink);
+
+#endif // SPECIALIZEDGENERATOR_H
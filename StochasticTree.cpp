@@ -0,0 +1,154 @@
+/*========================================================================
+ * File: StochasticTree.cpp
+ * Purpose: implementation of the reproducible stochastic trees
+ *======================================================================*/
+#include "StochasticTree.h"
+#include <cmath>
+
+namespace {
+    // Philox4x32 multipliers and Weyl key increments
+    const uint32_t PHILOX_M0 = 0xD2511F53u;
+    const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+    const uint32_t PHILOX_W0 = 0x9E3779B9u;
+    const uint32_t PHILOX_W1 = 0xBB67AE85u;
+    const int PHILOX_ROUNDS = 10;
+
+    inline void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+    {
+        uint64_t product = (uint64_t)a * b;
+        hi = (uint32_t)(product >> 32);
+        lo = (uint32_t)product;
+    }
+
+    // -1 to 1 from a uniform number in [0, 1)
+    inline double centered(double u)
+    {
+        return 2.0 * u - 1.0;
+    }
+}
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+    uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+    uint32_t k[2] = {key[0], key[1]};
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+        if (round > 0) {
+            k[0] += PHILOX_W0;
+            k[1] += PHILOX_W1;
+        }
+        uint32_t hi0, lo0, hi1, lo1;
+        mulhilo(PHILOX_M0, c[0], hi0, lo0);
+        mulhilo(PHILOX_M1, c[2], hi1, lo1);
+        c[0] = hi1 ^ c[1] ^ k[0];
+        c[1] = lo1;
+        c[2] = hi0 ^ c[3] ^ k[1];
+        c[3] = lo0;
+    }
+    for (int i = 0; i < 4; i++) {
+        out[i] = c[i];
+    }
+}
+
+TreeVariation defaultTreeVariation(uint32_t seed)
+{
+    TreeVariation variation;
+    variation.seed = seed;
+    variation.angleJitter = 8.0;
+    variation.turnJitter = 15.0;
+    variation.lengthJitter = 0.2;
+    variation.skipChance = 0.1;
+    return variation;
+}
+
+void branchRandoms(const TreeVariation& variation, int depth, uint64_t index, double out[4])
+{
+    const uint32_t counter[4] = {(uint32_t)index, (uint32_t)(index >> 32), (uint32_t)depth, 0};
+    const uint32_t key[2] = {variation.seed, 0};
+    uint32_t words[4];
+    philox4x32(counter, key, words);
+    for (int i = 0; i < 4; i++) {
+        out[i] = words[i] * (1.0 / 4294967296.0);
+    }
+}
+
+StochasticNode stochasticRoot(int maxDepth)
+{
+    StochasticNode root;
+    root.branch = rootBranch(maxDepth);
+    root.index = 0;
+    return root;
+}
+
+// childBranch with the jitter folded in; zero jitter adds exact zeros,
+// so the arithmetic matches it bit for bit
+bool stochasticChild(const StochasticNode& parent, int i, int numBranches,
+                     const TreeParams& params, const TreeVariation& variation,
+                     StochasticNode& child)
+{
+    const BranchNode& node = parent.branch;
+    child.index = parent.index * (uint64_t)numBranches + (uint64_t)i;
+
+    double u[4];
+    branchRandoms(variation, node.depth - 1, child.index, u);
+    if (u[3] < variation.skipChance) return false;
+
+    double dirX = node.dirX;
+    double dirY = node.dirY;
+    double dirZ = node.dirZ;
+    double rotAngle = (2.0 * M_PI * i) / numBranches
+                    + variation.turnJitter * centered(u[1]) * M_PI / 180.0;
+
+    Vec3 perp1(0, 0, 0), perp2(0, 0, 0);
+    branchBasis(Vec3(dirX, dirY, dirZ), perp1, perp2);
+
+    double cosRot = cos(rotAngle);
+    double sinRot = sin(rotAngle);
+    Vec3 radial(
+        perp1.x * cosRot + perp2.x * sinRot,
+        perp1.y * cosRot + perp2.y * sinRot,
+        perp1.z * cosRot + perp2.z * sinRot
+    );
+
+    double branchAngle = (params.angle + variation.angleJitter * centered(u[0])) * M_PI / 180.0;
+    double cosBranch = cos(branchAngle);
+    double sinBranch = sin(branchAngle);
+    Vec3 branchDir = normalize(Vec3(
+        dirX * cosBranch + radial.x * sinBranch,
+        dirY * cosBranch + radial.y * sinBranch,
+        dirZ * cosBranch + radial.z * sinBranch
+    ));
+
+    double factor = params.factor;
+    BranchNode& branch = child.branch;
+    branch.x = node.x + dirX * node.length * factor;
+    branch.y = node.y + dirY * node.length * factor;
+    branch.z = node.z + dirZ * node.length * factor;
+    branch.dirX = branchDir.x;
+    branch.dirY = branchDir.y;
+    branch.dirZ = branchDir.z;
+    branch.length = node.length * params.lambda * (1.0 + variation.lengthJitter * centered(u[2]));
+    branch.depth = node.depth - 1;
+    return true;
+}
+
+void generateStochasticSubtree(const StochasticNode& node, const TreeParams& params,
+                               const TreeVariation& variation, int maxDepth, SegmentSink& sink)
+{
+    if (isTerminalBranch(node.branch)) return;
+
+    emitBranchSegment(node.branch, maxDepth, sink);
+
+    int numBranches = getBranchCountForDepth(node.branch.depth, maxDepth, params.numBranches);
+    StochasticNode child;
+    for (int i = 0; i < numBranches; i++) {
+        if (stochasticChild(node, i, numBranches, params, variation, child)) {
+            generateStochasticSubtree(child, params, variation, maxDepth, sink);
+        }
+    }
+}
+
+void generateStochasticTree(const TreeParams& params, const TreeVariation& variation,
+                            int maxDepth, SegmentSink& sink)
+{
+    generateStochasticSubtree(stochasticRoot(maxDepth), params, variation, maxDepth, sink);
+}
@@ -0,0 +1,65 @@
+/*========================================================================
+ * File: StochasticTree.h
+ * Purpose: trees with random variation per branch, reproducible in
+ *          any generation order from a counter-based random generator
+ *======================================================================*/
+#ifndef STOCHASTICTREE_H
+#define STOCHASTICTREE_H
+
+#include <cstdint>
+#include "SegmentSink.h"
+#include "TreeGenerator.h"
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as
+// 1, 2, 3"): four 32-bit random words that are a pure function of a
+// 128-bit counter and a 64-bit key. Nothing is carried from one call
+// to the next, so any thread can draw any number at any time.
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+
+// How far branches stray from the regular tree. The defaults:
+// +/-8 degrees of branch angle, +/-15 degrees of turn around the
+// parent, +/-20% of length, and one branch in ten left out (with its
+// subtree). All zero gives generateTree's tree, bit for bit.
+struct TreeVariation {
+    uint32_t seed;
+    double angleJitter;     // degrees, added to params.angle
+    double turnJitter;      // degrees, added to the child's place around the parent
+    double lengthJitter;    // fraction of the length
+    double skipChance;      // probability in [0, 1]
+};
+
+TreeVariation defaultTreeVariation(uint32_t seed);
+
+// A branch and where it sits in its level: children of a node with
+// index k and n slots get indices k * n + i, skipped ones included.
+// (depth, index) is unique in the tree and does not depend on the
+// order branches are generated in.
+struct StochasticNode {
+    BranchNode branch;
+    uint64_t index;
+};
+
+// The four uniform numbers in [0, 1) of one branch: angle, turn,
+// length and skip. The Philox counter is (index, depth) and the key is
+// the seed.
+void branchRandoms(const TreeVariation& variation, int depth, uint64_t index, double out[4]);
+
+StochasticNode stochasticRoot(int maxDepth);
+
+// Child i of numBranches, jittered by its own random numbers; false
+// when the child is skipped
+bool stochasticChild(const StochasticNode& parent, int i, int numBranches,
+                     const TreeParams& params, const TreeVariation& variation,
+                     StochasticNode& child);
+
+// Subtree below (and including) one node, in recursion order; any
+// subtree comes out the same whoever generates it and when
+void generateStochasticSubtree(const StochasticNode& node, const TreeParams& params,
+                               const TreeVariation& variation, int maxDepth, SegmentSink& sink);
+
+// Whole tree from the standard root. With length jitter, branches may
+// outlive the length cutoff, so treeSegmentCount is only a guide.
+void generateStochasticTree(const TreeParams& params, const TreeVariation& variation,
+                            int maxDepth, SegmentSink& sink);
+
+#endif // STOCHASTICTREE_H
@@ -0,0 +1,130 @@
+/*========================================================================
+ * File: ThreadPool.cpp
+ * Purpose: implementation of the work-stealing thread pool
+ *======================================================================*/
+#include "ThreadPool.h"
+
+namespace {
+    thread_local int currentWorkerIndex = -1;
+    thread_local const WorkStealingPool* currentPool = nullptr;
+}
+
+WorkStealingPool::WorkStealingPool(int threads)
+    : queued(0), pending(0), nextQueue(0), stopping(false)
+{
+    if (threads <= 0) threads = HardwareThreads();
+
+    for (int i = 0; i < threads; i++) {
+        queues.emplace_back(new Queue());
+    }
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+int WorkStealingPool::HardwareThreads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? (int)n : 1;
+}
+
+int WorkStealingPool::CurrentWorker()
+{
+    return currentWorkerIndex;
+}
+
+void WorkStealingPool::Submit(Task task)
+{
+    // Tasks spawned by a worker stay local; outside tasks (including
+    // those from another pool's workers) are dealt round-robin
+    int target = currentPool == this ? currentWorkerIndex : -1;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        pending++;
+        if (target < 0) {
+            target = (int)(nextQueue++ % queues.size());
+        }
+    }
+    {
+        Queue& queue = *queues[target];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        // Publish under the state lock so a sleeping worker cannot miss it
+        std::lock_guard<std::mutex> lock(stateMutex);
+        queued++;
+    }
+    workAvailable.notify_one();
+}
+
+void WorkStealingPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this] { return pending == 0; });
+}
+
+bool WorkStealingPool::popLocal(int index, Task& task)
+{
+    Queue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(int thief, Task& task)
+{
+    int count = (int)queues.size();
+    for (int offset = 1; offset < count; offset++) {
+        Queue& queue = *queues[(thief + offset) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::finishTask()
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    if (--pending == 0) {
+        allDone.notify_all();
+    }
+}
+
+void WorkStealingPool::workerLoop(int index)
+{
+    currentWorkerIndex = index;
+    currentPool = this;
+
+    for (;;) {
+        Task task;
+        if (popLocal(index, task) || steal(index, task)) {
+            queued--;
+            task();
+            finishTask();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        workAvailable.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
@@ -0,0 +1,63 @@
+/*========================================================================
+ * File: ThreadPool.h
+ * Purpose: small work-stealing thread pool
+ *======================================================================*/
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Every worker owns a deque. Workers pop their own newest task first and
+// steal the oldest task of another worker when they run dry.
+class WorkStealingPool
+{
+    public:
+        typedef std::function<void()> Task;
+
+        // threads <= 0 uses the hardware concurrency
+        explicit WorkStealingPool(int threads = 0);
+        ~WorkStealingPool();
+
+        void Submit(Task task);
+        void Wait();                        // until all submitted tasks ran
+
+        int ThreadCount() const { return (int)workers.size(); }
+
+        // Index of the calling worker thread, or -1 outside the pool
+        static int CurrentWorker();
+        static int HardwareThreads();
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<Queue>> queues;
+
+        std::mutex stateMutex;
+        std::condition_variable workAvailable;
+        std::condition_variable allDone;
+        std::atomic<int> queued;            // submitted, not yet taken
+        int pending;                        // submitted, not yet finished
+        unsigned nextQueue;
+        bool stopping;
+
+        void workerLoop(int index);
+        bool popLocal(int index, Task& task);
+        bool steal(int thief, Task& task);
+        void finishTask();
+
+        WorkStealingPool(const WorkStealingPool&);
+        WorkStealingPool& operator=(const WorkStealingPool&);
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,88 @@
+/*========================================================================
+ * File: TreeAnimation.cpp
+ * Purpose: implementation of the living-tree animation
+ *======================================================================*/
+#include "TreeAnimation.h"
+#include <cmath>
+
+namespace {
+    // Phase advance per nominal frame
+    const double WIND_RATE = 0.02;
+    const double GROWTH_RATE = 0.01;
+    const double BRANCH_COUNT_RATE = 0.005;
+    const double SPEED_RATE = 0.008;
+
+    // Swing of the rotation speed around the base speed
+    const double SPEED_SWING = 0.3;
+
+    // sin(a) + sin(2a) + ... + sin(n a)
+    double sineSum(long n, double a)
+    {
+        double half = sin(0.5 * a);
+        if (n <= 0 || half == 0.0) return 0.0;
+        return sin(0.5 * n * a) * sin(0.5 * (n + 1) * a) / half;
+    }
+}
+
+TreeAnimation::TreeAnimation(const TreeParams& base)
+    : baseParams(base), time(0.0), windPhase(0.0), growthPhase(0.0),
+      rotationAngle(0.0), branchCountPhase(0.0), speedPhase(0.0)
+{
+}
+
+TreeParams TreeAnimation::Step(double seconds, double& rotation)
+{
+    // Update time; the phases keep their rates per nominal frame
+    double frames = seconds / NOMINAL_FRAME_SECONDS;
+    time += seconds;
+    windPhase += WIND_RATE * frames;
+    growthPhase += GROWTH_RATE * frames;
+    branchCountPhase += BRANCH_COUNT_RATE * frames;
+    speedPhase += SPEED_RATE * frames;
+
+    TreeParams animParams = paramsAt(time, windPhase, growthPhase, branchCountPhase, speedPhase);
+    rotationAngle += animParams.rotationSpeed * frames;
+    rotation = rotationAngle;
+    return animParams;
+}
+
+TreeParams TreeAnimation::AtFrame(long frame, double frameSeconds, double& rotation) const
+{
+    double frames = frameSeconds / NOMINAL_FRAME_SECONDS;
+    double nominal = frame * frames;
+
+    // Step j turns by (base + swing * sin(rate * frames * j)) * frames
+    rotation = (frame * baseParams.rotationSpeed
+                + SPEED_SWING * sineSum(frame, SPEED_RATE * frames)) * frames;
+    return paramsAt(frame * frameSeconds, WIND_RATE * nominal, GROWTH_RATE * nominal,
+                    BRANCH_COUNT_RATE * nominal, SPEED_RATE * nominal);
+}
+
+TreeParams TreeAnimation::paramsAt(double t, double wind, double growth,
+                                   double branchCount, double speed) const
+{
+    // Create animated parameters
+    TreeParams animParams = baseParams;
+
+    // Dynamic rotation speed (oscillates between slow and fast)
+    animParams.rotationSpeed = baseParams.rotationSpeed + SPEED_SWING * sin(speed);
+
+    // Dynamic branch count (oscillates between 3 and 7)
+    animParams.numBranches = 5 + (int)(2.0 * sin(branchCount));
+    if (animParams.numBranches < 3) animParams.numBranches = 3;
+    if (animParams.numBranches > 7) animParams.numBranches = 7;
+
+    // Breathing/growing effect
+    double breathe = 0.03 * sin(growth * 0.7);
+    animParams.lambda = baseParams.lambda + breathe;
+
+    // Swaying - angle variation
+    animParams.angle = baseParams.angle + 5.0 * sin(wind * 1.3);
+
+    // Branch position shimmer
+    animParams.factor = baseParams.factor + 0.05 * sin(t * 0.9);
+
+    // Additional wobble
+    animParams.angle += 2.0 * sin(t * 2.1);
+    return animParams;
+}
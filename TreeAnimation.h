@@ -0,0 +1,43 @@
+/*========================================================================
+ * File: TreeAnimation.h
+ * Purpose: the living-tree animation, stepped in real time or evaluated
+ *          directly at any frame
+ *======================================================================*/
+#ifndef TREEANIMATION_H
+#define TREEANIMATION_H
+
+#include "TreeGenerator.h"
+
+// Frame length the animation rates were tuned for
+const double NOMINAL_FRAME_SECONDS = 0.016;
+
+// Branch count, lambda, angle and factor follow sinusoids of time; the
+// view turns at a speed that itself oscillates
+class TreeAnimation
+{
+    public:
+        explicit TreeAnimation(const TreeParams& base);
+
+        // Parameters and view rotation seconds after the previous step
+        TreeParams Step(double seconds, double& rotation);
+
+        // Parameters and rotation after frame steps of frameSeconds each,
+        // without stepping: the phases are linear in the frame and the
+        // rotation, a sum of sines, has a closed form. Matches Step to
+        // rounding, and does not change the animation's state.
+        TreeParams AtFrame(long frame, double frameSeconds, double& rotation) const;
+
+    private:
+        TreeParams baseParams;
+        double time;
+        double windPhase;
+        double growthPhase;
+        double rotationAngle;
+        double branchCountPhase;
+        double speedPhase;
+
+        TreeParams paramsAt(double t, double wind, double growth,
+                            double branchCount, double speed) const;
+};
+
+#endif // TREEANIMATION_H
@@ -0,0 +1,339 @@
+/*========================================================================
+ * File: TreeCache.cpp
+ * Purpose: writing, mapping and validating tree cache files
+ *======================================================================*/
+#include "TreeCache.h"
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "SegmentSink.h"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(TreeCacheHeader) == 128, "tree cache header layout changed");
+static_assert(sizeof(LineWidthRange) == 12, "tree cache range layout changed");
+
+namespace {
+    const char TREE_CACHE_MAGIC[8] = {'B', 'O', 'O', 'M', 'T', 'R', 'E', 'E'};
+    const size_t VERTEX_BYTES = LineBatch::FLOATS_PER_VERTEX * sizeof(float);
+
+    uint64_t alignUp(uint64_t offset)
+    {
+        return (offset + TREE_CACHE_ALIGNMENT - 1) / TREE_CACHE_ALIGNMENT * TREE_CACHE_ALIGNMENT;
+    }
+
+    int widthOf(const Segment3D& s)
+    {
+        return s.width < 0 ? 0 : s.width;
+    }
+
+    // Two vertices in the batch layout Canvas draws
+    void packSegment(const Segment3D& s, float* v)
+    {
+        v[0] = (float)s.x1; v[1] = (float)s.y1;  v[2] = (float)s.z1;
+        v[3] = s.r;         v[4] = s.g;          v[5] = s.b;
+        v[6] = (float)s.x2; v[7] = (float)s.y2;  v[8] = (float)s.z2;
+        v[9] = s.r;         v[10] = s.g;         v[11] = s.b;
+    }
+
+    // First pass: segments per width give the runs and the file layout
+    bool planCache(const TreeParams& params, int maxDepth, TreeCacheHeader& header,
+                   std::vector<LineWidthRange>& ranges, std::string& error)
+    {
+        std::vector<uint64_t> widthCounts;
+        CallbackSink counter([&widthCounts](const Segment3D& s) {
+            int w = widthOf(s);
+            if (w >= (int)widthCounts.size()) widthCounts.resize(w + 1, 0);
+            widthCounts[w]++;
+        });
+        generateTreeChunked(params, maxDepth, counter);
+
+        ranges.clear();
+        uint64_t vertexCount = 0;
+        for (size_t w = 0; w < widthCounts.size(); w++) {
+            if (widthCounts[w] == 0) continue;
+            if (vertexCount + 2 * widthCounts[w] > (uint64_t)INT_MAX) {
+                error = "tree too large for a cache file";
+                return false;
+            }
+            LineWidthRange range;
+            range.width = (int)w;
+            range.first = (int)vertexCount;
+            range.count = (int)(2 * widthCounts[w]);
+            ranges.push_back(range);
+            vertexCount += range.count;
+        }
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TREE_CACHE_MAGIC, sizeof(header.magic));
+        header.formatVersion = TREE_CACHE_FORMAT_VERSION;
+        header.byteOrder = TREE_CACHE_BYTE_ORDER;
+        header.generatorVersion = TREE_GENERATOR_VERSION;
+        header.maxDepth = maxDepth;
+        header.numBranches = params.numBranches;
+        header.floatsPerVertex = LineBatch::FLOATS_PER_VERTEX;
+        header.lambda = params.lambda;
+        header.angle = params.angle;
+        header.factor = params.factor;
+        header.vertexCount = vertexCount;
+        header.rangeCount = ranges.size();
+        header.rangeOffset = alignUp(sizeof(header));
+        header.vertexOffset = alignUp(header.rangeOffset + ranges.size() * sizeof(LineWidthRange));
+        header.fileSize = header.vertexOffset + vertexCount * VERTEX_BYTES;
+        return true;
+    }
+
+    bool sameKey(const TreeCacheHeader& header, const TreeParams& params, int maxDepth)
+    {
+        // Bitwise, so a cache is only reused for exactly these parameters
+        return header.maxDepth == maxDepth
+            && header.numBranches == params.numBranches
+            && memcmp(&header.lambda, &params.lambda, sizeof(double)) == 0
+            && memcmp(&header.angle, &params.angle, sizeof(double)) == 0
+            && memcmp(&header.factor, &params.factor, sizeof(double)) == 0;
+    }
+}
+
+#ifdef _WIN32
+
+// No mmap: one generation pass per width run, appended in file order
+bool writeTreeCache(const char* path, const TreeParams& params, int maxDepth,
+                    std::string& error)
+{
+    TreeCacheHeader header;
+    std::vector<LineWidthRange> ranges;
+    if (!planCache(params, maxDepth, header, ranges, error)) return false;
+
+    std::string temporary = std::string(path) + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        error = "cannot create " + temporary;
+        return false;
+    }
+
+    std::vector<char> head((size_t)header.vertexOffset, 0);
+    memcpy(head.data(), &header, sizeof(header));
+    memcpy(&head[(size_t)header.rangeOffset], ranges.data(), ranges.size() * sizeof(LineWidthRange));
+    bool ok = fwrite(head.data(), 1, head.size(), file) == head.size();
+    for (const auto& range : ranges) {
+        CallbackSink writer([&](const Segment3D& s) {
+            if (widthOf(s) != range.width) return;
+            float v[2 * LineBatch::FLOATS_PER_VERTEX];
+            packSegment(s, v);
+            ok = ok && fwrite(v, 1, sizeof(v), file) == sizeof(v);
+        });
+        generateTreeChunked(params, maxDepth, writer);
+    }
+    ok = fclose(file) == 0 && ok;
+
+    remove(path);
+    if (!ok || rename(temporary.c_str(), path) != 0) {
+        remove(temporary.c_str());
+        error = "cannot write " + std::string(path);
+        return false;
+    }
+    return true;
+}
+
+#else
+
+// Second pass: each segment goes straight to its run in the mapped file
+bool writeTreeCache(const char* path, const TreeParams& params, int maxDepth,
+                    std::string& error)
+{
+    TreeCacheHeader header;
+    std::vector<LineWidthRange> ranges;
+    if (!planCache(params, maxDepth, header, ranges, error)) return false;
+
+    std::string temporary = std::string(path) + ".tmp." + std::to_string((long)getpid());
+    int fd = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        error = "cannot create " + temporary;
+        return false;
+    }
+    if (ftruncate(fd, (off_t)header.fileSize) != 0) {
+        close(fd);
+        unlink(temporary.c_str());
+        error = "cannot size " + temporary;
+        return false;
+    }
+    void* address = mmap(nullptr, (size_t)header.fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        close(fd);
+        unlink(temporary.c_str());
+        error = "cannot map " + temporary;
+        return false;
+    }
+
+    unsigned char* bytes = (unsigned char*)address;
+    memcpy(bytes + header.rangeOffset, ranges.data(), ranges.size() * sizeof(LineWidthRange));
+
+    std::vector<uint64_t> next;
+    for (const auto& range : ranges) {
+        if (range.width >= (int)next.size()) next.resize(range.width + 1, 0);
+        next[range.width] = range.first;
+    }
+    float* vertices = (float*)(bytes + header.vertexOffset);
+    CallbackSink writer([&next, vertices](const Segment3D& s) {
+        uint64_t& vertex = next[widthOf(s)];
+        packSegment(s, vertices + vertex * LineBatch::FLOATS_PER_VERTEX);
+        vertex += 2;
+    });
+    generateTreeChunked(params, maxDepth, writer);
+
+    // The header goes in last, so only a complete file carries the magic
+    memcpy(bytes, &header, sizeof(header));
+    bool ok = msync(address, (size_t)header.fileSize, MS_SYNC) == 0;
+    ok = munmap(address, (size_t)header.fileSize) == 0 && ok;
+    ok = close(fd) == 0 && ok;
+
+    if (!ok || rename(temporary.c_str(), path) != 0) {
+        unlink(temporary.c_str());
+        error = "cannot write " + std::string(path);
+        return false;
+    }
+    return true;
+}
+
+#endif
+
+MappedTreeCache::MappedTreeCache()
+    : data(nullptr), size(0), mapped(false), written(false)
+{
+}
+
+MappedTreeCache::~MappedTreeCache()
+{
+    Close();
+}
+
+void MappedTreeCache::Close()
+{
+    if (!data) return;
+#ifndef _WIN32
+    if (mapped) {
+        munmap((void*)data, size);
+    }
+#endif
+    if (!mapped) {
+        delete[] data;
+    }
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+bool MappedTreeCache::reject(const std::string& reason)
+{
+    Close();
+    error = reason;
+    return false;
+}
+
+bool MappedTreeCache::Open(const char* path, const TreeParams& params, int maxDepth)
+{
+    Close();
+    error.clear();
+
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return reject("cannot open " + std::string(path));
+    size = (size_t)in.tellg();
+    unsigned char* copy = new unsigned char[size ? size : 1];
+    in.seekg(0);
+    data = copy;
+    if (!in.read((char*)copy, (std::streamsize)size)) return reject("cannot read " + std::string(path));
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return reject("cannot open " + std::string(path));
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(TreeCacheHeader)) {
+        close(fd);
+        return reject("file too small for a tree cache");
+    }
+    void* address = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) return reject("cannot map " + std::string(path));
+    data = (const unsigned char*)address;
+    size = (size_t)info.st_size;
+    mapped = true;
+#endif
+
+    // Nothing past the header is trusted until the header checks out
+    if (size < sizeof(TreeCacheHeader)) return reject("file too small for a tree cache");
+    TreeCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, TREE_CACHE_MAGIC, sizeof(header.magic)) != 0) {
+        return reject("not a tree cache");
+    }
+    if (header.byteOrder != TREE_CACHE_BYTE_ORDER) return reject("written with another byte order");
+    if (header.formatVersion != TREE_CACHE_FORMAT_VERSION) return reject("unsupported cache format version");
+    if (header.generatorVersion != (uint32_t)TREE_GENERATOR_VERSION) return reject("written by another generator version");
+    if (!sameKey(header, params, maxDepth)) return reject("written for other tree parameters");
+
+    if (header.floatsPerVertex != (uint32_t)LineBatch::FLOATS_PER_VERTEX
+        || header.fileSize != size
+        || header.rangeOffset < sizeof(TreeCacheHeader)
+        || header.rangeOffset % TREE_CACHE_ALIGNMENT != 0
+        || header.vertexOffset % TREE_CACHE_ALIGNMENT != 0
+        || header.vertexOffset < header.rangeOffset
+        || header.rangeCount > (header.vertexOffset - header.rangeOffset) / sizeof(LineWidthRange)
+        || header.vertexOffset > size
+        || header.vertexCount > (uint64_t)INT_MAX
+        || header.vertexCount != (size - header.vertexOffset) / VERTEX_BYTES
+        || (size - header.vertexOffset) % VERTEX_BYTES != 0) {
+        return reject("corrupt tree cache layout");
+    }
+
+    // Runs must tile the vertices exactly, in order, two per line
+    const LineWidthRange* ranges = (const LineWidthRange*)(data + header.rangeOffset);
+    int64_t expected = 0;
+    for (uint64_t i = 0; i < header.rangeCount; i++) {
+        if (ranges[i].first != expected || ranges[i].count < 0 || ranges[i].count % 2 != 0
+            || ranges[i].width < 0) {
+            return reject("corrupt tree cache ranges");
+        }
+        expected += ranges[i].count;
+    }
+    if ((uint64_t)expected != header.vertexCount) return reject("corrupt tree cache ranges");
+    return true;
+}
+
+bool MappedTreeCache::OpenOrWrite(const char* path, const TreeParams& params, int maxDepth)
+{
+    written = false;
+    missReason.clear();
+    if (Open(path, params, maxDepth)) return true;
+
+    missReason = error;
+    if (!writeTreeCache(path, params, maxDepth, error)) return false;
+    written = true;
+    return Open(path, params, maxDepth);
+}
+
+LineBatchView MappedTreeCache::Lines() const
+{
+    LineBatchView view = {nullptr, 0, nullptr, 0};
+    if (!data) return view;
+
+    TreeCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    view.vertices = (const float*)(data + header.vertexOffset);
+    view.vertexCount = (size_t)header.vertexCount;
+    view.ranges = (const LineWidthRange*)(data + header.rangeOffset);
+    view.rangeCount = (size_t)header.rangeCount;
+    return view;
+}
+
+size_t MappedTreeCache::SegmentCount() const
+{
+    return Lines().vertexCount / 2;
+}
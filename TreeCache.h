@@ -0,0 +1,90 @@
+/*========================================================================
+ * File: TreeCache.h
+ * Purpose: precomputed tree geometry in a memory-mappable cache file
+ *======================================================================*/
+#ifndef TREECACHE_H
+#define TREECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "LineBatch.h"
+#include "TreeGenerator.h"
+
+const uint32_t TREE_CACHE_FORMAT_VERSION = 1;
+const uint32_t TREE_CACHE_BYTE_ORDER = 0x01020304;
+const size_t TREE_CACHE_ALIGNMENT = 64;
+
+// File layout: this header, the width ranges and the vertices, each
+// section starting on a TREE_CACHE_ALIGNMENT boundary. The vertices are
+// exactly what Canvas uploads (LineBatch: x y z r g b floats, grouped
+// into width runs), in host byte order, so a mapped file is drawn in
+// place. Everything after the header is covered by the key: format
+// version, byte order, generator version, maxDepth and the parameters
+// that shape the tree (rotationSpeed does not).
+struct TreeCacheHeader {
+    char magic[8];                  // "BOOMTREE"
+    uint32_t formatVersion;
+    uint32_t byteOrder;
+    uint32_t generatorVersion;
+    int32_t maxDepth;
+    int32_t numBranches;
+    uint32_t floatsPerVertex;
+    double lambda;
+    double angle;
+    double factor;
+    uint64_t vertexCount;
+    uint64_t rangeCount;
+    uint64_t rangeOffset;
+    uint64_t vertexOffset;
+    uint64_t fileSize;
+    char reserved[32];
+};
+
+// Generates the tree in constant memory (two passes of the chunked
+// generator) straight into the file, which is written under a temporary
+// name and renamed into place. Returns false with a reason in error.
+bool writeTreeCache(const char* path, const TreeParams& params, int maxDepth,
+                    std::string& error);
+
+// Read-only mapping of a cache file. Open checks the key and the
+// layout before anything is handed out; on any mismatch it fails with a
+// reason and maps nothing.
+class MappedTreeCache
+{
+    public:
+        MappedTreeCache();
+        ~MappedTreeCache();
+
+        bool Open(const char* path, const TreeParams& params, int maxDepth);
+        void Close();
+
+        // Opens the cache, (re)writing it first when it is missing or
+        // rejected; MissReason says why the old file was not used
+        bool OpenOrWrite(const char* path, const TreeParams& params, int maxDepth);
+        bool WasWritten() const { return written; }
+        const std::string& MissReason() const { return missReason; }
+
+        bool IsOpen() const { return data != nullptr; }
+        const std::string& Error() const { return error; }
+
+        // Valid while the cache stays open
+        LineBatchView Lines() const;
+        size_t SegmentCount() const;
+        size_t FileSize() const { return size; }
+
+    private:
+        const unsigned char* data;
+        size_t size;
+        bool mapped;                // false: heap copy where mmap is missing
+        bool written;
+        std::string error;
+        std::string missReason;
+
+        bool reject(const std::string& reason);
+
+        MappedTreeCache(const MappedTreeCache&);
+        MappedTreeCache& operator=(const MappedTreeCache&);
+};
+
+#endif // TREECACHE_H
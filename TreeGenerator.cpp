@@ -0,0 +1,388 @@
+/*========================================================================
+ * File: TreeGenerator.cpp
+ * Purpose: implementation of the headless 3D tree generator
+ *======================================================================*/
+#include "TreeGenerator.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "View.h"
+
+// Active RecursionCounter of this thread, if any
+static thread_local uint64_t* recursionCalls = nullptr;
+
+RecursionCounter::RecursionCounter()
+    : calls(0), previous(recursionCalls)
+{
+    recursionCalls = &calls;
+}
+
+RecursionCounter::~RecursionCounter()
+{
+    recursionCalls = previous;
+}
+
+TreeParams defaultTreeParams()
+{
+    TreeParams params;
+    params.lambda = 0.65;       // Length reduction per level
+    params.angle = 35.0;        // Branch angle from trunk (degrees)
+    params.factor = 0.7;        // Where along trunk branches emerge
+    params.rotationSpeed = 0.5; // Initial rotation speed
+    params.numBranches = 5;     // Maximum branches at trunk level
+    return params;
+}
+
+const char* treePrecisionName(TreePrecision precision)
+{
+    return precision == PRECISION_FLOAT ? "float" : "double";
+}
+
+bool parseTreePrecision(const char* name, TreePrecision& precision)
+{
+    if (strcmp(name, "float") == 0) precision = PRECISION_FLOAT;
+    else if (strcmp(name, "double") == 0) precision = PRECISION_DOUBLE;
+    else return false;
+    return true;
+}
+
+// Normalize vector
+template <typename Scalar>
+Vec3T<Scalar> normalize(const Vec3T<Scalar>& v) {
+    Scalar len = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    if (len < Scalar(0.0001)) return Vec3T<Scalar>(0, 1, 0);
+    return Vec3T<Scalar>(v.x / len, v.y / len, v.z / len);
+}
+
+// Interpolate between two colors
+Color lerpColor(const Color& c1, const Color& c2, float t) {
+    return Color(
+        c1.r + (c2.r - c1.r) * t,
+        c1.g + (c2.g - c1.g) * t,
+        c1.b + (c2.b - c1.b) * t
+    );
+}
+
+// Get color based on depth (brown to green gradient)
+Color getColorForDepth(int currentDepth, int maxDepth) {
+    // Brown for trunk (deeper levels)
+    Color brown(0.55f, 0.27f, 0.07f);
+    // Green for tips (shallow levels)
+    Color green(0.13f, 0.55f, 0.13f);
+
+    // Calculate interpolation factor (0 = trunk, 1 = tips)
+    float t = 1.0f - (float)currentDepth / (float)maxDepth;
+
+    return lerpColor(brown, green, t);
+}
+
+// Calculate number of branches based on depth (more at bottom, fewer at top)
+int getBranchCountForDepth(int currentDepth, int maxDepth, int maxBranches) {
+    // At trunk (maxDepth): use maxBranches
+    // At tips (depth 1): use 2 or 3 branches
+    int minBranches = 2;
+
+    // Linear interpolation based on depth
+    float t = (float)currentDepth / (float)maxDepth;
+    int branches = minBranches + (int)((maxBranches - minBranches) * t);
+
+    // Ensure at least minBranches
+    if (branches < minBranches) branches = minBranches;
+
+    return branches;
+}
+
+// Line thickness shrinks with branch length
+int getLineWidthForLength(double length) {
+    return int(0.03 * length + 1);
+}
+
+// Two perpendiculars around a branch direction
+template <typename Scalar>
+void branchBasis(const Vec3T<Scalar>& dir, Vec3T<Scalar>& perp1, Vec3T<Scalar>& perp2)
+{
+    Vec3T<Scalar> up(0, 1, 0);
+
+    // If direction is too close to up, use different reference
+    if (std::fabs(dir.y) > Scalar(0.99)) {
+        up = Vec3T<Scalar>(1, 0, 0);
+    }
+
+    // Create perpendicular vector (cross product)
+    perp1 = normalize(Vec3T<Scalar>(
+        dir.y * up.z - dir.z * up.y,
+        dir.z * up.x - dir.x * up.z,
+        dir.x * up.y - dir.y * up.x
+    ));
+
+    // Create second perpendicular (cross product of dir and perp1)
+    perp2 = normalize(Vec3T<Scalar>(
+        dir.y * perp1.z - dir.z * perp1.y,
+        dir.z * perp1.x - dir.x * perp1.z,
+        dir.x * perp1.y - dir.y * perp1.x
+    ));
+}
+
+size_t treeSegmentCount(const TreeParams& params, int maxDepth)
+{
+    // One node per path; levels stop with the same length cutoff
+    size_t total = 0;
+    size_t nodes = 1;
+    double length = TREE_TRUNK_LENGTH;
+    for (int d = maxDepth; d >= 1; d--) {
+        if (length < 0.5) break;
+        total += nodes;
+        nodes *= getBranchCountForDepth(d, maxDepth, params.numBranches);
+        length *= params.lambda;
+    }
+    return total;
+}
+
+template <typename Scalar>
+BranchNodeT<Scalar> rootBranch(int maxDepth)
+{
+    // Start tree at origin, growing upward (positive Y)
+    BranchNodeT<Scalar> node;
+    node.x = (Scalar)TREE_ROOT_X;
+    node.y = (Scalar)TREE_ROOT_Y;
+    node.z = (Scalar)TREE_ROOT_Z;
+    node.dirX = 0;
+    node.dirY = 1;
+    node.dirZ = 0;
+    node.length = (Scalar)TREE_TRUNK_LENGTH;
+    node.depth = maxDepth;
+    return node;
+}
+
+template <typename Scalar>
+bool isTerminalBranch(const BranchNodeT<Scalar>& node)
+{
+    return node.depth <= 0 || node.length < Scalar(0.5);
+}
+
+// Emit a branch in 3D with color
+template <typename Scalar>
+void emitBranchSegment(const BranchNodeT<Scalar>& node, int maxDepth, SegmentSink& sink)
+{
+    // Get color for current depth
+    Color color = getColorForDepth(node.depth, maxDepth);
+
+    Segment3D segment;
+    segment.x1 = node.x;
+    segment.y1 = node.y;
+    segment.z1 = node.z;
+    segment.x2 = node.x + node.dirX * node.length;
+    segment.y2 = node.y + node.dirY * node.length;
+    segment.z2 = node.z + node.dirZ * node.length;
+    segment.r = color.r;
+    segment.g = color.g;
+    segment.b = color.b;
+    segment.width = getLineWidthForLength(node.length);
+    sink.AddSegment(segment);
+}
+
+template <typename Scalar>
+BranchNodeT<Scalar> childBranch(const BranchNodeT<Scalar>& parent, int i, int numBranches,
+                                const TreeParams& params)
+{
+    Scalar dirX = parent.dirX;
+    Scalar dirY = parent.dirY;
+    Scalar dirZ = parent.dirZ;
+    double rotAngle = (2.0 * M_PI * i) / numBranches;
+
+    // Calculate perpendicular vectors for branch direction
+    Vec3T<Scalar> perp1(0, 0, 0), perp2(0, 0, 0);
+    branchBasis(Vec3T<Scalar>(dirX, dirY, dirZ), perp1, perp2);
+
+    // Rotate around the trunk to get branch direction
+    Scalar cosRot = (Scalar)cos(rotAngle);
+    Scalar sinRot = (Scalar)sin(rotAngle);
+    Vec3T<Scalar> radial(
+        perp1.x * cosRot + perp2.x * sinRot,
+        perp1.y * cosRot + perp2.y * sinRot,
+        perp1.z * cosRot + perp2.z * sinRot
+    );
+
+    // Branch direction: mix of upward (trunk direction) and outward (radial)
+    double branchAngle = params.angle * M_PI / 180.0;
+    Scalar cosBranch = (Scalar)cos(branchAngle);
+    Scalar sinBranch = (Scalar)sin(branchAngle);
+    Vec3T<Scalar> branchDir(
+        dirX * cosBranch + radial.x * sinBranch,
+        dirY * cosBranch + radial.y * sinBranch,
+        dirZ * cosBranch + radial.z * sinBranch
+    );
+    branchDir = normalize(branchDir);
+
+    // Children start at the branch point along the parent
+    Scalar factor = (Scalar)params.factor;
+    BranchNodeT<Scalar> child;
+    child.x = parent.x + dirX * parent.length * factor;
+    child.y = parent.y + dirY * parent.length * factor;
+    child.z = parent.z + dirZ * parent.length * factor;
+    child.dirX = branchDir.x;
+    child.dirY = branchDir.y;
+    child.dirZ = branchDir.z;
+    child.length = parent.length * (Scalar)params.lambda;
+    child.depth = parent.depth - 1;
+    return child;
+}
+
+template <typename Scalar>
+void generateSubtree(const BranchNodeT<Scalar>& node, const TreeParams& params,
+                     int maxDepth, SegmentSink& sink)
+{
+    if (recursionCalls) ++*recursionCalls;
+    if (isTerminalBranch(node)) return;
+
+    // Emit current branch with color
+    emitBranchSegment(node, maxDepth, sink);
+
+    // Determine number of branches for this depth level
+    int numBranches = getBranchCountForDepth(node.depth, maxDepth, params.numBranches);
+
+    // Create branches around the trunk and recurse into them
+    for (int i = 0; i < numBranches; i++) {
+        generateSubtree(childBranch(node, i, numBranches, params), params, maxDepth, sink);
+    }
+}
+
+void generateTree3D(double x, double y, double z,
+                    double dirX, double dirY, double dirZ,
+                    double length, int depth, const TreeParams& params,
+                    int maxDepth, SegmentSink& sink)
+{
+    BranchNode node;
+    node.x = x;
+    node.y = y;
+    node.z = z;
+    node.dirX = dirX;
+    node.dirY = dirY;
+    node.dirZ = dirZ;
+    node.length = length;
+    node.depth = depth;
+    generateSubtree(node, params, maxDepth, sink);
+}
+
+void generateTree(const TreeParams& params, int maxDepth, SegmentSink& sink)
+{
+    generateSubtree(rootBranch(maxDepth), params, maxDepth, sink);
+}
+
+void generateTree(const TreeParams& params, int maxDepth, SegmentSink& sink,
+                  TreePrecision precision)
+{
+    if (precision == PRECISION_FLOAT) {
+        generateSubtree(rootBranch<float>(maxDepth), params, maxDepth, sink);
+    } else {
+        generateSubtree(rootBranch<double>(maxDepth), params, maxDepth, sink);
+    }
+}
+
+void generateTreeChunked(const TreeParams& params, int maxDepth, SegmentSink& sink,
+                         size_t chunkSize)
+{
+    if (chunkSize == 0) chunkSize = 1;
+    VectorSink chunkSink;
+    chunkSink.segments.reserve(chunkSize);
+
+    // Children are pushed last-first so they pop in recursion order; the
+    // stack holds at most the pending siblings along one path
+    std::vector<BranchNode> stack;
+    stack.push_back(rootBranch(maxDepth));
+    while (!stack.empty()) {
+        BranchNode node = stack.back();
+        stack.pop_back();
+        if (recursionCalls) ++*recursionCalls;
+        if (isTerminalBranch(node)) continue;
+
+        emitBranchSegment(node, maxDepth, chunkSink);
+        if (chunkSink.segments.size() >= chunkSize) {
+            sink.AddSegments(chunkSink.segments.data(), chunkSink.segments.size());
+            chunkSink.segments.clear();
+        }
+
+        int numBranches = getBranchCountForDepth(node.depth, maxDepth, params.numBranches);
+        for (int i = numBranches - 1; i >= 0; i--) {
+            stack.push_back(childBranch(node, i, numBranches, params));
+        }
+    }
+    if (!chunkSink.segments.empty()) {
+        sink.AddSegments(chunkSink.segments.data(), chunkSink.segments.size());
+    }
+}
+
+// Bounding spheres of whole subtrees, by depth. A subtree starting at
+// its node's start point fits in radius reach[d]; centred on the branch
+// point instead it fits in bound[d], which is never larger.
+static void subtreeBounds(const TreeParams& params, int maxDepth, std::vector<double>& bound)
+{
+    std::vector<double> reach(maxDepth + 1, 0.0);
+    bound.assign(maxDepth + 1, 0.0);
+
+    double factor = fabs(params.factor);
+    double along = factor > fabs(1.0 - params.factor) ? factor : fabs(1.0 - params.factor);
+    double length = TREE_TRUNK_LENGTH;
+    std::vector<double> lengths(maxDepth + 1, 0.0);
+    for (int d = maxDepth; d >= 1; d--) {
+        lengths[d] = length;
+        length *= params.lambda;
+    }
+
+    for (int d = 1; d <= maxDepth; d++) {
+        double children = d > 1 ? reach[d - 1] : 0.0;
+        double self = along * lengths[d];
+        bound[d] = children > self ? children : self;
+        double fromStart = factor * lengths[d] + children;
+        reach[d] = fromStart > lengths[d] ? fromStart : lengths[d];
+    }
+}
+
+static void generateVisibleSubtree(const BranchNode& node, const TreeParams& params,
+                                   int maxDepth, const ViewCuller& culler,
+                                   const std::vector<double>& bound, SegmentSink& sink)
+{
+    if (recursionCalls) ++*recursionCalls;
+    if (isTerminalBranch(node)) return;
+
+    double reach = node.length * params.factor;
+    CullResult result = culler.Classify(node.x + node.dirX * reach,
+                                        node.y + node.dirY * reach,
+                                        node.z + node.dirZ * reach,
+                                        bound[node.depth]);
+    if (result == CULL_OUTSIDE) return;
+
+    emitBranchSegment(node, maxDepth, sink);
+    if (result == CULL_TOO_SMALL) return;
+
+    int numBranches = getBranchCountForDepth(node.depth, maxDepth, params.numBranches);
+    for (int i = 0; i < numBranches; i++) {
+        generateVisibleSubtree(childBranch(node, i, numBranches, params), params, maxDepth,
+                               culler, bound, sink);
+    }
+}
+
+void generateTree(const TreeParams& params, int maxDepth, const ViewCuller& culler,
+                  SegmentSink& sink)
+{
+    if (maxDepth <= 0) return;
+
+    std::vector<double> bound;
+    subtreeBounds(params, maxDepth, bound);
+    generateVisibleSubtree(rootBranch(maxDepth), params, maxDepth, culler, bound, sink);
+}
+
+// The building blocks at both precisions
+#define INSTANTIATE_TREE_GENERATOR(Scalar) \
+    template Vec3T<Scalar> normalize(const Vec3T<Scalar>&); \
+    template void branchBasis(const Vec3T<Scalar>&, Vec3T<Scalar>&, Vec3T<Scalar>&); \
+    template BranchNodeT<Scalar> rootBranch<Scalar>(int); \
+    template bool isTerminalBranch(const BranchNodeT<Scalar>&); \
+    template void emitBranchSegment(const BranchNodeT<Scalar>&, int, SegmentSink&); \
+    template BranchNodeT<Scalar> childBranch(const BranchNodeT<Scalar>&, int, int, \
+                                             const TreeParams&); \
+    template void generateSubtree(const BranchNodeT<Scalar>&, const TreeParams&, int, \
+                                  SegmentSink&);
+
+INSTANTIATE_TREE_GENERATOR(float)
+INSTANTIATE_TREE_GENERATOR(double)
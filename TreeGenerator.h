@@ -0,0 +1,148 @@
+/*========================================================================
+ * File: TreeGenerator.h
+ * Purpose: headless recursive 3D tree generator (iterated function system)
+ *======================================================================*/
+#ifndef TREEGENERATOR_H
+#define TREEGENERATOR_H
+
+#include <cstdint>
+#include "SegmentSink.h"
+
+class ViewCuller;
+
+// Animation parameters
+struct TreeParams {
+    double lambda;          // length reduction factor
+    double angle;           // branch angle from trunk
+    double factor;          // branch position along trunk
+    double rotationSpeed;   // rotation speed
+    int numBranches;        // number of branches per node
+};
+
+// Color structure
+struct Color {
+    float r, g, b;
+    Color(float r_, float g_, float b_) : r(r_), g(g_), b(b_) {}
+};
+
+// Scalar type of the generator's arithmetic. Float is the fast path;
+// double is the reference that the parallel, topology and cached paths
+// reproduce bit for bit. Segments are handed to sinks as Segment3D
+// either way.
+enum TreePrecision {PRECISION_FLOAT, PRECISION_DOUBLE};
+
+const char* treePrecisionName(TreePrecision precision);
+// Parses "float" or "double"; returns false on anything else
+bool parseTreePrecision(const char* name, TreePrecision& precision);
+
+// 3D vector helper
+template <typename Scalar>
+struct Vec3T {
+    Scalar x, y, z;
+    Vec3T(Scalar x_, Scalar y_, Scalar z_) : x(x_), y(y_), z(z_) {}
+};
+
+// State of one recursion step
+template <typename Scalar>
+struct BranchNodeT {
+    Scalar x, y, z;             // start point
+    Scalar dirX, dirY, dirZ;    // unit direction
+    Scalar length;
+    int depth;                  // levels left, counting this one
+};
+
+typedef Vec3T<double> Vec3;
+typedef BranchNodeT<double> BranchNode;
+
+// Bumped whenever generateTree's output changes for the same
+// parameters; stored caches of older versions are rejected
+const int TREE_GENERATOR_VERSION = 1;
+
+// Where the trunk starts and how long it is
+const double TREE_ROOT_X = 0.0;
+const double TREE_ROOT_Y = -80.0;
+const double TREE_ROOT_Z = 0.0;
+const double TREE_TRUNK_LENGTH = 60.0;
+
+// Balanced default parameters
+TreeParams defaultTreeParams();
+
+template <typename Scalar>
+Vec3T<Scalar> normalize(const Vec3T<Scalar>& v);
+Color lerpColor(const Color& c1, const Color& c2, float t);
+Color getColorForDepth(int currentDepth, int maxDepth);
+int getBranchCountForDepth(int currentDepth, int maxDepth, int maxBranches);
+int getLineWidthForLength(double length);
+
+// Exact number of segments generateTree emits, without generating them
+size_t treeSegmentCount(const TreeParams& params, int maxDepth);
+
+// Building blocks of the recursion, shared by all generation strategies.
+// They are instantiated for float and double; every parameter and
+// constant is rounded to the scalar type before use, so the vector
+// kernels can reproduce them exactly.
+template <typename Scalar>
+void branchBasis(const Vec3T<Scalar>& dir, Vec3T<Scalar>& perp1, Vec3T<Scalar>& perp2);
+template <typename Scalar = double>
+BranchNodeT<Scalar> rootBranch(int maxDepth);
+template <typename Scalar>
+bool isTerminalBranch(const BranchNodeT<Scalar>& node);
+template <typename Scalar>
+void emitBranchSegment(const BranchNodeT<Scalar>& node, int maxDepth, SegmentSink& sink);
+template <typename Scalar>
+BranchNodeT<Scalar> childBranch(const BranchNodeT<Scalar>& parent, int i, int numBranches,
+                                const TreeParams& params);
+
+// Recursive 3D tree generation with variable branches and colors
+void generateTree3D(double x, double y, double z,
+                    double dirX, double dirY, double dirZ,
+                    double length, int depth, const TreeParams& params,
+                    int maxDepth, SegmentSink& sink);
+
+// Subtree below (and including) one node
+template <typename Scalar>
+void generateSubtree(const BranchNodeT<Scalar>& node, const TreeParams& params,
+                     int maxDepth, SegmentSink& sink);
+
+// Whole tree from the standard root, growing upward, in double
+void generateTree(const TreeParams& params, int maxDepth, SegmentSink& sink);
+
+// The same tree at the given precision. In float the end points differ
+// from the double reference by rounding only (about 2e-5 units at depth
+// 12; boom-gen --precision-check measures it).
+void generateTree(const TreeParams& params, int maxDepth, SegmentSink& sink,
+                  TreePrecision precision);
+
+// Whole tree in the same order, walked with an explicit stack instead
+// of native recursion. Segments reach the sink through AddSegments in
+// chunks of at most chunkSize, so memory stays fixed at any depth.
+void generateTreeChunked(const TreeParams& params, int maxDepth, SegmentSink& sink,
+                         size_t chunkSize = 4096);
+
+// Whole tree as seen through a view: subtrees outside the frustum are
+// skipped, subtrees smaller than the culler's pixel threshold are
+// collapsed into their first segment
+void generateTree(const TreeParams& params, int maxDepth, const ViewCuller& culler,
+                  SegmentSink& sink);
+
+// Counts the generator's recursive calls (nodes visited, terminal ones
+// included) on the creating thread while it is alive. Calls made on the
+// parallel generator's workers are not counted. Without a counter the
+// generator pays one thread-local test per call.
+class RecursionCounter
+{
+    public:
+        RecursionCounter();
+        ~RecursionCounter();
+
+        uint64_t Calls() const { return calls; }
+
+    private:
+        uint64_t calls;
+        uint64_t* previous;         // counters nest
+
+        RecursionCounter(const RecursionCounter&);
+        RecursionCounter& operator=(const RecursionCounter&);
+};
+
+#endif // TREEGENERATOR_H
@@ -0,0 +1,174 @@
+/*========================================================================
+ * File: TreeTopology.cpp
+ * Purpose: implementation of the cached tree topology
+ *======================================================================*/
+#include "TreeTopology.h"
+#include <cmath>
+
+TreeTopology::TreeTopology()
+    : maxDepth(-1), maxBranches(-1), liveLevels(-1), tableStride(0)
+{
+}
+
+int TreeTopology::LiveLevels(const TreeParams& params, int maxDepth)
+{
+    // Same repeated multiplication and cutoff as the recursion
+    int count = 0;
+    double length = TREE_TRUNK_LENGTH;
+    for (int d = maxDepth; d >= 1; d--) {
+        if (length < 0.5) break;
+        count++;
+        length *= params.lambda;
+    }
+    return count;
+}
+
+bool TreeTopology::Update(const TreeParams& params, int newMaxDepth)
+{
+    int live = LiveLevels(params, newMaxDepth);
+    if (newMaxDepth == maxDepth && params.numBranches == maxBranches && live == liveLevels) {
+        return false;
+    }
+
+    maxDepth = newMaxDepth;
+    maxBranches = params.numBranches;
+    liveLevels = live;
+    build(live);
+    return true;
+}
+
+void TreeTopology::build(int liveCount)
+{
+    parent.clear();
+    depth.clear();
+    slot.clear();
+
+    int levels = maxDepth > 0 ? maxDepth + 1 : 1;
+    branchCounts.assign(levels, 0);
+    colors.assign(levels, Color(0, 0, 0));
+    int widest = 0;
+    for (int d = 1; d <= maxDepth; d++) {
+        branchCounts[d] = getBranchCountForDepth(d, maxDepth, maxBranches);
+        colors[d] = getColorForDepth(d, maxDepth);
+        if (branchCounts[d] > widest) widest = branchCounts[d];
+    }
+
+    path.resize(levels);
+    lengths.resize(levels);
+    widths.resize(levels);
+    tableStride = widest;
+    cosRot.assign((size_t)levels * widest, 0.0);
+    sinRot.assign((size_t)levels * widest, 0.0);
+
+    if (liveCount <= 0) return;
+    addNode(-1, maxDepth, 0, maxDepth - liveCount + 1);
+}
+
+void TreeTopology::addNode(int32_t parentIndex, int nodeDepth, int nodeSlot, int lastDepth)
+{
+    int32_t index = (int32_t)depth.size();
+    parent.push_back(parentIndex);
+    depth.push_back((uint8_t)nodeDepth);
+    slot.push_back((uint8_t)nodeSlot);
+
+    if (nodeDepth <= lastDepth) return;
+    for (int i = 0; i < branchCounts[nodeDepth]; i++) {
+        addNode(index, nodeDepth - 1, i, lastDepth);
+    }
+}
+
+void TreeTopology::Evaluate(const TreeParams& params, std::vector<Segment3D>& out)
+{
+    const size_t count = depth.size();
+    out.resize(count);
+    if (count == 0) return;
+
+    // Per-depth values for this frame, with the recursion's exact arithmetic
+    const int stride = tableStride;
+    double length = TREE_TRUNK_LENGTH;
+    for (int d = maxDepth; d >= 1; d--) {
+        lengths[d] = length;
+        widths[d] = getLineWidthForLength(length);
+        length *= params.lambda;
+
+        int n = branchCounts[d];
+        for (int i = 0; i < n; i++) {
+            double rotAngle = (2.0 * M_PI * i) / n;
+            cosRot[d * stride + i] = cos(rotAngle);
+            sinRot[d * stride + i] = sin(rotAngle);
+        }
+    }
+    double branchAngle = params.angle * M_PI / 180.0;
+    const double cosBranch = cos(branchAngle);
+    const double sinBranch = sin(branchAngle);
+    const int lastDepth = maxDepth - liveLevels + 1;
+
+    // Pre-order: a node's parent is the latest node one depth up
+    for (size_t k = 0; k < count; k++) {
+        const int d = depth[k];
+        double x, y, z, dirX, dirY, dirZ;
+
+        if (parent[k] < 0) {
+            BranchNode trunk = rootBranch(maxDepth);
+            x = trunk.x;
+            y = trunk.y;
+            z = trunk.z;
+            dirX = trunk.dirX;
+            dirY = trunk.dirY;
+            dirZ = trunk.dirZ;
+        } else {
+            const PathEntry& p = path[d + 1];
+            const int table = (d + 1) * stride + slot[k];
+            const double c = cosRot[table];
+            const double s = sinRot[table];
+            Vec3 radial(
+                p.perp1X * c + p.perp2X * s,
+                p.perp1Y * c + p.perp2Y * s,
+                p.perp1Z * c + p.perp2Z * s
+            );
+            Vec3 dir = normalize(Vec3(
+                p.dirX * cosBranch + radial.x * sinBranch,
+                p.dirY * cosBranch + radial.y * sinBranch,
+                p.dirZ * cosBranch + radial.z * sinBranch
+            ));
+            x = p.branchX;
+            y = p.branchY;
+            z = p.branchZ;
+            dirX = dir.x;
+            dirY = dir.y;
+            dirZ = dir.z;
+        }
+
+        const double len = lengths[d];
+        Segment3D& segment = out[k];
+        segment.x1 = x;
+        segment.y1 = y;
+        segment.z1 = z;
+        segment.x2 = x + dirX * len;
+        segment.y2 = y + dirY * len;
+        segment.z2 = z + dirZ * len;
+        segment.r = colors[d].r;
+        segment.g = colors[d].g;
+        segment.b = colors[d].b;
+        segment.width = widths[d];
+
+        // Nodes with children publish their branch point and basis
+        if (d > lastDepth) {
+            PathEntry& entry = path[d];
+            entry.branchX = x + dirX * len * params.factor;
+            entry.branchY = y + dirY * len * params.factor;
+            entry.branchZ = z + dirZ * len * params.factor;
+            entry.dirX = dirX;
+            entry.dirY = dirY;
+            entry.dirZ = dirZ;
+            Vec3 perp1(0, 0, 0), perp2(0, 0, 0);
+            branchBasis(Vec3(dirX, dirY, dirZ), perp1, perp2);
+            entry.perp1X = perp1.x;
+            entry.perp1Y = perp1.y;
+            entry.perp1Z = perp1.z;
+            entry.perp2X = perp2.x;
+            entry.perp2Y = perp2.y;
+            entry.perp2Z = perp2.z;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+/*========================================================================
+ * File: TreeTopology.h
+ * Purpose: cached flat tree topology with a per-frame geometry pass
+ *======================================================================*/
+#ifndef TREETOPOLOGY_H
+#define TREETOPOLOGY_H
+
+#include <cstdint>
+#include <vector>
+#include "TreeGenerator.h"
+
+// The node hierarchy only depends on maxDepth, the maximum branch count
+// and how many levels pass the minimum length; the animated lambda,
+// angle and factor only move the nodes. The topology is stored flat in
+// recursion (pre-)order and rebuilt when that key changes; Evaluate
+// recomputes positions in one linear pass without recursion or
+// allocation, producing exactly what generateTree produces.
+class TreeTopology
+{
+    public:
+        TreeTopology();
+
+        // Rebuilds the topology if params/maxDepth give a different one.
+        // Returns true when it was rebuilt.
+        bool Update(const TreeParams& params, int maxDepth);
+
+        // Writes one segment per node into out (resized to NodeCount())
+        void Evaluate(const TreeParams& params, std::vector<Segment3D>& out);
+
+        size_t NodeCount() const { return depth.size(); }
+        int MaxDepth() const { return maxDepth; }
+
+        // Flat hierarchy, indexed by node
+        const std::vector<int32_t>& Parents() const { return parent; }
+        const std::vector<uint8_t>& Depths() const { return depth; }
+        const std::vector<uint8_t>& Slots() const { return slot; }
+
+        // Levels (counted from the trunk) that pass the minimum length
+        static int LiveLevels(const TreeParams& params, int maxDepth);
+
+    private:
+        int maxDepth;
+        int maxBranches;
+        int liveLevels;
+
+        std::vector<int32_t> parent;
+        std::vector<uint8_t> depth;
+        std::vector<uint8_t> slot;
+
+        // Per-depth constants, indexed by depth
+        std::vector<int> branchCounts;
+        std::vector<Color> colors;
+
+        // Per-frame scratch: current ancestor at every depth
+        struct PathEntry {
+            double branchX, branchY, branchZ;
+            double dirX, dirY, dirZ;
+            double perp1X, perp1Y, perp1Z;
+            double perp2X, perp2Y, perp2Z;
+        };
+        std::vector<PathEntry> path;
+        std::vector<double> lengths;
+        std::vector<int> widths;
+        std::vector<double> cosRot;     // [depth * tableStride + slot]
+        std::vector<double> sinRot;
+        int tableStride;
+
+        void build(int liveCount);
+        void addNode(int32_t parentIndex, int nodeDepth, int nodeSlot, int lastDepth);
+};
+
+#endif // TREETOPOLOGY_H
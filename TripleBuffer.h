@@ -0,0 +1,49 @@
+/*========================================================================
+ * File: TripleBuffer.h
+ * Purpose: lock-free single-producer/single-consumer frame handoff
+ *======================================================================*/
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Three slots: the producer fills Back(), the consumer reads Front(),
+// and the third is the handoff. Publish and Acquire each exchange a
+// slot index with the handoff atomically, so neither side ever blocks
+// the other and slots (with the memory they own) are reused forever.
+// The producer may check Pending() before publishing so that no
+// published frame is dropped.
+template <typename T>
+class TripleBuffer
+{
+    public:
+        TripleBuffer() : handoff(1), back(0), front(2) {}
+
+        // Producer side
+        T& Back() { return slots[back]; }
+        bool Pending() const { return (handoff.load(std::memory_order_acquire) & FRESH) != 0; }
+        void Publish()
+        {
+            back = handoff.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        // Consumer side: true if a newer frame became the front
+        bool Acquire()
+        {
+            if (!Pending()) return false;
+            front = handoff.exchange(front, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+        T& Front() { return slots[front]; }
+
+    private:
+        static const int INDEX = 3;
+        static const int FRESH = 4;         // handoff slot not yet acquired
+
+        T slots[3];
+        std::atomic<int> handoff;
+        int back;                           // producer only
+        int front;                          // consumer only
+};
+
+#endif // TRIPLEBUFFER_H
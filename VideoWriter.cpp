@@ -0,0 +1,134 @@
+/*========================================================================
+ * File: VideoWriter.cpp
+ * Purpose: implementation of the Y4M and raw RGB video streams
+ *======================================================================*/
+#include "VideoWriter.h"
+#include <cstring>
+
+namespace {
+    const char FRAME_MARKER[] = "FRAME\n";
+    const size_t FRAME_MARKER_BYTES = sizeof(FRAME_MARKER) - 1;
+
+    bool endsWith(const char* text, const char* suffix)
+    {
+        size_t length = strlen(text);
+        size_t suffixLength = strlen(suffix);
+        return length >= suffixLength && strcmp(text + length - suffixLength, suffix) == 0;
+    }
+
+    inline uint8_t clampByte(int value)
+    {
+        return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+
+    // Full-range BT.601 in 16.16 fixed point, rounded
+    inline uint8_t luma(int r, int g, int b)
+    {
+        return clampByte((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+    }
+
+    inline uint8_t chromaBlue(int r, int g, int b)
+    {
+        return clampByte(((-11059 * r - 21709 * g + 32768 * b + 32768) >> 16) + 128);
+    }
+
+    inline uint8_t chromaRed(int r, int g, int b)
+    {
+        return clampByte(((32768 * r - 27439 * g - 5329 * b + 32768) >> 16) + 128);
+    }
+}
+
+bool parseVideoFormat(const char* name, VideoFormat& format)
+{
+    if (strcmp(name, "y4m") == 0) {
+        format = VIDEO_Y4M;
+    } else if (strcmp(name, "rgb") == 0) {
+        format = VIDEO_RGB;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* videoFormatName(VideoFormat format)
+{
+    return format == VIDEO_Y4M ? "y4m" : "rgb";
+}
+
+VideoFormat videoFormatForPath(const char* path)
+{
+    return endsWith(path, ".rgb") || endsWith(path, ".raw") ? VIDEO_RGB : VIDEO_Y4M;
+}
+
+VideoWriter::VideoWriter(FILE* stream, VideoFormat videoFormat, int w, int h, int rate)
+    : out(stream), format(videoFormat), width(w), height(h), fps(rate)
+{
+}
+
+bool VideoWriter::WriteHeader()
+{
+    if (format != VIDEO_Y4M) return true;
+    return fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n",
+                   width, height, fps) > 0;
+}
+
+size_t VideoWriter::FrameBytes() const
+{
+    size_t pixels = (size_t)width * height;
+    if (format == VIDEO_RGB) return pixels * 3;
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    return FRAME_MARKER_BYTES + pixels + 2 * chroma;
+}
+
+void VideoWriter::Encode(const uint8_t* rgba, std::vector<uint8_t>& frame) const
+{
+    frame.resize(FrameBytes());
+    uint8_t* target = frame.data();
+
+    if (format == VIDEO_RGB) {
+        size_t pixels = (size_t)width * height;
+        for (size_t i = 0; i < pixels; i++) {
+            target[3 * i] = rgba[4 * i];
+            target[3 * i + 1] = rgba[4 * i + 1];
+            target[3 * i + 2] = rgba[4 * i + 2];
+        }
+        return;
+    }
+
+    memcpy(target, FRAME_MARKER, FRAME_MARKER_BYTES);
+    uint8_t* y = target + FRAME_MARKER_BYTES;
+    for (size_t i = 0, n = (size_t)width * height; i < n; i++) {
+        y[i] = luma(rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2]);
+    }
+
+    // Chroma from the average of each 2x2 block (edge blocks of odd
+    // sizes average what they cover)
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    uint8_t* cb = y + (size_t)width * height;
+    uint8_t* cr = cb + (size_t)chromaWidth * chromaHeight;
+    for (int cy = 0; cy < chromaHeight; cy++) {
+        for (int cx = 0; cx < chromaWidth; cx++) {
+            int r = 0, g = 0, b = 0, count = 0;
+            for (int py = 2 * cy; py < 2 * cy + 2 && py < height; py++) {
+                for (int px = 2 * cx; px < 2 * cx + 2 && px < width; px++) {
+                    const uint8_t* p = rgba + ((size_t)py * width + px) * 4;
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                    count++;
+                }
+            }
+            r = (r + count / 2) / count;
+            g = (g + count / 2) / count;
+            b = (b + count / 2) / count;
+            cb[(size_t)cy * chromaWidth + cx] = chromaBlue(r, g, b);
+            cr[(size_t)cy * chromaWidth + cx] = chromaRed(r, g, b);
+        }
+    }
+}
+
+bool VideoWriter::WriteFrame(const std::vector<uint8_t>& frame)
+{
+    return fwrite(frame.data(), 1, frame.size(), out) == frame.size();
+}
@@ -0,0 +1,59 @@
+/*========================================================================
+ * File: VideoWriter.h
+ * Purpose: uncompressed video streams (YUV4MPEG2 or raw RGB) of RGBA
+ *          framebuffers
+ *======================================================================*/
+#ifndef VIDEOWRITER_H
+#define VIDEOWRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Y4M: 4:2:0 full-range (JPEG) YCbCr with a stream header, readable by
+// ffmpeg, mpv and most encoders. RGB: packed rgb24 frames and no header;
+// the reader must be told the size and rate (ffmpeg -f rawvideo
+// -pix_fmt rgb24 -s WxH -r FPS).
+enum VideoFormat {VIDEO_Y4M, VIDEO_RGB};
+
+bool parseVideoFormat(const char* name, VideoFormat& format);
+const char* videoFormatName(VideoFormat format);
+
+// Y4M unless the name ends in .rgb or .raw
+VideoFormat videoFormatForPath(const char* path);
+
+// Encoding is separate from writing, so that many frames can be encoded
+// at once on other threads and written in order on one.
+class VideoWriter
+{
+    public:
+        // The stream is not owned; frames are RGBA8, rows from top to
+        // bottom, as the rasterizer produces them
+        VideoWriter(FILE* out, VideoFormat format, int width, int height, int fps);
+
+        bool WriteHeader();
+
+        // Bytes of one encoded frame, including the Y4M frame marker
+        size_t FrameBytes() const;
+
+        // Thread-safe: touches nothing but its arguments
+        void Encode(const uint8_t* rgba, std::vector<uint8_t>& frame) const;
+
+        bool WriteFrame(const std::vector<uint8_t>& frame);
+
+        VideoFormat Format() const { return format; }
+        int Width() const { return width; }
+        int Height() const { return height; }
+        int FrameRate() const { return fps; }
+
+    private:
+        FILE* out;
+        VideoFormat format;
+        int width, height;
+        int fps;
+
+        VideoWriter(const VideoWriter&);
+        VideoWriter& operator=(const VideoWriter&);
+};
+
+#endif // VIDEOWRITER_H
@@ -0,0 +1,147 @@
+/*========================================================================
+ * File: View.cpp
+ * Purpose: implementation of the view parameters and the view culler
+ *======================================================================*/
+#include "View.h"
+#include <cmath>
+
+ViewParams defaultViewParams(int viewportWidth, int viewportHeight)
+{
+    ViewParams view;
+    view.rotationX = 0.0;
+    view.rotationY = 0.0;
+    view.cameraDistance = VIEW_CAMERA_DISTANCE;
+    view.fov = VIEW_FOV;
+    view.nearPlane = VIEW_NEAR;
+    view.farPlane = VIEW_FAR;
+    view.viewportWidth = viewportWidth;
+    view.viewportHeight = viewportHeight;
+    return view;
+}
+
+void viewFrustumSlopes(const ViewParams& view, double& right, double& top)
+{
+    double aspect = (double)view.viewportWidth / (double)view.viewportHeight;
+    top = tan(view.fov * M_PI / 360.0);
+    right = top * aspect;
+}
+
+void viewMatrix(const ViewParams& view, double out[16])
+{
+    double ax = view.rotationX * M_PI / 180.0;
+    double ay = view.rotationY * M_PI / 180.0;
+    double cx = cos(ax), sx = sin(ax);
+    double cy = cos(ay), sy = sin(ay);
+    const double m[16] = {
+        cy,  sx * sy, -cx * sy, 0.0,
+        0.0, cx,      sx,       0.0,
+        sy,  -sx * cy, cx * cy, 0.0,
+        0.0, 0.0,     -view.cameraDistance, 1.0
+    };
+    for (int i = 0; i < 16; i++) {
+        out[i] = m[i];
+    }
+}
+
+double viewUnitsPerPixel(const ViewParams& view)
+{
+    double right, top;
+    viewFrustumSlopes(view, right, top);
+    return 2.0 * top * view.cameraDistance / view.viewportHeight;
+}
+
+// The eye sits at the origin of eye space; world = R^T (eye - t)
+void viewRay(const ViewParams& view, double px, double py,
+             double origin[3], double direction[3])
+{
+    double m[16];
+    viewMatrix(view, m);
+    double right, top;
+    viewFrustumSlopes(view, right, top);
+
+    double eyeDir[3] = {
+        (2.0 * px / view.viewportWidth - 1.0) * right,
+        (1.0 - 2.0 * py / view.viewportHeight) * top,
+        -1.0
+    };
+    double eyeOrigin[3] = {-m[12], -m[13], -m[14]};
+
+    double length = 0.0;
+    for (int i = 0; i < 3; i++) {
+        origin[i] = m[4 * i] * eyeOrigin[0] + m[4 * i + 1] * eyeOrigin[1] + m[4 * i + 2] * eyeOrigin[2];
+        direction[i] = m[4 * i] * eyeDir[0] + m[4 * i + 1] * eyeDir[1] + m[4 * i + 2] * eyeDir[2];
+        length += direction[i] * direction[i];
+    }
+    length = sqrt(length);
+    for (int i = 0; i < 3; i++) {
+        direction[i] /= length;
+    }
+}
+
+ViewCuller::ViewCuller(const ViewParams& v, double pixels)
+    : view(v), minPixels(pixels)
+{
+    // Same order as Canvas: glRotated about X, then about Y
+    double ax = view.rotationX * M_PI / 180.0;
+    double ay = view.rotationY * M_PI / 180.0;
+    double cx = cos(ax), sx = sin(ax);
+    double cy = cos(ay), sy = sin(ay);
+    const double r[3][3] = {
+        {cy,       0.0, sy},
+        {sx * sy,  cx,  -sx * cy},
+        {-cx * sy, sx,  cx * cy}
+    };
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            rotation[i][j] = r[i][j];
+        }
+    }
+
+    // Inward distance to a side plane is -dot(plane, eyePoint)
+    double right, top;
+    viewFrustumSlopes(view, right, top);
+    double sideNorm = sqrt(1.0 + right * right);
+    double topNorm = sqrt(1.0 + top * top);
+    const double p[4][3] = {
+        {1.0 / sideNorm,  0.0, right / sideNorm},
+        {-1.0 / sideNorm, 0.0, right / sideNorm},
+        {0.0, 1.0 / topNorm,   top / topNorm},
+        {0.0, -1.0 / topNorm,  top / topNorm}
+    };
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 3; j++) {
+            planes[i][j] = p[i][j];
+        }
+    }
+
+    pixelsPerUnit = 0.5 * view.viewportHeight / top;
+}
+
+void ViewCuller::toEye(double x, double y, double z, double out[3]) const
+{
+    for (int i = 0; i < 3; i++) {
+        out[i] = rotation[i][0] * x + rotation[i][1] * y + rotation[i][2] * z;
+    }
+    out[2] -= view.cameraDistance;
+}
+
+CullResult ViewCuller::Classify(double x, double y, double z, double radius) const
+{
+    double eye[3];
+    toEye(x, y, z, eye);
+
+    double distance = -eye[2];
+    if (distance + radius < view.nearPlane || distance - radius > view.farPlane) {
+        return CULL_OUTSIDE;
+    }
+    for (int i = 0; i < 4; i++) {
+        double side = planes[i][0] * eye[0] + planes[i][1] * eye[1] + planes[i][2] * eye[2];
+        if (side > radius) return CULL_OUTSIDE;
+    }
+
+    // The eye is inside the sphere: it can cover the whole screen
+    if (distance <= radius) return CULL_VISIBLE;
+
+    double pixels = 2.0 * radius / distance * pixelsPerUnit;
+    return pixels < minPixels ? CULL_TOO_SMALL : CULL_VISIBLE;
+}
@@ -0,0 +1,67 @@
+/*========================================================================
+ * File: View.h
+ * Purpose: viewer camera/projection and the view culler used by the
+ *          generator for frustum culling and screen-space detail
+ *======================================================================*/
+#ifndef VIEW_H
+#define VIEW_H
+
+// Camera and projection of the viewer: the tree is rotated about X,
+// then Y, and looked at from cameraDistance along -Z
+const double VIEW_CAMERA_DISTANCE = 300.0;
+const double VIEW_FOV = 45.0;               // vertical, degrees
+const double VIEW_NEAR = 1.0;
+const double VIEW_FAR = 1000.0;
+
+struct ViewParams {
+    double rotationX, rotationY;            // degrees, as Canvas::SetRotation
+    double cameraDistance;
+    double fov;
+    double nearPlane, farPlane;
+    int viewportWidth, viewportHeight;      // pixels
+};
+
+ViewParams defaultViewParams(int viewportWidth, int viewportHeight);
+
+// Frustum extents at distance 1 from the eye
+void viewFrustumSlopes(const ViewParams& view, double& right, double& top);
+
+// World to eye transform (glTranslated, glRotated X, glRotated Y),
+// column-major 4x4 as OpenGL stores it
+void viewMatrix(const ViewParams& view, double out[16]);
+
+// World units covered by one pixel at the rotation centre
+double viewUnitsPerPixel(const ViewParams& view);
+
+// World-space ray through a viewport position (pixels from the top
+// left, as GLFW reports the cursor); direction is unit length
+void viewRay(const ViewParams& view, double px, double py,
+             double origin[3], double direction[3]);
+
+// How a bounding sphere relates to the view
+enum CullResult {CULL_VISIBLE, CULL_OUTSIDE, CULL_TOO_SMALL};
+
+// Classifies world-space bounding spheres against the view frustum and
+// a minimum projected size. minPixels is the detail knob: subtrees whose
+// sphere covers fewer pixels (diameter) are collapsed; 0 keeps everything
+// inside the frustum.
+class ViewCuller
+{
+    public:
+        ViewCuller(const ViewParams& view, double minPixels);
+
+        CullResult Classify(double x, double y, double z, double radius) const;
+
+        double MinPixels() const { return minPixels; }
+
+    private:
+        ViewParams view;
+        double minPixels;
+        double rotation[3][3];                  // world to eye, rows
+        double planes[4][3];                    // side planes through the eye
+        double pixelsPerUnit;                   // at distance 1
+
+        void toEye(double x, double y, double z, double out[3]) const;
+};
+
+#endif // VIEW_H
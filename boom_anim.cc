@@ -0,0 +1,138 @@
+/*========================================================================
+ * File: boom_anim.cc
+ * Purpose: renders the viewer's animation offline on all cores and
+ *          streams it as Y4M or raw RGB video
+ *======================================================================*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "AnimationRenderer.h"
+#include "CommandLine.h"
+#include "StochasticTree.h"
+#include "VideoWriter.h"
+
+static void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " --output FILE [options]" << std::endl;
+    printTreeOptionsUsage(std::cerr);
+    std::cerr << "  --output FILE    video to write ('-' for stdout)" << std::endl;
+    std::cerr << "  --format F       y4m or rgb (default: rgb for .rgb and .raw names," << std::endl;
+    std::cerr << "                   y4m otherwise)" << std::endl;
+    std::cerr << "  --frames N       frames to render (default 600)" << std::endl;
+    std::cerr << "  --first K        first frame; frame 0 is the animation's start" << std::endl;
+    std::cerr << "  --fps N          frame rate; the animation keeps its real-time" << std::endl;
+    std::cerr << "                   speed (default 60)" << std::endl;
+    std::cerr << "  --size W H       frame size in pixels (default 800 800)" << std::endl;
+    std::cerr << "  --tilt X         view tilt in degrees (default 20)" << std::endl;
+    std::cerr << "  --seed N         stochastic tree with the default variation (see boom-gen)" << std::endl;
+    std::cerr << "  --threads N      worker threads (default: all cores)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    int maxDepth = 7;
+    TreeParams params = defaultTreeParams();
+    const char* outputPath = nullptr;
+    const char* formatName = nullptr;
+    long frameCount = 600;
+    long firstFrame = 0;
+    int fps = 60;
+    int frameWidth = 800;
+    int frameHeight = 800;
+    double tilt = 20.0;         // the viewer's
+    bool stochastic = false;
+    TreeVariation variation = defaultTreeVariation(0);
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (parseTreeOption(argc, argv, i, params, maxDepth)) {
+            continue;
+        } else if (strcmp(argv[i], "--output") == 0) {
+            outputPath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--format") == 0) {
+            formatName = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--frames") == 0) {
+            frameCount = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--first") == 0) {
+            firstFrame = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--fps") == 0) {
+            fps = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--size") == 0) {
+            frameWidth = nextIntArg(argc, argv, i);
+            frameHeight = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--tilt") == 0) {
+            tilt = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            variation.seed = (uint32_t)nextIntArg(argc, argv, i);
+            stochastic = true;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return EXIT_SUCCESS;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!outputPath || frameWidth <= 0 || frameHeight <= 0 || frameCount <= 0
+        || firstFrame < 0 || fps <= 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    VideoFormat format = videoFormatForPath(outputPath);
+    if (formatName && !parseVideoFormat(formatName, format)) {
+        std::cerr << "Unknown video format: " << formatName << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool toStdout = strcmp(outputPath, "-") == 0;
+    FILE* out = toStdout ? stdout : fopen(outputPath, "wb");
+    if (!out) {
+        std::cerr << "Cannot open " << outputPath << " for writing" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    AnimationRenderer renderer(threads);
+    renderer.SetTilt(tilt);
+    renderer.SetDepth(maxDepth);
+    if (stochastic) renderer.SetVariation(variation);
+
+    VideoWriter writer(out, format, frameWidth, frameHeight, fps);
+    auto start = std::chrono::steady_clock::now();
+    bool ok = writer.WriteHeader() && renderer.Run(params, firstFrame, frameCount, writer);
+    if (fflush(out) != 0) ok = false;
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    if (!toStdout && fclose(out) != 0) ok = false;
+    if (!ok) {
+        std::cerr << "Cannot write " << outputPath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // The report goes to stderr: stdout may carry the video
+    const AnimationStats& stats = renderer.Stats();
+    double seconds = ms / 1000.0;
+    std::cerr << "depth " << maxDepth
+              << " lambda " << params.lambda
+              << " angle " << params.angle
+              << " factor " << params.factor << std::endl;
+    std::cerr << "video " << videoFormatName(format) << " " << frameWidth << "x" << frameHeight
+              << " " << fps << " fps frames " << firstFrame << ".." << firstFrame + stats.frames - 1
+              << std::endl;
+    if (stochastic) {
+        std::cerr << "seed " << variation.seed << std::endl;
+    }
+    std::cerr << "segments " << stats.segments << std::endl;
+    std::cerr << "threads " << renderer.ThreadCount() << std::endl;
+    std::cerr << "generate_ms " << stats.generateMs / stats.frames
+              << " render_ms " << stats.renderMs / stats.frames << " (per frame, one thread)"
+              << std::endl;
+    std::cerr << "total_ms " << ms << " frames_per_s " << stats.frames / seconds
+              << " realtime " << (double)stats.frames / fps / seconds << "x" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,528 @@
+/*========================================================================
+ * File: boom_bench.cc
+ * Purpose: reproducible benchmarks of generation, canvas storage and
+ *          rendering, with machine-readable results
+ *======================================================================*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include "BranchBVH.h"
+#include "BranchMesh.h"
+#include "Canvas.h"
+#include "CanvasSink.h"
+#include "CommandLine.h"
+#include "Forest.h"
+#include "ShapeCache.h"
+#include "SpecializedGenerator.h"
+#include "StochasticTree.h"
+#include "TreeGenerator.h"
+
+namespace {
+    // Counts without looking at the segments, so only generation is timed
+    class CountSink : public SegmentSink
+    {
+        public:
+            size_t count = 0;
+
+            void AddSegment(const Segment3D&) override { count++; }
+            void AddSegments(const Segment3D*, size_t n) override { count += n; }
+    };
+
+    struct BenchOptions {
+        double minSeconds;          // per case, unless a single run is longer
+        int minRuns;
+        int maxDepth;
+        std::string filter;         // only cases whose name contains it
+        bool json;
+    };
+
+    struct BenchResult {
+        std::string name;
+        int depth;
+        int branches;
+        size_t segments;
+        int runs;
+        double bestMs;
+        double medianMs;
+        long peakRssKb;
+    };
+
+    // The kernel's high-water mark is reset before every case where
+    // Linux allows it, so each case reports its own peak
+    void resetPeakMemory()
+    {
+#ifdef __linux__
+        FILE* file = fopen("/proc/self/clear_refs", "w");
+        if (file) {
+            fputs("5", file);
+            fclose(file);
+        }
+#endif
+    }
+
+    long peakMemoryKb()
+    {
+#ifdef __linux__
+        FILE* file = fopen("/proc/self/status", "r");
+        if (file) {
+            char line[256];
+            long kb = 0;
+            while (fgets(line, sizeof(line), file)) {
+                if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+            }
+            fclose(file);
+            if (kb > 0) return kb;
+        }
+#endif
+#ifndef _WIN32
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+            return usage.ru_maxrss / 1024;
+#else
+            return usage.ru_maxrss;
+#endif
+        }
+#endif
+        return 0;
+    }
+
+    // Runs body (after setup, untimed) until both the minimum time and
+    // run count are reached, or a few times the minimum time has passed
+    BenchResult measure(const BenchOptions& options, const std::string& name,
+                        int depth, int branches, size_t segments,
+                        const std::function<void()>& setup, const std::function<void()>& body)
+    {
+        resetPeakMemory();
+        std::vector<double> times;
+        double total = 0.0;
+        while (times.empty()
+               || ((total < options.minSeconds * 1000.0 || (int)times.size() < options.minRuns)
+                   && total < 5.0 * options.minSeconds * 1000.0)) {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            body();
+            double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            times.push_back(ms);
+            total += ms;
+        }
+        std::sort(times.begin(), times.end());
+
+        BenchResult result;
+        result.name = name;
+        result.depth = depth;
+        result.branches = branches;
+        result.segments = segments;
+        result.runs = (int)times.size();
+        result.bestMs = times.front();
+        result.medianMs = times[times.size() / 2];
+        result.peakRssKb = peakMemoryKb();
+        return result;
+    }
+
+    // Prints each result as soon as its case finishes
+    class Reporter
+    {
+        public:
+            explicit Reporter(bool jsonOutput) : json(jsonOutput), count(0) {}
+
+            void Add(const BenchResult& r)
+            {
+                double perSecond = r.medianMs > 0.0 ? r.segments / (r.medianMs / 1000.0) : 0.0;
+                double nsPerSegment = r.segments ? r.medianMs * 1e6 / r.segments : 0.0;
+                if (json) {
+                    printf("%s\n  {\"bench\": \"%s\", \"depth\": %d, \"branches\": %d, "
+                           "\"segments\": %zu, \"runs\": %d, \"best_ms\": %.4f, "
+                           "\"median_ms\": %.4f, \"segments_per_s\": %.0f, "
+                           "\"ns_per_segment\": %.3f, \"peak_rss_kb\": %ld}",
+                           count ? "," : "[", r.name.c_str(), r.depth, r.branches, r.segments,
+                           r.runs, r.bestMs, r.medianMs, perSecond, nsPerSegment, r.peakRssKb);
+                } else {
+                    if (count == 0) {
+                        printf("bench,depth,branches,segments,runs,best_ms,median_ms,"
+                               "segments_per_s,ns_per_segment,peak_rss_kb\n");
+                    }
+                    printf("%s,%d,%d,%zu,%d,%.4f,%.4f,%.0f,%.3f,%ld\n",
+                           r.name.c_str(), r.depth, r.branches, r.segments, r.runs,
+                           r.bestMs, r.medianMs, perSecond, nsPerSegment, r.peakRssKb);
+                }
+                fflush(stdout);
+                count++;
+            }
+
+            void Finish()
+            {
+                if (json) printf("%s]\n", count ? "\n" : "[");
+            }
+
+        private:
+            bool json;
+            size_t count;
+    };
+
+    bool selected(const BenchOptions& options, const char* name)
+    {
+        return options.filter.empty() || strstr(name, options.filter.c_str()) != nullptr;
+    }
+
+    TreeParams benchParams(int branches)
+    {
+        TreeParams params = defaultTreeParams();
+        params.numBranches = branches;
+        return params;
+    }
+
+    // Recursive generation into a counting sink, in double and in float,
+    // compiled per shape, and jittered by seed 1
+    void benchGenerate(const BenchOptions& options, Reporter& results)
+    {
+        for (int depth = 6; depth <= options.maxDepth; depth++) {
+            for (int branches = 3; branches <= 7; branches++) {
+                TreeParams params = benchParams(branches);
+                CountSink sink;
+                if (selected(options, "generate")) {
+                    results.Add(measure(options, "generate", depth, branches,
+                                        treeSegmentCount(params, depth),
+                                        [&sink]() { sink.count = 0; },
+                                        [&]() { generateTree(params, depth, sink); }));
+                }
+                if (selected(options, "generate_float")) {
+                    results.Add(measure(options, "generate_float", depth, branches,
+                                        treeSegmentCount(params, depth),
+                                        [&sink]() { sink.count = 0; },
+                                        [&]() { generateTree(params, depth, sink, PRECISION_FLOAT); }));
+                }
+                if (selected(options, "generate_specialized")) {
+                    results.Add(measure(options, "generate_specialized", depth, branches,
+                                        treeSegmentCount(params, depth),
+                                        [&sink]() { sink.count = 0; },
+                                        [&]() { generateTreeSpecialized(params, depth, sink); }));
+                }
+                if (selected(options, "generate_stochastic")) {
+                    const TreeVariation variation = defaultTreeVariation(1);
+                    sink.count = 0;
+                    generateStochasticTree(params, variation, depth, sink);
+                    results.Add(measure(options, "generate_stochastic", depth, branches, sink.count,
+                                        [&sink]() { sink.count = 0; },
+                                        [&]() { generateStochasticTree(params, variation, depth, sink); }));
+                }
+            }
+        }
+    }
+
+    // Pre-generated segments pushed into the canvas's compact store, one
+    // Line3D per segment (as the recursion does) or in bulk
+    void benchPush(const BenchOptions& options, Reporter& results)
+    {
+        if (!selected(options, "push_line3d") && !selected(options, "push_bulk")) return;
+        for (int depth = 8; depth <= options.maxDepth; depth += 2) {
+            TreeParams params = benchParams(5);
+            VectorSink source;
+            generateTree(params, depth, source);
+            const std::vector<Segment3D>& segments = source.segments;
+            Canvas canvas(64, 64, Canvas::SOFTWARE);
+
+            if (selected(options, "push_line3d")) {
+                results.Add(measure(options, "push_line3d", depth, 5, segments.size(),
+                    [&canvas]() { canvas.ClearLines(); },
+                    [&]() {
+                        CanvasSink sink(canvas);
+                        for (const auto& s : segments) sink.AddSegment(s);
+                    }));
+            }
+            if (selected(options, "push_bulk")) {
+                results.Add(measure(options, "push_bulk", depth, 5, segments.size(),
+                    [&canvas]() { canvas.ClearLines(); },
+                    [&]() { canvas.Lines3D(segments.data(), segments.size()); }));
+            }
+        }
+    }
+
+    // Branch BVH over the stored lines: a full build, a refit after the
+    // animation moved the lines, and one pick through the view centre
+    void benchBvh(const BenchOptions& options, Reporter& results)
+    {
+        if (!selected(options, "bvh_build") && !selected(options, "bvh_refit")
+            && !selected(options, "bvh_pick")) return;
+        ViewParams view = defaultViewParams(800, 800);
+        view.rotationX = 20.0;
+        double radiusPerWidth = viewUnitsPerPixel(view);
+        for (int depth = 8; depth <= options.maxDepth; depth += 2) {
+            TreeParams params = benchParams(5);
+            VectorSink source;
+            generateTree(params, depth, source);
+            const std::vector<Segment3D>& segments = source.segments;
+            BranchBVH bvh;
+            bvh.Build(segments.data(), segments.size(), radiusPerWidth);
+
+            if (selected(options, "bvh_build")) {
+                results.Add(measure(options, "bvh_build", depth, 5, segments.size(),
+                    []() {},
+                    [&]() { bvh.Build(segments.data(), segments.size(), radiusPerWidth); }));
+            }
+            if (selected(options, "bvh_refit")) {
+                results.Add(measure(options, "bvh_refit", depth, 5, segments.size(),
+                    []() {},
+                    [&]() { bvh.Refit(segments.data(), segments.size(), radiusPerWidth); }));
+            }
+            if (selected(options, "bvh_pick")) {
+                double origin[3], direction[3];
+                viewRay(view, 400.0, 400.0, origin, direction);
+                results.Add(measure(options, "bvh_pick", depth, 5, segments.size(),
+                    []() {},
+                    [&]() { BranchHit hit; bvh.Pick(origin, direction, hit); }));
+            }
+        }
+    }
+
+    // The viewer's animation at a frame of a 60 Hz run: lambda, angle
+    // and factor on sinusoids, three to seven branches
+    TreeParams animatedParams(int frame)
+    {
+        const double time = frame / 60.0;
+        const double nominal = time / 0.016;
+        TreeParams params = defaultTreeParams();
+        params.numBranches = std::max(3, std::min(7, 5 + (int)(2.0 * sin(0.005 * nominal))));
+        params.lambda += 0.03 * sin(0.007 * nominal);
+        params.angle += 5.0 * sin(0.026 * nominal) + 2.0 * sin(time * 2.1);
+        params.factor += 0.05 * sin(time * 0.9);
+        return params;
+    }
+
+    // 20 seconds of animation through a 64 MB shape cache that starts
+    // empty, against generating every frame
+    void benchShapeCache(const BenchOptions& options, Reporter& results)
+    {
+        const int frames = 1200;
+        const char* names[3] = {"animation_generate", "animation_shape_nearest",
+                                "animation_shape_interpolate"};
+        for (int depth = 6; depth <= std::min(options.maxDepth, 8); depth++) {
+            size_t segments = 0;
+            for (int frame = 0; frame < frames; frame++) {
+                segments += treeSegmentCount(animatedParams(frame), depth);
+            }
+            for (int variant = 0; variant < 3; variant++) {
+                if (!selected(options, names[variant])) continue;
+                ShapeCache::Lookup lookup = variant == 1 ? ShapeCache::NEAREST
+                                                         : ShapeCache::INTERPOLATE;
+                std::unique_ptr<ShapeCache> cache;
+                CompactSegmentStore lines;
+                results.Add(measure(options, names[variant], depth, 5, segments,
+                                    [&]() { cache.reset(new ShapeCache(64 << 20,
+                                                                       defaultShapeGrid(),
+                                                                       lookup)); },
+                                    [&]() {
+                                        for (int frame = 0; frame < frames; frame++) {
+                                            TreeParams params = animatedParams(frame);
+                                            if (variant == 0) {
+                                                lines.Clear();
+                                                generateTree(params, depth, lines);
+                                            } else {
+                                                cache->Get(params, depth, lines);
+                                            }
+                                        }
+                                    }));
+                if (variant > 0) {
+                    std::cerr << names[variant] << " depth " << depth << ": "
+                              << 100.0 * cache->HitRate() << "% of " << cache->Lookups()
+                              << " lookups hit, " << cache->EntryCount() << " trees in "
+                              << cache->ByteSize() / 1024 << " KB" << std::endl;
+                }
+            }
+        }
+    }
+
+    // Forests of 100, 1000 and 10000 trees of depth 3 to 5: generating
+    // the shared shapes, baking every tree into one batch, and drawing
+    // the baked batch
+    void benchForest(const BenchOptions& options, Reporter& results)
+    {
+        if (!selected(options, "forest_")) return;
+        const int size = 800;
+        const int depth = std::min(options.maxDepth, 5);
+        for (size_t count = 100; count <= 10000; count *= 10) {
+            std::vector<ForestTree> trees;
+            scatterForest(count, benchParams(5), std::max(1, depth - 2), depth, 120.0, 1, trees);
+            Forest forest;
+            for (const auto& tree : trees) forest.Add(tree);
+            std::string error;
+            if (!forest.Build(error)) {
+                std::cerr << "forest " << count << ": " << error << std::endl;
+                continue;
+            }
+            size_t segments = forest.SegmentCount();
+            std::string suffix = "_" + std::to_string(count);
+
+            std::string name = "forest_build" + suffix;
+            if (selected(options, name.c_str())) {
+                results.Add(measure(options, name, depth, 5, segments,
+                                    []() {}, [&forest, &error]() { forest.Build(error); }));
+            }
+            LineBatch batch;
+            name = "forest_bake" + suffix;
+            if (selected(options, name.c_str())) {
+                results.Add(measure(options, name, depth, 5, segments,
+                                    []() {}, [&]() { forest.Bake(1.0, batch); }));
+            }
+            name = "forest_render_software" + suffix;
+            if (selected(options, name.c_str())) {
+                Canvas canvas(size, size, Canvas::SOFTWARE);
+                canvas.SetRotation(20.0, 0.0);
+                forest.Bake(1.0, batch);
+                canvas.SwapLineBatch(batch);
+                results.Add(measure(options, name, depth, 5, segments,
+                                    []() {}, [&canvas]() { canvas.Show(); }));
+            }
+#ifdef BOOM_WITH_GL
+            name = "forest_render_gl" + suffix;
+            if (selected(options, name.c_str())) {
+                Canvas canvas(size, size, Canvas::OPENGL_HIDDEN);
+                canvas.SetRotation(20.0, 0.0);
+                forest.Bake(1.0, batch);
+                canvas.SwapLineBatch(batch);
+                results.Add(measure(options, name, depth, 5, segments,
+                                    []() {}, [&canvas]() { canvas.Show(); glFinish(); }));
+            }
+#endif
+        }
+    }
+
+    // One frame of already stored lines: the CPU rasterizer always, and
+    // the GL path in a hidden window when the benchmark has GL
+    void benchRender(const BenchOptions& options, Reporter& results)
+    {
+        const int size = 800;
+        for (int depth = 8; depth <= std::min(options.maxDepth, 11); depth++) {
+            TreeParams params = benchParams(5);
+            size_t count = treeSegmentCount(params, depth);
+
+            if (selected(options, "render_software")) {
+                Canvas canvas(size, size, Canvas::SOFTWARE);
+                canvas.SetRotation(20.0, 0.0);
+                CanvasSink sink(canvas);
+                generateTree(params, depth, sink);
+                results.Add(measure(options, "render_software", depth, 5, count,
+                                    []() {}, [&canvas]() { canvas.Show(); }));
+            }
+            if (selected(options, "mesh_build")) {
+                CompactSegmentStore lines;
+                generateTree(params, depth, lines);
+                BranchMeshBuilder builder;
+                TriangleBatch mesh;
+                const double eye[3] = {0.0, 200.0, 400.0};
+                results.Add(measure(options, "mesh_build", depth, 5, count, []() {},
+                                    [&]() { builder.Build(lines, eye, 0.1, mesh); }));
+            }
+            if (selected(options, "render_software_mesh")) {
+                Canvas canvas(size, size, Canvas::SOFTWARE);
+                canvas.SetRotation(20.0, 0.0);
+                canvas.SetRenderPath(Canvas::MESH);
+                CanvasSink sink(canvas);
+                generateTree(params, depth, sink);
+                results.Add(measure(options, "render_software_mesh", depth, 5, count,
+                                    []() {}, [&canvas]() { canvas.Show(); }));
+            }
+#ifdef BOOM_WITH_GL
+            if (selected(options, "render_gl")) {
+                Canvas canvas(size, size, Canvas::OPENGL_HIDDEN);
+                canvas.SetRotation(20.0, 0.0);
+                CanvasSink sink(canvas);
+                generateTree(params, depth, sink);
+                results.Add(measure(options, "render_gl", depth, 5, count,
+                                    []() {}, [&canvas]() { canvas.Show(); glFinish(); }));
+            }
+            if (selected(options, "render_gl_indexed")) {
+                Canvas canvas(size, size, Canvas::OPENGL_HIDDEN);
+                canvas.SetRotation(20.0, 0.0);
+                canvas.SetRenderPath(Canvas::INDEXED);
+                CanvasSink sink(canvas);
+                generateTree(params, depth, sink);
+                results.Add(measure(options, "render_gl_indexed", depth, 5, count,
+                                    []() {}, [&canvas]() { canvas.Show(); glFinish(); }));
+            }
+            if (selected(options, "render_gl_mesh")) {
+                Canvas canvas(size, size, Canvas::OPENGL_HIDDEN);
+                canvas.SetRotation(20.0, 0.0);
+                canvas.SetRenderPath(Canvas::MESH);
+                CanvasSink sink(canvas);
+                generateTree(params, depth, sink);
+                results.Add(measure(options, "render_gl_mesh", depth, 5, count,
+                                    []() {}, [&canvas]() { canvas.Show(); glFinish(); }));
+            }
+#endif
+        }
+    }
+
+    void printUsage(const char* program)
+    {
+        std::cerr << "Usage: " << program << " [options]" << std::endl;
+        std::cerr << "  --filter NAME    only cases containing NAME (generate, generate_float," << std::endl;
+        std::cerr << "                   generate_specialized, generate_stochastic," << std::endl;
+        std::cerr << "                   push_line3d, push_bulk," << std::endl;
+        std::cerr << "                   bvh_build, bvh_refit, bvh_pick," << std::endl;
+        std::cerr << "                   render_software, render_gl, render_gl_indexed," << std::endl;
+        std::cerr << "                   mesh_build, render_software_mesh, render_gl_mesh," << std::endl;
+        std::cerr << "                   forest_build_N, forest_bake_N, forest_render_software_N," << std::endl;
+        std::cerr << "                   forest_render_gl_N for N = 100, 1000, 10000," << std::endl;
+        std::cerr << "                   animation_generate, animation_shape_nearest," << std::endl;
+        std::cerr << "                   animation_shape_interpolate)" << std::endl;
+        std::cerr << "  --max-depth N    deepest tree to run (default 12)" << std::endl;
+        std::cerr << "  --min-time S     seconds per case (default 0.5)" << std::endl;
+        std::cerr << "  --min-runs N     runs per case (default 3)" << std::endl;
+        std::cerr << "  --json           JSON array instead of CSV" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.minSeconds = 0.5;
+    options.minRuns = 3;
+    options.maxDepth = 12;
+    options.json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0) {
+            options.filter = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--max-depth") == 0) {
+            options.maxDepth = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--min-time") == 0) {
+            options.minSeconds = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--min-runs") == 0) {
+            options.minRuns = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            options.json = true;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return EXIT_SUCCESS;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Every case uses fixed parameters; the generator has no randomness,
+    // so results differ between runs only by timing
+    Reporter results(options.json);
+    benchGenerate(options, results);
+    benchPush(options, results);
+    benchBvh(options, results);
+    benchForest(options, results);
+    benchShapeCache(options, results);
+    benchRender(options, results);
+    results.Finish();
+    return EXIT_SUCCESS;
+}
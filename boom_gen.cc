@@ -0,0 +1,792 @@
+/*========================================================================
+ * File: boom_gen.cc
+ * Purpose: headless command line tree generator (no window, no GL)
+ *======================================================================*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include "BranchBVH.h"
+#include "CommandLine.h"
+#include "CompactSegments.h"
+#include "IndexedLines.h"
+#include "InstancedTree.h"
+#include "ParallelGenerator.h"
+#include "SegmentWriter.h"
+#include "SimdGenerator.h"
+#include "SpecializedGenerator.h"
+#include "StochasticTree.h"
+#include "TreeCache.h"
+#include "TreeGenerator.h"
+#include "TreeTopology.h"
+#include "View.h"
+
+// FNV-1a over the segment bytes, to check that outputs are identical
+class HashSink : public SegmentSink
+{
+    public:
+        unsigned long long hash;
+        size_t count;
+
+        HashSink() : hash(1469598103934665603ULL), count(0) {}
+
+        void AddSegment(const Segment3D& s) override
+        {
+            const double coords[6] = {s.x1, s.y1, s.z1, s.x2, s.y2, s.z2};
+            const float color[3] = {s.r, s.g, s.b};
+            mix(coords, sizeof(coords));
+            mix(color, sizeof(color));
+            mix(&s.width, sizeof(s.width));
+            count++;
+        }
+
+    private:
+        void mix(const void* data, size_t size)
+        {
+            const unsigned char* bytes = (const unsigned char*)data;
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ bytes[i]) * 1099511628211ULL;
+            }
+        }
+};
+
+// Best-of-runs wall time for one generation strategy
+template <typename GenerateFn>
+static double timeGeneration(GenerateFn generate, int runs)
+{
+    double best = 0.0;
+    for (int run = 0; run < runs; run++) {
+        auto start = std::chrono::steady_clock::now();
+        generate();
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+// Generation time for 1..maxThreads workers at depths 8-12; with a
+// variation, of the stochastic tree
+static void printScalingReport(const TreeParams& params, const TreeVariation* variation,
+                               int maxThreads)
+{
+    const int runs = 3;
+    auto serial = [&](int depth, SegmentSink& sink) {
+        if (variation) {
+            generateStochasticTree(params, *variation, depth, sink);
+        } else {
+            generateTree(params, depth, sink);
+        }
+    };
+    auto parallel = [&](ParallelTreeGenerator& generator, int depth, SegmentSink& sink) {
+        if (variation) {
+            generator.Generate(params, *variation, depth, sink);
+        } else {
+            generator.Generate(params, depth, sink);
+        }
+    };
+
+    std::cout << "depth  segments  threads  time_ms  speedup  identical" << std::endl;
+    for (int depth = 8; depth <= 12; depth++) {
+        HashSink reference;
+        serial(depth, reference);
+        double serialMs = timeGeneration([&]() {
+            StatsSink stats;
+            serial(depth, stats);
+        }, runs);
+        std::cout << std::setw(5) << depth << std::setw(10) << reference.count
+                  << std::setw(9) << "serial" << std::setw(9) << std::fixed
+                  << std::setprecision(2) << serialMs << std::setw(9) << 1.0
+                  << std::setw(11) << "-" << std::endl;
+
+        for (int threads = 1; threads <= maxThreads; threads++) {
+            ParallelTreeGenerator generator(threads);
+            HashSink check;
+            parallel(generator, depth, check);
+            double ms = timeGeneration([&]() {
+                StatsSink stats;
+                parallel(generator, depth, stats);
+            }, runs);
+            std::cout << std::setw(5) << depth << std::setw(10) << check.count
+                      << std::setw(9) << threads << std::setw(9) << ms
+                      << std::setw(9) << serialMs / ms
+                      << std::setw(11) << (check.hash == reference.hash ? "yes" : "NO")
+                      << std::endl;
+        }
+    }
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+// Counts segments with one call per batch, so the benchmark measures
+// the generators rather than the sink
+class CountSink : public SegmentSink
+{
+    public:
+        size_t count;
+
+        CountSink() : count(0) {}
+
+        void AddSegment(const Segment3D&) override { count++; }
+        void AddSegments(const Segment3D*, size_t n) override { count += n; }
+};
+
+// Sum of per-segment hashes: equal for the same segments in any order
+class SetHashSink : public SegmentSink
+{
+    public:
+        size_t count;
+        unsigned long long checksum;
+
+        SetHashSink() : count(0), checksum(0) {}
+
+        void AddSegment(const Segment3D& s) override
+        {
+            HashSink one;
+            one.AddSegment(s);
+            checksum += one.hash;
+            count++;
+        }
+};
+
+// Branches per second of the recursive, cached-topology and level-order
+// generators at every SIMD level the CPU supports, in double and float.
+// Each generator is checked against the recursion at its precision.
+static void printSimdBenchmark(const TreeParams& params)
+{
+    const int runs = 5;
+    const TreePrecision precisions[] = {PRECISION_DOUBLE, PRECISION_FLOAT};
+    std::cout << "depth  segments  generator           Mbranches/s  identical" << std::endl;
+    for (int depth = 8; depth <= 12; depth++) {
+        SetHashSink reference[2];
+        std::vector<std::pair<std::string, double>> rows;
+        std::vector<bool> identical;
+        for (int p = 0; p < 2; p++) {
+            generateTree(params, depth, reference[p], precisions[p]);
+            rows.push_back(std::make_pair(std::string("recursive-") + treePrecisionName(precisions[p]),
+                                          timeGeneration([&]() {
+                CountSink sink;
+                generateTree(params, depth, sink, precisions[p]);
+            }, runs)));
+            identical.push_back(true);
+        }
+
+        SetHashSink specialized;
+        generateTreeSpecialized(params, depth, specialized);
+        rows.push_back(std::make_pair(std::string("specialized"), timeGeneration([&]() {
+            CountSink sink;
+            generateTreeSpecialized(params, depth, sink);
+        }, runs)));
+        identical.push_back(specialized.checksum == reference[0].checksum
+                            && specialized.count == reference[0].count);
+
+        TreeTopology topology;
+        std::vector<Segment3D> segments;
+        topology.Update(params, depth);
+        rows.push_back(std::make_pair(std::string("topology"), timeGeneration([&]() {
+            topology.Evaluate(params, segments);
+        }, runs)));
+        identical.push_back(true);
+
+        for (int p = 0; p < 2; p++) {
+            for (int level = SIMD_SCALAR; level <= (int)detectSimdLevel(); level++) {
+                LevelOrderGenerator generator((SimdLevel)level, precisions[p]);
+                SetHashSink check;
+                generator.Generate(params, depth, check);
+                rows.push_back(std::make_pair(std::string("level-") + simdLevelName((SimdLevel)level)
+                                              + "-" + treePrecisionName(precisions[p]),
+                                              timeGeneration([&]() {
+                    CountSink sink;
+                    generator.Generate(params, depth, sink);
+                }, runs)));
+                identical.push_back(check.checksum == reference[p].checksum
+                                    && check.count == reference[p].count);
+            }
+        }
+
+        for (size_t r = 0; r < rows.size(); r++) {
+            double perSecond = reference[0].count / (rows[r].second / 1000.0) / 1e6;
+            std::cout << std::setw(5) << depth << std::setw(10) << reference[0].count << "  "
+                      << std::left << std::setw(18) << rows[r].first << std::right
+                      << std::setw(13) << std::fixed << std::setprecision(2) << perSecond
+                      << std::setw(11) << (identical[r] ? "yes" : "NO") << std::endl;
+        }
+    }
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+// Peak resident set size in kilobytes (0 where unavailable)
+static long peakMemoryKb()
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+// Streams the whole tree to a file in fixed-size chunks
+static int exportTree(const TreeParams& params, int maxDepth, const char* path)
+{
+    ExportFormat format = exportFormatForPath(path);
+    std::unique_ptr<SegmentFileWriter> writer = createSegmentWriter(format);
+    if (!writer->Open(path)) {
+        std::cerr << "Cannot open " << path << " for writing" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    generateTreeChunked(params, maxDepth, *writer);
+    bool written = writer->Close();
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    if (!written) {
+        std::cerr << "Write to " << path << " failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "depth " << maxDepth
+              << " lambda " << params.lambda
+              << " angle " << params.angle
+              << " factor " << params.factor
+              << " branches " << params.numBranches << std::endl;
+    std::cout << "export " << path << " format " << exportFormatName(format) << std::endl;
+    std::cout << "segments " << writer->SegmentCount() << std::endl;
+    std::cout << "bytes " << writer->BytesWritten()
+              << " (" << writer->BytesWritten() / 1e6 / (ms / 1000.0) << " MB/s)" << std::endl;
+    std::cout << "peak_rss_kb " << peakMemoryKb() << std::endl;
+    std::cout << "time_ms " << ms << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Maps the tree cache at path, writing it first if it is missing or stale
+static int cacheTree(const TreeParams& params, int maxDepth, const char* path)
+{
+    auto start = std::chrono::steady_clock::now();
+    MappedTreeCache cache;
+    if (!cache.OpenOrWrite(path, params, maxDepth)) {
+        std::cerr << "Cannot use cache " << path << ": " << cache.Error() << std::endl;
+        return EXIT_FAILURE;
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "depth " << maxDepth
+              << " lambda " << params.lambda
+              << " angle " << params.angle
+              << " factor " << params.factor
+              << " branches " << params.numBranches << std::endl;
+    std::cout << "cache " << path << " " << (cache.WasWritten() ? "written" : "hit");
+    if (cache.WasWritten()) std::cout << " (" << cache.MissReason() << ")";
+    std::cout << std::endl;
+    std::cout << "segments " << cache.SegmentCount() << std::endl;
+    std::cout << "widths " << cache.Lines().rangeCount << std::endl;
+    std::cout << "bytes " << cache.FileSize() << std::endl;
+    std::cout << "peak_rss_kb " << peakMemoryKb() << std::endl;
+    std::cout << "time_ms " << ms << std::endl;
+    return EXIT_SUCCESS;
+}
+
+static double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Indexes the tree in a BVH, then picks through a pixel of the view
+// and/or lists the branches in a sphere. The pick is checked against a
+// linear scan, and the BVH is refitted to the tree at another angle, as
+// the viewer does while the animation runs.
+static int queryTree(const TreeParams& params, int maxDepth, const ViewParams& view, int threads,
+                     const double* pixel, const double* sphere)
+{
+    VectorSink tree;
+    generateTree(params, maxDepth, tree);
+    double radiusPerWidth = viewUnitsPerPixel(view);
+
+    std::unique_ptr<WorkStealingPool> pool;
+    if (threads > 1) {
+        pool.reset(new WorkStealingPool(threads));
+    }
+    BranchBVH bvh(pool.get());
+    auto start = std::chrono::steady_clock::now();
+    bvh.Build(tree.segments.data(), tree.segments.size(), radiusPerWidth);
+    double buildMs = msSince(start);
+
+    std::cout << "segments " << bvh.Size() << " nodes " << bvh.NodeCount()
+              << " threads " << threads << std::endl;
+    std::cout << "build_ms " << buildMs << std::endl;
+
+    if (pixel) {
+        double origin[3], direction[3];
+        viewRay(view, pixel[0], pixel[1], origin, direction);
+        BranchHit hit;
+        start = std::chrono::steady_clock::now();
+        bool found = bvh.Pick(origin, direction, hit);
+        double pickMs = msSince(start);
+
+        // Reference: every capsule tested in turn
+        start = std::chrono::steady_clock::now();
+        BranchHit linearHit = {0, 0.0};
+        bool linearFound = false;
+        for (uint32_t i = 0; i < bvh.Size(); i++) {
+            double t;
+            if (rayHitsCapsule(origin, direction, bvh.Capsule(i), t)
+                && (!linearFound || t < linearHit.distance)) {
+                linearHit.segment = i;
+                linearHit.distance = t;
+                linearFound = true;
+            }
+        }
+        double linearMs = msSince(start);
+
+        std::cout << "pick " << pixel[0] << " " << pixel[1] << ": ";
+        if (found) {
+            std::cout << "segment " << hit.segment << " distance " << hit.distance;
+        } else {
+            std::cout << "none";
+        }
+        // Capsules hit at the same distance are ties, not a mismatch
+        bool agrees = found == linearFound
+                   && (!found || hit.segment == linearHit.segment
+                       || fabs(hit.distance - linearHit.distance)
+                          <= 1e-9 * std::max(1.0, fabs(linearHit.distance)));
+        std::cout << " (" << pickMs << " ms, linear scan " << (agrees ? "agrees" : "DIFFERS");
+        if (linearFound) {
+            std::cout << ": segment " << linearHit.segment << " distance " << linearHit.distance;
+        }
+        std::cout << ", " << linearMs << " ms)" << std::endl;
+    }
+
+    if (sphere) {
+        std::vector<uint32_t> inside;
+        start = std::chrono::steady_clock::now();
+        bvh.QuerySphere(sphere, sphere[3], inside);
+        std::cout << "within " << inside.size() << " (" << msSince(start) << " ms)" << std::endl;
+    }
+
+    TreeParams moved = params;
+    moved.angle += 1.0;
+    VectorSink movedTree;
+    generateTree(moved, maxDepth, movedTree);
+    start = std::chrono::steady_clock::now();
+    bool refitted = bvh.Refit(movedTree.segments.data(), movedTree.segments.size(), radiusPerWidth);
+    std::cout << "refit_ms " << msSince(start) << (refitted ? "" : " (count changed)") << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// End points of the float tree against the double reference, segment by
+// segment. Float is accepted while the largest difference stays below
+// PRECISION_TOLERANCE of the tree's extent, about 8 float epsilons.
+static int checkPrecision(const TreeParams& params, int maxDepth)
+{
+    const double PRECISION_TOLERANCE = 1e-6;
+    const int runs = 3;
+
+    VectorSink reference;
+    generateTree(params, maxDepth, reference, PRECISION_DOUBLE);
+    StatsSink bounds;
+    bounds.AddSegments(reference.segments.data(), reference.segments.size());
+    double extent = std::max(bounds.maxX - bounds.minX,
+                             std::max(bounds.maxY - bounds.minY, bounds.maxZ - bounds.minZ));
+
+    size_t count = 0;
+    bool sameAttributes = true;
+    double maxError = 0.0;
+    CallbackSink check([&](const Segment3D& s) {
+        if (count < reference.segments.size()) {
+            const Segment3D& r = reference.segments[count];
+            const double a[6] = {s.x1, s.y1, s.z1, s.x2, s.y2, s.z2};
+            const double b[6] = {r.x1, r.y1, r.z1, r.x2, r.y2, r.z2};
+            for (int k = 0; k < 6; k++) {
+                maxError = std::max(maxError, fabs(a[k] - b[k]));
+            }
+            sameAttributes = sameAttributes && s.width == r.width
+                             && s.r == r.r && s.g == r.g && s.b == r.b;
+        }
+        count++;
+    });
+    generateTree(params, maxDepth, check, PRECISION_FLOAT);
+
+    double doubleMs = timeGeneration([&]() {
+        CountSink sink;
+        generateTree(params, maxDepth, sink, PRECISION_DOUBLE);
+    }, runs);
+    double floatMs = timeGeneration([&]() {
+        CountSink sink;
+        generateTree(params, maxDepth, sink, PRECISION_FLOAT);
+    }, runs);
+    LevelOrderGenerator levelDouble(detectSimdLevel(), PRECISION_DOUBLE);
+    LevelOrderGenerator levelFloat(detectSimdLevel(), PRECISION_FLOAT);
+    double levelDoubleMs = timeGeneration([&]() {
+        CountSink sink;
+        levelDouble.Generate(params, maxDepth, sink);
+    }, runs);
+    double levelFloatMs = timeGeneration([&]() {
+        CountSink sink;
+        levelFloat.Generate(params, maxDepth, sink);
+    }, runs);
+
+    bool passed = count == reference.segments.size() && sameAttributes
+                  && maxError <= PRECISION_TOLERANCE * extent;
+    std::cout << "segments " << reference.segments.size() << " float " << count << std::endl;
+    std::cout << "extent " << extent << std::endl;
+    std::cout << "max_error " << maxError << " (" << maxError / extent << " of the extent, "
+              << "tolerance " << PRECISION_TOLERANCE << ")" << std::endl;
+    std::cout << "attributes " << (sameAttributes ? "identical" : "DIFFER") << std::endl;
+    std::cout << "recursive_ms double " << doubleMs << " float " << floatMs << std::endl;
+    std::cout << "level_" << simdLevelName(levelFloat.Level()) << "_ms double " << levelDoubleMs
+              << " float " << levelFloatMs << std::endl;
+    std::cout << "precision_check " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    printTreeOptionsUsage(std::cerr);
+    std::cerr << "  --output FILE    write segments as text ('-' for stdout)" << std::endl;
+    std::cerr << "                   x1 y1 z1 x2 y2 z2 r g b width" << std::endl;
+    std::cerr << "  --export FILE    stream the tree to FILE in fixed memory: binary PLY" << std::endl;
+    std::cerr << "                   (.ply), OBJ lines (.obj) or raw records (other)" << std::endl;
+    std::cerr << "  --cache FILE     map the tree cache FILE, writing it first if it is" << std::endl;
+    std::cerr << "                   missing or was made for other parameters" << std::endl;
+    std::cerr << "  --threads N      generate on N worker threads (0 = all cores)" << std::endl;
+    std::cerr << "  --scaling        print a 1..N thread scaling report for depths 8-12" << std::endl;
+    std::cerr << "  --instanced      build the per-depth IFS representation; segments are" << std::endl;
+    std::cerr << "                   only expanded when --output is given" << std::endl;
+    std::cerr << "  --topology       build the flat topology once, then time the linear" << std::endl;
+    std::cerr << "                   geometry pass used per frame by the viewer" << std::endl;
+    std::cerr << "  --simd LEVEL     level-order generator with vector kernels" << std::endl;
+    std::cerr << "                   (scalar, sse2, avx2 or auto)" << std::endl;
+    std::cerr << "  --simd-bench     branches/s of the generators at depths 8-12" << std::endl;
+    std::cerr << "  --specialized    recursion compiled for the branch count and depth" << std::endl;
+    std::cerr << "                   (double; see SpecializedGenerator.h)" << std::endl;
+    std::cerr << "  --seed N         stochastic tree: jittered angles and lengths, some" << std::endl;
+    std::cerr << "                   branches left out; the same for any --threads" << std::endl;
+    std::cerr << "  --variation A T L S  jitter amounts for --seed: branch angle and turn" << std::endl;
+    std::cerr << "                   (degrees), length (fraction), skip chance (default" << std::endl;
+    std::cerr << "                   8 15 0.2 0.1)" << std::endl;
+    std::cerr << "  --precision P    float (default) or double arithmetic for the recursive" << std::endl;
+    std::cerr << "                   and --simd generators; the others always use double" << std::endl;
+    std::cerr << "  --precision-check  compare the float tree with the double reference" << std::endl;
+    std::cerr << "  --compact        also store the segments quantized, as the viewer does," << std::endl;
+    std::cerr << "                   and report memory, precision and indexed geometry size" << std::endl;
+    std::cerr << "  --lod PIXELS     cull against the viewer's 800x800 view: skip subtrees" << std::endl;
+    std::cerr << "                   outside it, collapse those smaller than PIXELS" << std::endl;
+    std::cerr << "  --view X Y       view rotation in degrees for --lod and --pick (default 20 0)" << std::endl;
+    std::cerr << "  --pick X Y       index the tree in a BVH and report the branch under" << std::endl;
+    std::cerr << "                   pixel X Y of the view, with build and refit times" << std::endl;
+    std::cerr << "  --within X Y Z R count the branches within R of a point (BVH query)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    int maxDepth = 7;
+    TreeParams params = defaultTreeParams();
+    const char* outputPath = nullptr;
+    const char* exportPath = nullptr;
+    const char* cachePath = nullptr;
+    int threads = 1;
+    bool scaling = false;
+    bool instanced = false;
+    bool topology = false;
+    bool simd = false;
+    bool simdBench = false;
+    bool specialized = false;
+    bool stochastic = false;
+    TreeVariation variation = defaultTreeVariation(0);
+    SimdLevel simdLevel = detectSimdLevel();
+    TreePrecision precision = PRECISION_FLOAT;
+    bool precisionCheck = false;
+    bool compact = false;
+    double lodPixels = 0.0;
+    bool pick = false;
+    double pickPixel[2] = {0.0, 0.0};
+    bool within = false;
+    double sphere[4] = {0.0, 0.0, 0.0, 0.0};
+    ViewParams view = defaultViewParams(800, 800);
+    view.rotationX = 20.0;      // the viewer's tilt
+
+    for (int i = 1; i < argc; i++) {
+        if (parseTreeOption(argc, argv, i, params, maxDepth)) {
+            continue;
+        } else if (strcmp(argv[i], "--output") == 0) {
+            outputPath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--export") == 0) {
+            exportPath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            cachePath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = nextIntArg(argc, argv, i);
+            if (threads <= 0) threads = WorkStealingPool::HardwareThreads();
+        } else if (strcmp(argv[i], "--scaling") == 0) {
+            scaling = true;
+        } else if (strcmp(argv[i], "--instanced") == 0) {
+            instanced = true;
+        } else if (strcmp(argv[i], "--topology") == 0) {
+            topology = true;
+        } else if (strcmp(argv[i], "--simd") == 0) {
+            const char* name = nextArg(argc, argv, i);
+            if (strcmp(name, "auto") != 0 && !parseSimdLevel(name, simdLevel)) {
+                std::cerr << "Unknown SIMD level: " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+            simd = true;
+        } else if (strcmp(argv[i], "--simd-bench") == 0) {
+            simdBench = true;
+        } else if (strcmp(argv[i], "--specialized") == 0) {
+            specialized = true;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            variation.seed = (uint32_t)nextIntArg(argc, argv, i);
+            stochastic = true;
+        } else if (strcmp(argv[i], "--variation") == 0) {
+            variation.angleJitter = nextDoubleArg(argc, argv, i);
+            variation.turnJitter = nextDoubleArg(argc, argv, i);
+            variation.lengthJitter = nextDoubleArg(argc, argv, i);
+            variation.skipChance = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--precision") == 0) {
+            const char* name = nextArg(argc, argv, i);
+            if (!parseTreePrecision(name, precision)) {
+                std::cerr << "Unknown precision: " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--precision-check") == 0) {
+            precisionCheck = true;
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            compact = true;
+        } else if (strcmp(argv[i], "--lod") == 0) {
+            lodPixels = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--view") == 0) {
+            view.rotationX = nextDoubleArg(argc, argv, i);
+            view.rotationY = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--pick") == 0) {
+            pick = true;
+            pickPixel[0] = nextDoubleArg(argc, argv, i);
+            pickPixel[1] = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--within") == 0) {
+            within = true;
+            for (int k = 0; k < 4; k++) {
+                sphere[k] = nextDoubleArg(argc, argv, i);
+            }
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return EXIT_SUCCESS;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (stochastic && (simd || topology || instanced || specialized || lodPixels > 0.0)) {
+        std::cerr << "--seed generates with the recursive or --threads generator only" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (simd && (threads > 1 || topology || instanced || specialized || lodPixels > 0.0)) {
+        std::cerr << "--simd cannot be combined with --threads, --topology, --instanced,"
+                  << " --specialized or --lod" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (scaling) {
+        printScalingReport(params, stochastic ? &variation : nullptr,
+                           threads > 1 ? threads : WorkStealingPool::HardwareThreads());
+        return EXIT_SUCCESS;
+    }
+
+    if (exportPath) {
+        return exportTree(params, maxDepth, exportPath);
+    }
+
+    if (cachePath) {
+        return cacheTree(params, maxDepth, cachePath);
+    }
+
+    if (pick || within) {
+        return queryTree(params, maxDepth, view, threads,
+                         pick ? pickPixel : nullptr, within ? sphere : nullptr);
+    }
+
+    if (precisionCheck) {
+        return checkPrecision(params, maxDepth);
+    }
+
+    if (simdBench) {
+        std::cout << "cpu supports " << simdLevelName(detectSimdLevel()) << std::endl;
+        printSimdBenchmark(params);
+        return EXIT_SUCCESS;
+    }
+
+    FILE* out = nullptr;
+    if (outputPath) {
+        out = strcmp(outputPath, "-") == 0 ? stdout : fopen(outputPath, "w");
+        if (!out) {
+            std::cerr << "Cannot open " << outputPath << " for writing" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Segments are streamed, never stored (except by --compact)
+    CompactSegmentStore store;
+    size_t reserved = 0;
+    double maxError = 0.0;
+    if (compact) {
+        reserved = treeSegmentCount(params, maxDepth);
+        store.Reserve(reserved);
+    }
+
+    StatsSink stats;
+    CallbackSink sink([&](const Segment3D& s) {
+        stats.AddSegment(s);
+        if (compact) {
+            store.AddSegment(s);
+            float p[6];
+            store.Decode(store.Segments().back(), p);
+            const double exact[6] = {s.x1, s.y1, s.z1, s.x2, s.y2, s.z2};
+            for (int k = 0; k < 6; k++) {
+                double error = fabs(p[k] - exact[k]);
+                if (error > maxError) maxError = error;
+            }
+        }
+        if (out) {
+            fprintf(out, "%.6f %.6f %.6f %.6f %.6f %.6f %.4f %.4f %.4f %d\n",
+                    s.x1, s.y1, s.z1, s.x2, s.y2, s.z2, s.r, s.g, s.b, s.width);
+        }
+    });
+
+    std::unique_ptr<ParallelTreeGenerator> parallel;
+    if (threads > 1) {
+        parallel.reset(new ParallelTreeGenerator(threads));
+    }
+
+    InstancedTree instancedTree;
+    double expandMs = 0.0;
+    TreeTopology treeTopology;
+    std::vector<Segment3D> segments;
+    double topologyMs = 0.0;
+    if (topology) {
+        auto buildStart = std::chrono::steady_clock::now();
+        treeTopology.Update(params, maxDepth);
+        topologyMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - buildStart).count();
+    }
+
+    // The other generators are double only; the level-order generator
+    // is built after this so it runs at the precision reported
+    if (topology || instanced || lodPixels > 0.0 || parallel || specialized || stochastic) {
+        precision = PRECISION_DOUBLE;
+    }
+    LevelOrderGenerator levelOrder(simdLevel, precision);
+
+    auto start = std::chrono::steady_clock::now();
+    if (simd) {
+        levelOrder.Generate(params, maxDepth, sink);
+    } else if (topology) {
+        treeTopology.Evaluate(params, segments);
+    } else if (instanced) {
+        instancedTree.Build(params, maxDepth);
+    } else if (lodPixels > 0.0) {
+        generateTree(params, maxDepth, ViewCuller(view, lodPixels), sink);
+    } else if (stochastic && parallel) {
+        parallel->Generate(params, variation, maxDepth, sink);
+    } else if (stochastic) {
+        generateStochasticTree(params, variation, maxDepth, sink);
+    } else if (parallel) {
+        parallel->Generate(params, maxDepth, sink);
+    } else if (specialized) {
+        generateTreeSpecialized(params, maxDepth, sink);
+    } else {
+        generateTree(params, maxDepth, sink, precision);
+    }
+    double elapsedMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    if (topology) {
+        sink.AddSegments(segments.data(), segments.size());
+    }
+
+    if (instanced && out) {
+        auto expandStart = std::chrono::steady_clock::now();
+        instancedTree.Expand(sink);
+        expandMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - expandStart).count();
+    }
+
+    if (out && out != stdout) {
+        fclose(out);
+    }
+
+    // Keep stdout clean when it carries the segment dump
+    std::ostream& report = (out == stdout) ? std::cerr : std::cout;
+    report << "depth " << maxDepth
+           << " lambda " << params.lambda
+           << " angle " << params.angle
+           << " factor " << params.factor
+           << " branches " << params.numBranches
+           << " threads " << threads
+           << " precision " << treePrecisionName(precision) << std::endl;
+    if (instanced) {
+        report << "transforms " << instancedTree.TransformCount()
+               << " (" << instancedTree.TransformCount() * sizeof(Transform3D) << " bytes)" << std::endl;
+        report << "segments " << instancedTree.SegmentCount() << std::endl;
+        if (out) {
+            report << "expand_ms " << expandMs << std::endl;
+        }
+    } else {
+        report << "segments " << stats.count << std::endl;
+    }
+    if (compact) {
+        report << "compact_bytes " << store.ByteSize() << " ("
+               << (double)store.ByteSize() / (store.Size() ? store.Size() : 1) << " per segment, "
+               << sizeof(Segment3D) << " unpacked)" << std::endl;
+        report << "compact_styles " << store.Styles().size()
+               << " step " << store.Step() << " max_error " << maxError << std::endl;
+        report << "reserved " << reserved << " capacity " << store.Capacity() << std::endl;
+
+        // GPU-side size of the viewer's two batched draw paths
+        IndexedLineBatch indexed;
+        IndexedLineBuilder().Build(store, indexed);
+        size_t batchBytes = store.Size() * 2 * LineBatch::FLOATS_PER_VERTEX * sizeof(float);
+        report << "batch_bytes " << batchBytes << " (" << store.Size() * 2 << " vertices)" << std::endl;
+        report << "indexed_bytes " << indexed.ByteSize() << " (" << indexed.VertexCount()
+               << " vertices, " << indexed.indices.size() << " indices)" << std::endl;
+    }
+    if (lodPixels > 0.0) {
+        report << "lod " << lodPixels << " px view " << view.rotationX << " " << view.rotationY
+               << std::endl;
+    }
+    if (simd) {
+        report << "simd " << simdLevelName(levelOrder.Level()) << std::endl;
+    }
+    if (stochastic) {
+        report << "seed " << variation.seed << " variation " << variation.angleJitter << " "
+               << variation.turnJitter << " " << variation.lengthJitter << " "
+               << variation.skipChance << std::endl;
+    }
+    if (topology) {
+        report << "topology_ms " << topologyMs << std::endl;
+    }
+    if (stats.count > 0) {
+        report << "bounds " << stats.minX << " " << stats.minY << " " << stats.minZ
+               << " .. " << stats.maxX << " " << stats.maxY << " " << stats.maxZ << std::endl;
+    }
+    report << "time_ms " << elapsedMs << std::endl;
+
+    return EXIT_SUCCESS;
+}
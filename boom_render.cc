@@ -0,0 +1,255 @@
+/*========================================================================
+ * File: boom_render.cc
+ * Purpose: headless frame renderer (software Canvas backend, no GPU)
+ *======================================================================*/
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include "Canvas.h"
+#include "CanvasSink.h"
+#include "CommandLine.h"
+#include "Forest.h"
+#include "Profiler.h"
+#include "StochasticTree.h"
+#include "TreeCache.h"
+#include "TreeGenerator.h"
+#include "View.h"
+
+static void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " --output FILE [options]" << std::endl;
+    printTreeOptionsUsage(std::cerr);
+    std::cerr << "  --output FILE    frame to write (.png, anything else is PPM)" << std::endl;
+    std::cerr << "  --size W H       frame size in pixels (default 800 800)" << std::endl;
+    std::cerr << "  --view X Y       view rotation in degrees (default 20 0)" << std::endl;
+    std::cerr << "  --lod PIXELS     cull the tree against the view (see boom-gen)" << std::endl;
+    std::cerr << "  --cache FILE     draw the tree from a cache file, writing it if" << std::endl;
+    std::cerr << "                   missing or stale" << std::endl;
+    std::cerr << "  --precision P    generator arithmetic, float (default) or double" << std::endl;
+    std::cerr << "  --frames N       generate and render the frame N times (default 1)" << std::endl;
+    std::cerr << "  --profile FILE   per-frame stage times and counters (.json or CSV)" << std::endl;
+    std::cerr << "  --forest N       N varied trees of depth --depth-2 to --depth, as in" << std::endl;
+    std::cerr << "                   the viewer; frames are 1/60 s apart" << std::endl;
+    std::cerr << "  --mesh SIDES     draw tapered solid branches: 0 for quads facing the" << std::endl;
+    std::cerr << "                   eye, 3 or more for prisms with that many sides" << std::endl;
+    std::cerr << "  --seed N         stochastic tree with the default variation (see boom-gen)" << std::endl;
+}
+
+// FNV-1a over the frame, for regression checks
+static unsigned long long hashFrame(const uint8_t* pixels, size_t size)
+{
+    unsigned long long hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ pixels[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int main(int argc, char** argv)
+{
+    int maxDepth = 7;
+    TreeParams params = defaultTreeParams();
+    const char* outputPath = nullptr;
+    int frameWidth = 800;
+    int frameHeight = 800;
+    double viewX = 20.0;        // the viewer's tilt
+    double viewY = 0.0;
+    double lodPixels = 0.0;
+    const char* cachePath = nullptr;
+    int frameCount = 1;
+    const char* profilePath = nullptr;
+    int forestCount = 0;
+    TreePrecision precision = PRECISION_FLOAT;
+    int meshSides = -1;         // lines
+    bool stochastic = false;
+    TreeVariation variation = defaultTreeVariation(0);
+
+    for (int i = 1; i < argc; i++) {
+        if (parseTreeOption(argc, argv, i, params, maxDepth)) {
+            continue;
+        } else if (strcmp(argv[i], "--output") == 0) {
+            outputPath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--size") == 0) {
+            frameWidth = nextIntArg(argc, argv, i);
+            frameHeight = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--view") == 0) {
+            viewX = nextDoubleArg(argc, argv, i);
+            viewY = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--lod") == 0) {
+            lodPixels = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            cachePath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--precision") == 0) {
+            const char* name = nextArg(argc, argv, i);
+            if (!parseTreePrecision(name, precision)) {
+                std::cerr << "Unknown precision: " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--frames") == 0) {
+            frameCount = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profilePath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--forest") == 0) {
+            forestCount = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--mesh") == 0) {
+            meshSides = std::max(nextIntArg(argc, argv, i), 0);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            variation.seed = (uint32_t)nextIntArg(argc, argv, i);
+            stochastic = true;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return EXIT_SUCCESS;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!outputPath || frameWidth <= 0 || frameHeight <= 0 || frameCount <= 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (cachePath && lodPixels > 0.0) {
+        std::cerr << "--cache stores the whole tree and cannot be combined with --lod" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (forestCount > 0 && (cachePath || lodPixels > 0.0)) {
+        std::cerr << "--forest cannot be combined with --cache or --lod" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (stochastic && (forestCount > 0 || cachePath || lodPixels > 0.0)) {
+        std::cerr << "--seed cannot be combined with --forest, --cache or --lod" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Canvas canvas(frameWidth, frameHeight, Canvas::SOFTWARE);
+    canvas.SetRotation(viewX, viewY);
+    if (meshSides >= 0) {
+        canvas.SetRenderPath(Canvas::MESH);
+        canvas.SetMeshSides(meshSides);
+    }
+
+    std::unique_ptr<FrameProfiler> profiler;
+    if (profilePath) {
+        profiler.reset(new FrameProfiler());
+        canvas.SetProfiler(profiler.get());
+    }
+
+    // Same path as the viewer: generate into the canvas (or map the
+    // cache), then show
+    double generateMs = 0.0;
+    double renderMs = 0.0;
+    MappedTreeCache cache;
+
+    // Forest shapes are generated once, then baked per frame on all
+    // cores like the rasterizer
+    Forest forest(WorkStealingPool::HardwareThreads());
+    LineBatch forestLines;
+    double forestBuildMs = 0.0;
+    if (forestCount > 0) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<ForestTree> trees;
+        scatterForest(forestCount, params, std::max(1, maxDepth - 2), maxDepth, 120.0, 1, trees);
+        for (const auto& tree : trees) {
+            forest.Add(tree);
+        }
+        std::string error;
+        if (!forest.Build(error)) {
+            std::cerr << "Cannot build the forest: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        forestBuildMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    for (int frame = 0; frame < frameCount; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        RecursionCounter recursion;
+        if (forestCount > 0) {
+            forest.Bake(frame / 60.0, forestLines);
+            canvas.SwapLineBatch(forestLines);
+        } else if (cachePath) {
+            if (!cache.IsOpen() && !cache.OpenOrWrite(cachePath, params, maxDepth)) {
+                std::cerr << "Cannot use cache " << cachePath << ": " << cache.Error() << std::endl;
+                return EXIT_FAILURE;
+            }
+            canvas.SetStaticLines(cache.Lines());
+        } else {
+            canvas.ClearLines();
+            canvas.ReserveLines3D(treeSegmentCount(params, maxDepth));
+            CanvasSink sink(canvas);
+            if (lodPixels > 0.0) {
+                generateTree(params, maxDepth, ViewCuller(canvas.GetView(), lodPixels), sink);
+            } else if (stochastic) {
+                generateStochasticTree(params, variation, maxDepth, sink);
+            } else {
+                generateTree(params, maxDepth, sink, precision);
+            }
+        }
+        auto generated = std::chrono::steady_clock::now();
+        canvas.Show();
+        auto rendered = std::chrono::steady_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(generated - start).count();
+        generateMs += ms;
+        renderMs += std::chrono::duration<double, std::milli>(rendered - generated).count();
+        if (profiler) {
+            profiler->AddTime(PROFILE_GENERATE, ms);
+            profiler->AddCount(PROFILE_SEGMENTS, forestCount > 0 ? forest.SegmentCount()
+                                               : cachePath ? cache.SegmentCount()
+                                                           : canvas.Lines3DCount());
+            profiler->AddCount(PROFILE_RECURSION_CALLS, recursion.Calls());
+            profiler->EndFrame();
+        }
+    }
+
+    if (!canvas.SaveFrame(outputPath)) {
+        std::cerr << "Cannot write " << outputPath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "depth " << maxDepth
+              << " lambda " << params.lambda
+              << " angle " << params.angle
+              << " factor " << params.factor
+              << " branches " << params.numBranches << std::endl;
+    std::cout << "frame " << frameWidth << "x" << frameHeight
+              << " view " << viewX << " " << viewY << std::endl;
+    if (forestCount > 0) {
+        std::cout << "forest " << forest.TreeCount() << " trees " << forest.ShapeCount()
+                  << " shapes build_ms " << forestBuildMs << std::endl;
+        std::cout << "segments " << forest.SegmentCount() << std::endl;
+    } else if (cachePath) {
+        std::cout << "segments " << cache.SegmentCount() << std::endl;
+    } else if (stochastic || lodPixels > 0.0) {
+        if (stochastic) std::cout << "seed " << variation.seed << std::endl;
+        std::cout << "segments " << canvas.Lines3DCount() << std::endl;
+    } else {
+        std::cout << "segments " << treeSegmentCount(params, maxDepth) << std::endl;
+    }
+    if (meshSides >= 0) {
+        std::cout << "mesh " << meshSides << " sides " << canvas.MeshTriangleCount()
+                  << " triangles" << std::endl;
+    }
+    if (cachePath) {
+        std::cout << "cache " << (cache.WasWritten() ? "written" : "hit");
+        if (cache.WasWritten()) std::cout << " (" << cache.MissReason() << ")";
+        std::cout << " " << cache.FileSize() << " bytes" << std::endl;
+    }
+    std::cout << "frame_hash " << std::hex
+              << hashFrame(canvas.FramePixels(), (size_t)frameWidth * frameHeight * 4)
+              << std::dec << std::endl;
+    std::cout << "generate_ms " << generateMs / frameCount << std::endl;
+    std::cout << "render_ms " << renderMs / frameCount << std::endl;
+    if (profiler) {
+        profiler->PrintSummary(std::cout);
+        if (!profiler->Write(profilePath)) {
+            std::cerr << "Cannot write " << profilePath << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
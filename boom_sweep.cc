@@ -0,0 +1,160 @@
+/*========================================================================
+ * File: boom_sweep.cc
+ * Purpose: renders every combination of parameter ranges into a contact
+ *          sheet with a CSV index, on all cores
+ *======================================================================*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "CommandLine.h"
+#include "ImageWriter.h"
+#include "ParameterSweep.h"
+
+static void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "  --lambda A B N   N values from A to B (default: the viewer's, once)" << std::endl;
+    std::cerr << "  --angle A B N" << std::endl;
+    std::cerr << "  --factor A B N" << std::endl;
+    std::cerr << "  --branches A B   every branch count from A to B" << std::endl;
+    std::cerr << "  --depth A B      every depth from A to B (default 7 7)" << std::endl;
+    std::cerr << "  --sheet FILE     contact sheet (.png, anything else is PPM)" << std::endl;
+    std::cerr << "  --index FILE     CSV index of the sheet (default: standard output)" << std::endl;
+    std::cerr << "  --images DIR     also write every thumbnail as DIR/tree_<index>.png" << std::endl;
+    std::cerr << "  --thumb SIZE     thumbnail size in pixels (default 160; 0 for" << std::endl;
+    std::cerr << "                   statistics only)" << std::endl;
+    std::cerr << "  --columns N      thumbnails per sheet row (default: about square)" << std::endl;
+    std::cerr << "  --view X Y       view rotation in degrees (default 20 0)" << std::endl;
+    std::cerr << "  --threads N      worker threads (default: all cores)" << std::endl;
+}
+
+static SweepRange nextRangeArg(int argc, char** argv, int& i)
+{
+    SweepRange range;
+    range.first = nextDoubleArg(argc, argv, i);
+    range.last = nextDoubleArg(argc, argv, i);
+    range.steps = nextIntArg(argc, argv, i);
+    return range;
+}
+
+// Every integer from A to B
+static SweepRange nextIntRangeArg(int argc, char** argv, int& i)
+{
+    SweepRange range;
+    int first = nextIntArg(argc, argv, i);
+    int last = nextIntArg(argc, argv, i);
+    range.first = first;
+    range.last = last;
+    range.steps = abs(last - first) + 1;
+    return range;
+}
+
+static void writeIndex(FILE* out, const ParameterSweep& sweep,
+                       const std::vector<SweepResult>& results)
+{
+    fprintf(out, "index,row,column,depth,branches,lambda,angle,factor,segments,"
+                 "min_x,min_y,min_z,max_x,max_y,max_z,generate_ms,render_ms,image\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const SweepResult& r = results[i];
+        fprintf(out, "%zu,%zu,%zu,%d,%d,%g,%g,%g,%zu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f,%.4f,%s\n",
+                i, i / sweep.Columns(), i % sweep.Columns(), r.maxDepth, r.params.numBranches,
+                r.params.lambda, r.params.angle, r.params.factor, r.segments,
+                r.lo[0], r.lo[1], r.lo[2], r.hi[0], r.hi[1], r.hi[2],
+                r.generateMs, r.renderMs, sweep.ImagePath(i).c_str());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SweepSpec spec = defaultSweepSpec();
+    const char* sheetPath = nullptr;
+    const char* indexPath = nullptr;
+    const char* imageDirectory = nullptr;
+    int thumbnailSize = 160;
+    int columns = 0;
+    double viewX = 20.0;
+    double viewY = 0.0;
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--lambda") == 0) {
+            spec.lambda = nextRangeArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--angle") == 0) {
+            spec.angle = nextRangeArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--factor") == 0) {
+            spec.factor = nextRangeArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--branches") == 0) {
+            spec.branches = nextIntRangeArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--depth") == 0) {
+            spec.depth = nextIntRangeArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--sheet") == 0) {
+            sheetPath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--index") == 0) {
+            indexPath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--images") == 0) {
+            imageDirectory = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--thumb") == 0) {
+            thumbnailSize = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--columns") == 0) {
+            columns = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--view") == 0) {
+            viewX = nextDoubleArg(argc, argv, i);
+            viewY = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return EXIT_SUCCESS;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (spec.branches.first < 1 || spec.branches.last < 1
+        || spec.depth.first < 0 || spec.depth.last < 0) {
+        std::cerr << "Branch counts must be positive and depths not negative" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if ((sheetPath || imageDirectory) && thumbnailSize <= 0) {
+        std::cerr << "--sheet and --images need a thumbnail size" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ParameterSweep sweep(threads);
+    sweep.SetThumbnail(thumbnailSize, viewX, viewY);
+    sweep.SetColumns(columns);
+    if (imageDirectory) sweep.SetImageDirectory(imageDirectory);
+
+    std::vector<SweepResult> results;
+    auto start = std::chrono::steady_clock::now();
+    if (!sweep.Run(spec, results)) {
+        std::cerr << "Cannot write the thumbnails to " << imageDirectory << std::endl;
+        return EXIT_FAILURE;
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    if (sheetPath && !writeImage(sheetPath, sweep.SheetWidth(), sweep.SheetHeight(),
+                                 sweep.Sheet().data())) {
+        std::cerr << "Cannot write " << sheetPath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    FILE* index = indexPath ? fopen(indexPath, "w") : stdout;
+    if (!index) {
+        std::cerr << "Cannot write " << indexPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    writeIndex(index, sweep, results);
+    if (indexPath) fclose(index);
+
+    size_t segments = 0;
+    for (const auto& r : results) segments += r.segments;
+    std::cerr << results.size() << " trees, " << segments << " segments in " << ms
+              << " ms on " << sweep.ThreadCount() << " threads" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -1,195 +1,500 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <atomic>
 #include <chrono>
 #include <thread>
+#include <memory>
 #include <vector>
+#include "BranchBVH.h"
 #include "Canvas.h"
+#include "CommandLine.h"
+#include "CompactSegments.h"
+#include "Forest.h"
+#include "FrameScheduler.h"
+#include "InstancedTree.h"
+#include "ParallelGenerator.h"
+#include "Profiler.h"
+#include "ShapeCache.h"
+#include "SpecializedGenerator.h"
+#include "StochasticTree.h"
+#include "TreeAnimation.h"
+#include "TreeCache.h"
+#include "TreeGenerator.h"
+#include "TreeTopology.h"
+#include "TripleBuffer.h"
+#include "View.h"
 
-Canvas canvas(800, 800); // global window creation
+const int WINDOW_SIZE = 800;
+const double VIEW_TILT = 20.0;
 
-// Animation parameters
-struct TreeParams {
-    double lambda;      // length reduction factor
-    double angle;           // branch angle from trunk
-    double factor;          // branch position along trunk
-    double rotationSpeed;   // rotation speed
-    int numBranches;        // number of branches per node
-};
+// Forest mode scatters its trees over a disc of this radius
+const double FOREST_RADIUS = 120.0;
+
+// Generation strategies selectable from the command line
+enum GeneratorMode {TOPOLOGY, RECURSIVE, PARALLEL, INSTANCED};
+
+const char* generatorModeName(GeneratorMode mode)
+{
+    switch (mode) {
+        case TOPOLOGY:  return "cached topology";
+        case RECURSIVE: return "recursive";
+        case PARALLEL:  return "parallel";
+        case INSTANCED: return "instanced";
+    }
+    return "?";
+}
+
+const char* renderPathName(Canvas::RenderPath path)
+{
+    switch (path) {
+        case Canvas::IMMEDIATE: return "immediate";
+        case Canvas::BATCHED:   return "batched";
+        case Canvas::INDEXED:   return "indexed";
+        case Canvas::MESH:      return "mesh";
+    }
+    return "?";
+}
+
+// State kept across frames by the generation strategies
+struct TreeBuilder {
+    GeneratorMode mode;
+    TreeTopology topology;
+    std::vector<Segment3D> segments;
+    std::unique_ptr<ParallelTreeGenerator> parallel;
+    InstancedTree instancedTree;
+    std::vector<Transform3D> instances;
+    double lodPixels;           // > 0 culls the recursion against the view
+    // Set: frames come from cached grid-point trees, generated by mode
+    std::unique_ptr<ShapeCache> shapeCache;
+    // Set: jittered trees from variation, by the recursive or parallel mode
+    bool stochastic;
+    TreeVariation variation;
 
-// Color structure
-struct Color {
-    float r, g, b;
-    Color(float r_, float g_, float b_) : r(r_), g(g_), b(b_) {}
+    TreeBuilder()
+        : mode(TOPOLOGY), lodPixels(0.0), stochastic(false), variation(defaultTreeVariation(0)) {}
 };
 
-// 3D vector helper
-struct Vec3 {
-    double x, y, z;
-    Vec3(double x_, double y_, double z_) : x(x_), y(y_), z(z_) {}
+// Everything one frame draws. Frames are built away from the Canvas so
+// that a generator thread can fill one while the previous one is drawn;
+// the stores keep their capacity from frame to frame.
+struct TreeFrame {
+    CompactSegmentStore lines;
+    CompactSegmentStore instanceLines;
+    std::vector<double> instanceMatrices;
+    TreeParams params;
+    double rotation;
+    int depth;
+
+    // Generation cost, reported when the frame is shown
+    double generateMs;
+    uint64_t segmentsDrawn;
+    uint64_t recursionCalls;
+
+    // Shape cache lookups of this frame, and the cache after it
+    uint64_t shapeCacheHits;
+    uint64_t shapeCacheMisses;
+    uint64_t shapeCacheFallbacks;
+    size_t shapeCacheTrees;
+    size_t shapeCacheBytes;
+
+    TreeFrame()
+        : rotation(0.0), depth(0), generateMs(0.0), segmentsDrawn(0), recursionCalls(0),
+          shapeCacheHits(0), shapeCacheMisses(0), shapeCacheFallbacks(0), shapeCacheTrees(0), shapeCacheBytes(0) {}
 };
 
-// Normalize vector
-Vec3 normalize(const Vec3& v) {
-    double len = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
-    if (len < 0.0001) return Vec3(0, 1, 0);
-    return Vec3(v.x / len, v.y / len, v.z / len);
-}
+// Instanced variant: the levels near the trunk are expanded into regular
+// lines, everything below the cut is one shared subtree drawn per instance
+void addInstancedTree(TreeFrame& frame, TreeBuilder& builder,
+                      int maxDepth, const TreeParams& params)
+{
+    const size_t maxInstances = 4096;
+    InstancedTree& tree = builder.instancedTree;
 
-// Interpolate between two colors
-Color lerpColor(const Color& c1, const Color& c2, float t) {
-    return Color(
-        c1.r + (c2.r - c1.r) * t,
-        c1.g + (c2.g - c1.g) * t,
-        c1.b + (c2.b - c1.b) * t
-    );
-}
+    tree.Build(params, maxDepth);
+    int cutDepth = tree.ChooseInstanceDepth(maxInstances);
 
-// Get color based on depth (brown to green gradient)
-Color getColorForDepth(int currentDepth, int maxDepth) {
-    // Brown for trunk (deeper levels)
-    Color brown(0.55f, 0.27f, 0.07f);
-    // Green for tips (shallow levels)
-    Color green(0.13f, 0.55f, 0.13f);
-    
-    // Calculate interpolation factor (0 = trunk, 1 = tips)
-    float t = 1.0f - (float)currentDepth / (float)maxDepth;
-    
-    return lerpColor(brown, green, t);
+    tree.ExpandAbove(cutDepth, frame.lines);
+    tree.ExpandCanonical(cutDepth, frame.instanceLines);
+
+    tree.CollectInstances(cutDepth, builder.instances);
+    double matrix[16];
+    for (const auto& instance : builder.instances) {
+        instance.ToMatrix(matrix);
+        frame.instanceMatrices.insert(frame.instanceMatrices.end(), matrix, matrix + 16);
+    }
 }
 
-// Calculate number of branches based on depth (more at bottom, fewer at top)
-int getBranchCountForDepth(int currentDepth, int maxDepth, int maxBranches) {
-    // At trunk (maxDepth): use maxBranches
-    // At tips (depth 1): use 2 or 3 branches
-    int minBranches = 2;
-    
-    // Linear interpolation based on depth
-    float t = (float)currentDepth / (float)maxDepth;
-    int branches = minBranches + (int)((maxBranches - minBranches) * t);
-    
-    // Ensure at least minBranches
-    if (branches < minBranches) branches = minBranches;
-    
-    return branches;
+// Fills a store with the whole tree the way the builder's mode does;
+// the view-culled and instanced variants are handled by buildFrame
+void generateWithMode(TreeBuilder& builder, int maxDepth, const TreeParams& params,
+                      CompactSegmentStore& lines)
+{
+    switch (builder.mode) {
+        case TOPOLOGY:
+            // Hierarchy is rebuilt only when the branch count changes
+            builder.topology.Update(params, maxDepth);
+            builder.topology.Evaluate(params, builder.segments);
+            lines.AddSegments(builder.segments.data(), builder.segments.size());
+            break;
+        case PARALLEL:
+            if (builder.stochastic) {
+                builder.parallel->Generate(params, builder.variation, maxDepth, lines);
+            } else {
+                builder.parallel->Generate(params, maxDepth, lines);
+            }
+            break;
+        default:
+            if (builder.stochastic) {
+                generateStochasticTree(params, builder.variation, maxDepth, lines);
+                break;
+            }
+            // Same output as generateTree, from the kernel compiled for
+            // this branch count and depth
+            generateTreeSpecialized(params, maxDepth, lines);
+            break;
+    }
 }
 
-// Draw a branch in 3D with color
-void drawBranch(double x1, double y1, double z1, 
-                double x2, double y2, double z2, 
-                double length, const Color& color)
+void buildFrame(TreeFrame& frame, TreeBuilder& builder,
+                int maxDepth, const TreeParams& params, double rotation)
 {
-    canvas.SetLineWidth(int(0.03 * length + 1));
-    canvas.SetColorRGB(color.r, color.g, color.b);
-    canvas.Line3D(x1, y1, z1, x2, y2, z2);
+    auto start = std::chrono::steady_clock::now();
+    RecursionCounter recursion;
+    frame.lines.Clear();
+    frame.instanceLines.Clear();
+    frame.instanceMatrices.clear();
+    frame.params = params;
+    frame.rotation = rotation;
+    frame.depth = maxDepth;
+
+    // Exact count for the full tree, an upper bound when view culled
+    if (builder.mode != INSTANCED) {
+        frame.lines.Reserve(treeSegmentCount(params, maxDepth));
+    }
+
+    if (builder.shapeCache) {
+        ShapeCache& cache = *builder.shapeCache;
+        uint64_t hits = cache.Hits(), misses = cache.Misses(), fallbacks = cache.Fallbacks();
+        cache.Get(params, maxDepth, frame.lines);
+        frame.shapeCacheHits = cache.Hits() - hits;
+        frame.shapeCacheMisses = cache.Misses() - misses;
+        frame.shapeCacheFallbacks = cache.Fallbacks() - fallbacks;
+        frame.shapeCacheTrees = cache.EntryCount();
+        frame.shapeCacheBytes = cache.ByteSize();
+    } else if (builder.mode == INSTANCED) {
+        addInstancedTree(frame, builder, maxDepth, params);
+    } else if (builder.lodPixels > 0.0) {
+        ViewParams view = defaultViewParams(WINDOW_SIZE, WINDOW_SIZE);
+        view.rotationX = VIEW_TILT;
+        view.rotationY = rotation;
+        generateTree(params, maxDepth, ViewCuller(view, builder.lodPixels), frame.lines);
+    } else {
+        generateWithMode(builder, maxDepth, params, frame.lines);
+    }
+    frame.generateMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    frame.segmentsDrawn = frame.lines.Size()
+                        + frame.instanceLines.Size() * (frame.instanceMatrices.size() / 16);
+    frame.recursionCalls = recursion.Calls();
 }
 
-// Recursive 3D tree generation with variable branches and colors
-void generateTree3D(double x, double y, double z,
-                    double dirX, double dirY, double dirZ,
-                    double length, int depth, const TreeParams& params,
-                    int maxDepth)
+// Hands a built frame to the canvas; the frame gets the canvas's
+// previous geometry back, to be cleared and refilled
+void presentFrame(Canvas& canvas, TreeFrame& frame, FrameProfiler* profiler)
 {
-    if (depth <= 0 || length < 0.5) return;
-    
-    // Get color for current depth
-    Color branchColor = getColorForDepth(depth, maxDepth);
-    
-    // Calculate end point of current branch
-    double x2 = x + dirX * length;
-    double y2 = y + dirY * length;
-    double z2 = z + dirZ * length;
-    
-    // Draw current branch with color
-    drawBranch(x, y, z, x2, y2, z2, length, branchColor);
-    
-    // Calculate branch point position along trunk
-    double branchX = x + dirX * length * params.factor;
-    double branchY = y + dirY * length * params.factor;
-    double branchZ = z + dirZ * length * params.factor;
-    
-    // Determine number of branches for this depth level
-    int numBranches = getBranchCountForDepth(depth, maxDepth, params.numBranches);
-    
-    // Create branches around the trunk
-    for (int i = 0; i < numBranches; i++) {
-        double rotAngle = (2.0 * M_PI * i) / numBranches;
-        
-        // Calculate perpendicular vectors for branch direction
-        Vec3 dir(dirX, dirY, dirZ);
-        Vec3 up(0, 1, 0);
-        
-        // If direction is too close to up, use different reference
-        if (fabs(dirY) > 0.99) {
-            up = Vec3(1, 0, 0);
-        }
-        
-        // Create perpendicular vector (cross product)
-        Vec3 perp1(
-            dir.y * up.z - dir.z * up.y,
-            dir.z * up.x - dir.x * up.z,
-            dir.x * up.y - dir.y * up.x
-        );
-        perp1 = normalize(perp1);
-        
-        // Create second perpendicular (cross product of dir and perp1)
-        Vec3 perp2(
-            dir.y * perp1.z - dir.z * perp1.y,
-            dir.z * perp1.x - dir.x * perp1.z,
-            dir.x * perp1.y - dir.y * perp1.x
-        );
-        perp2 = normalize(perp2);
-        
-        // Rotate around the trunk to get branch direction
-        double cosRot = cos(rotAngle);
-        double sinRot = sin(rotAngle);
-        Vec3 radial(
-            perp1.x * cosRot + perp2.x * sinRot,
-            perp1.y * cosRot + perp2.y * sinRot,
-            perp1.z * cosRot + perp2.z * sinRot
-        );
-        
-        // Branch direction: mix of upward (trunk direction) and outward (radial)
-        double branchAngle = params.angle * M_PI / 180.0;
-        Vec3 branchDir(
-            dirX * cos(branchAngle) + radial.x * sin(branchAngle),
-            dirY * cos(branchAngle) + radial.y * sin(branchAngle),
-            dirZ * cos(branchAngle) + radial.z * sin(branchAngle)
-        );
-        branchDir = normalize(branchDir);
-        
-        // Recursively generate sub-branches
-        generateTree3D(branchX, branchY, branchZ,
-                      branchDir.x, branchDir.y, branchDir.z,
-                      length * params.lambda, depth - 1, params, maxDepth);
+    if (profiler) {
+        profiler->AddTime(PROFILE_GENERATE, frame.generateMs);
+        profiler->AddCount(PROFILE_SEGMENTS, frame.segmentsDrawn);
+        profiler->AddCount(PROFILE_RECURSION_CALLS, frame.recursionCalls);
+        profiler->AddCount(PROFILE_SHAPE_CACHE_HITS, frame.shapeCacheHits);
+        profiler->AddCount(PROFILE_SHAPE_CACHE_MISSES, frame.shapeCacheMisses);
     }
+    canvas.SwapLines3D(frame.lines);
+    canvas.SwapInstances(frame.instanceLines, frame.instanceMatrices);
+    canvas.SetRotation(VIEW_TILT, frame.rotation); // Tilt view and rotate
 }
 
-void drawTree(int maxDepth, const TreeParams& params, double rotation)
+// Click inspection of the lines on screen. The BVH is refitted while
+// the segment count stays the same (the animation only moved them) and
+// rebuilt when it changes. Instanced geometry is not indexed.
+class BranchPicker
 {
-    canvas.ClearLines();
-    canvas.SetRotation(20.0, rotation); // Tilt view and rotate
-    
-    // Start tree at origin, growing upward (positive Y)
-    generateTree3D(0.0, -80.0, 0.0,  // start position
-                   0.0, 1.0, 0.0,    // direction (upward)
-                   60.0,              // initial length
-                   maxDepth,          // depth
-                   params,            // parameters
-                   maxDepth);         // max depth
+    public:
+        explicit BranchPicker(WorkStealingPool* pool) : bvh(pool) {}
+
+        void Inspect(const Canvas& canvas, const TreeParams& params, int maxDepth,
+                     double x, double y)
+        {
+            const CompactSegmentStore& lines = canvas.StoredLines3D();
+            ViewParams view = canvas.GetView();
+            double radiusPerWidth = viewUnitsPerPixel(view);
+            if (!bvh.Refit(lines, radiusPerWidth)) {
+                bvh.Build(lines, radiusPerWidth);
+            }
+
+            double origin[3], direction[3];
+            viewRay(view, x, y, origin, direction);
+            BranchHit hit;
+            if (!bvh.Pick(origin, direction, hit)) {
+                std::cout << "No branch at " << x << ", " << y << std::endl;
+                return;
+            }
+
+            const BranchCapsule& c = bvh.Capsule(hit.segment);
+            double length = sqrt((c.b[0] - c.a[0]) * (c.b[0] - c.a[0])
+                               + (c.b[1] - c.a[1]) * (c.b[1] - c.a[1])
+                               + (c.b[2] - c.a[2]) * (c.b[2] - c.a[2]));
+            std::cout << "Branch " << hit.segment << " of " << lines.Size() << ": length " << length;
+            // Lengths shrink by lambda per level from the trunk
+            if (params.lambda > 0.0 && params.lambda < 1.0 && length > 0.0) {
+                int level = (int)lround(log(length / TREE_TRUNK_LENGTH) / log(params.lambda));
+                std::cout << ", level " << level << " of " << maxDepth;
+            }
+            std::cout << ", width " << lines.StyleOf(lines.Segments()[hit.segment]).width
+                      << std::endl;
+
+            const double start[3] = {c.a[0], c.a[1], c.a[2]};
+            std::vector<uint32_t> nearby;
+            bvh.QuerySphere(start, length, nearby);
+            std::cout << "  from (" << c.a[0] << ", " << c.a[1] << ", " << c.a[2] << ") to ("
+                      << c.b[0] << ", " << c.b[1] << ", " << c.b[2] << "), "
+                      << nearby.size() << " branches within its length" << std::endl;
+            std::cout << "  lambda " << params.lambda << " angle " << params.angle
+                      << " factor " << params.factor << " branches " << params.numBranches
+                      << std::endl;
+        }
+
+    private:
+        BranchBVH bvh;
+};
+
+// What the next frame shows: the animation at the current real time,
+// at the depth the frame budget allows. Owned by the thread that
+// generates frames.
+class FramePlanner
+{
+    public:
+        FramePlanner(const TreeParams& base, double budgetMs, int minDepth, int maxDepth)
+            : animation(base), scheduler(budgetMs, minDepth, maxDepth) {}
+
+        TreeParams Next(double& rotation, int& depth)
+        {
+            TreeParams params = animation.Step(clock.Tick(), rotation);
+            scheduler.Update([&params](int d) { return treeSegmentCount(params, d); });
+            depth = scheduler.Depth();
+            return params;
+        }
+
+        // Generation plus drawing of a finished frame, for the budget
+        void Report(const TreeFrame& frame, double costMs)
+        {
+            scheduler.Report(costMs, frame.segmentsDrawn);
+        }
+
+        TreeAnimation animation;
+        FrameClock clock;
+        FrameScheduler scheduler;
+};
+
+// Generator thread of the pipelined loop: builds the next frame while
+// the render loop draws the current one. A finished frame is only
+// published once the render loop has taken the previous one, so no
+// animation step is ever skipped. The pipelined frame costs the longer
+// of generation and the last draw.
+void produceFrames(TripleBuffer<TreeFrame>& frames, TreeBuilder& builder,
+                   FramePlanner& planner, const std::atomic<double>& drawMs,
+                   const std::atomic<bool>& stop)
+{
+    while (!stop.load()) {
+        double rotation;
+        int depth;
+        TreeParams params = planner.Next(rotation, depth);
+        TreeFrame& frame = frames.Back();
+        buildFrame(frame, builder, depth, params, rotation);
+        planner.Report(frame, std::max(frame.generateMs, drawMs.load()));
+
+        while (frames.Pending() && !stop.load()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        frames.Publish();
+    }
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // --immediate selects the old per-segment glBegin/glEnd path and
+    // --indexed the endpoint-sharing one, so the draw paths can be
+    // compared on the same machine; --mesh SIDES draws solid tapered
+    // branches instead of lines
+    Canvas::RenderPath renderPath = Canvas::BATCHED;
+    int meshSides = 0;
+    // --serial generates and draws each frame in turn, for comparison
+    // with the default pipelined loop
+    bool serial = false;
+    TreeBuilder builder;
+    int threads = 1;
+    const char* cachePath = nullptr;
+    const char* profilePath = nullptr;
+    // --budget MS is the frame time the depth adapts to (0 = fixed depth)
+    double budgetMs = NOMINAL_FRAME_SECONDS * 1000.0;
+    int minDepth = 1;
+    // --forest N draws N varied trees instead of one
+    size_t forestCount = 0;
+    // --shape-cache MB reuses trees generated at grid points of the
+    // animated parameters; --shape-nearest snaps instead of blending
+    double shapeCacheMB = 0.0;
+    ShapeCache::Lookup shapeLookup = ShapeCache::INTERPOLATE;
+
     // Default balanced tree parameters
     int maxDepth = 7;
-    TreeParams baseParams;
-    baseParams.lambda = 0.65;       // Length reduction per level
-    baseParams.angle = 35.0;        // Branch angle from trunk (degrees)
-    baseParams.factor = 0.7;        // Where along trunk branches emerge
-    baseParams.rotationSpeed = 0.5; // Initial rotation speed
-    baseParams.numBranches = 5;     // Maximum branches at trunk level
+    TreeParams baseParams = defaultTreeParams();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--immediate") == 0) {
+            renderPath = Canvas::IMMEDIATE;
+        } else if (strcmp(argv[i], "--indexed") == 0) {
+            renderPath = Canvas::INDEXED;
+        } else if (strcmp(argv[i], "--mesh") == 0) {
+            renderPath = Canvas::MESH;
+            meshSides = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--serial") == 0) {
+            serial = true;
+        } else if (strcmp(argv[i], "--recursive") == 0) {
+            builder.mode = RECURSIVE;
+        } else if (strcmp(argv[i], "--instanced") == 0) {
+            builder.mode = INSTANCED;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = nextIntArg(argc, argv, i);
+            if (threads <= 0) threads = WorkStealingPool::HardwareThreads();
+            builder.mode = threads > 1 ? PARALLEL : RECURSIVE;
+        } else if (strcmp(argv[i], "--lod") == 0) {
+            builder.lodPixels = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            cachePath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profilePath = nextArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--budget") == 0) {
+            budgetMs = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--min-depth") == 0) {
+            minDepth = nextIntArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--forest") == 0) {
+            int count = nextIntArg(argc, argv, i);
+            forestCount = count > 0 ? (size_t)count : 0;
+        } else if (strcmp(argv[i], "--shape-cache") == 0) {
+            shapeCacheMB = nextDoubleArg(argc, argv, i);
+        } else if (strcmp(argv[i], "--shape-nearest") == 0) {
+            shapeLookup = ShapeCache::NEAREST;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            builder.variation.seed = (uint32_t)nextIntArg(argc, argv, i);
+            builder.stochastic = true;
+        } else if (!parseTreeOption(argc, argv, i, baseParams, maxDepth)) {
+            std::cerr << "Usage: " << argv[0] << " [--immediate | --indexed | --mesh SIDES] [--serial]"
+                      << " [--recursive | --instanced | --threads N]"
+                      << " [--lod PIXELS] [--cache FILE] [--profile FILE.json|FILE.csv]"
+                      << " [--budget MS] [--min-depth N] [--forest N]"
+                      << " [--shape-cache MB [--shape-nearest]] [--seed N]"
+                      << " [tree options]" << std::endl;
+            printTreeOptionsUsage(std::cerr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // View culling works on the recursion, which can skip whole subtrees
+    if (builder.lodPixels > 0.0) {
+        if (builder.mode == TOPOLOGY) {
+            builder.mode = RECURSIVE;
+        } else if (builder.mode != RECURSIVE) {
+            std::cerr << "--lod needs the recursive generator" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The topology stores the regular tree; jittered trees are recursive
+    if (builder.stochastic) {
+        if (builder.mode == INSTANCED || builder.lodPixels > 0.0 || cachePath || forestCount > 0) {
+            std::cerr << "--seed cannot be combined with --instanced, --lod, --cache or --forest"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (builder.mode == TOPOLOGY) builder.mode = RECURSIVE;
+    }
+
+    if (cachePath && builder.lodPixels > 0.0) {
+        std::cerr << "--cache stores the whole tree and cannot be combined with --lod" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (forestCount > 0 && (cachePath || builder.lodPixels > 0.0)) {
+        std::cerr << "--forest cannot be combined with --cache or --lod" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (shapeCacheMB > 0.0 && (cachePath || forestCount > 0 || builder.lodPixels > 0.0
+                               || builder.mode == INSTANCED)) {
+        std::cerr << "--shape-cache needs whole trees: it cannot be combined with --cache,"
+                  << " --forest, --lod or --instanced" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Canvas canvas(WINDOW_SIZE, WINDOW_SIZE);
+    canvas.SetRenderPath(renderPath);
+    canvas.SetMeshSides(meshSides);
+
+    // Without --profile there is no profiler and nothing is timed
+    std::unique_ptr<FrameProfiler> profiler;
+    if (profilePath) {
+        profiler.reset(new FrameProfiler());
+        canvas.SetProfiler(profiler.get());
+    }
+
+    // A cached tree is static: it is mapped once and only the view
+    // rotation animates
+    MappedTreeCache cache;
+    if (cachePath) {
+        if (!cache.OpenOrWrite(cachePath, baseParams, maxDepth)) {
+            std::cerr << "Cannot use cache " << cachePath << ": " << cache.Error() << std::endl;
+            return EXIT_FAILURE;
+        }
+        canvas.SetStaticLines(cache.Lines());
+    }
+
+    // A forest's shapes are generated once; each frame only bakes the
+    // swaying trees into one batch
+    std::unique_ptr<Forest> forest;
+    LineBatch forestLines;
+    double forestTime = 0.0;
+    if (forestCount > 0) {
+        forest.reset(new Forest(threads));
+        std::vector<ForestTree> trees;
+        scatterForest(forestCount, baseParams, std::max(1, maxDepth - 2), maxDepth,
+                      FOREST_RADIUS, 1, trees);
+        for (const auto& tree : trees) {
+            forest->Add(tree);
+        }
+        std::string error;
+        if (!forest->Build(error)) {
+            std::cerr << "Cannot build the forest: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (builder.mode == PARALLEL) {
+        builder.parallel.reset(new ParallelTreeGenerator(threads));
+    }
+    if (shapeCacheMB > 0.0) {
+        builder.shapeCache.reset(new ShapeCache((size_t)(shapeCacheMB * 1024 * 1024),
+                                                defaultShapeGrid(), shapeLookup));
+        // Misses are generated on the frame's thread, by the chosen mode
+        TreeBuilder* modeBuilder = &builder;
+        builder.shapeCache->SetGenerator(
+            [modeBuilder](const TreeParams& params, int depth, CompactSegmentStore& out) {
+                generateWithMode(*modeBuilder, depth, params, out);
+            });
+    }
     
     std::cout << "=== Living 3D Recursive Tree ===" << std::endl;
     std::cout << "Depth: " << maxDepth << std::endl;
@@ -198,58 +503,179 @@ int main()
     std::cout << "  - Color gradient (brown trunk -> green tips)" << std::endl;
     std::cout << "  - Dynamic rotation speed" << std::endl;
     std::cout << "  - Organic swaying and breathing" << std::endl;
+    if (cache.IsOpen()) {
+        std::cout << "Generator: static tree from " << cachePath
+                  << (cache.WasWritten() ? " (written: " + cache.MissReason() + ")" : " (mapped)");
+    } else if (forest) {
+        std::cout << "Generator: forest of " << forest->TreeCount() << " trees ("
+                  << forest->ShapeCount() << " shapes, " << forest->SegmentCount() << " segments)";
+    } else {
+        std::cout << "Generator: " << generatorModeName(builder.mode);
+        if (builder.mode == PARALLEL) std::cout << " (" << threads << " threads)";
+        if (builder.lodPixels > 0.0) std::cout << " (view culled, " << builder.lodPixels << " px)";
+        if (builder.stochastic) std::cout << " (seed " << builder.variation.seed << ")";
+        if (builder.shapeCache) {
+            std::cout << " through a " << shapeCacheMB << " MB shape cache ("
+                      << (shapeLookup == ShapeCache::NEAREST ? "nearest" : "interpolated") << ")";
+        }
+    }
+    std::cout << std::endl;
+    std::cout << "Render path: " << renderPathName(renderPath) << std::endl;
+    std::cout << "Frame loop: " << (serial ? "serial" : "pipelined") << std::endl;
+    if (budgetMs > 0.0 && !cache.IsOpen() && !forest) {
+        std::cout << "Frame budget: " << budgetMs << " ms (depth " << std::min(minDepth, maxDepth)
+                  << " to " << maxDepth << ")" << std::endl;
+    }
     std::cout << "Close the window to exit." << std::endl << std::endl;
     
-    // Animation variables
-    double time = 0.0;
-    double windPhase = 0.0;
-    double growthPhase = 0.0;
-    double rotationAngle = 0.0;
-    double branchCountPhase = 0.0;
-    double speedPhase = 0.0;
-    
-    // Animation loop
+    FramePlanner planner(baseParams, budgetMs, minDepth, maxDepth);
+    TripleBuffer<TreeFrame> frames;
+    TreeFrame serialFrame;
+    std::atomic<double> drawMs(0.0);
+    std::atomic<bool> stop(false);
+    std::thread producer;
+    if (!cache.IsOpen() && !forest && !serial) {
+        producer = std::thread(produceFrames, std::ref(frames), std::ref(builder),
+                               std::ref(planner), std::cref(drawMs), std::cref(stop));
+    }
+
+    // Statistics over new frames: the interval between them, and the
+    // generation and draw time spent on each
+    const int reportInterval = 300;
+    int framesMeasured = 0;
+    double generateTotal = 0.0;
+    double drawTotal = 0.0;
+    uint64_t shapeHits = 0;
+    uint64_t shapeMisses = 0;
+    uint64_t shapeFallbacks = 0;
+    auto reportStart = std::chrono::steady_clock::now();
+
+    // Clicking a branch prints it; the BVH build shares --threads
+    std::unique_ptr<WorkStealingPool> pickPool;
+    if (threads > 1) {
+        pickPool.reset(new WorkStealingPool(threads));
+    }
+    BranchPicker picker(pickPool.get());
+    const TreeFrame* shown = nullptr;
+
+    // Animation loop; the buffer swap waits for vsync
     while (!canvas.ShouldClose()) {
-        // Update time
-        time += 0.016; // approximately 60 FPS
-        windPhase += 0.02;
-        growthPhase += 0.01;
-        branchCountPhase += 0.005;
-        speedPhase += 0.008;
-        
-        // Create animated parameters
-        TreeParams animParams = baseParams;
-        
-        // Dynamic rotation speed (oscillates between slow and fast)
-        animParams.rotationSpeed = baseParams.rotationSpeed + 0.3 * sin(speedPhase);
-        rotationAngle += animParams.rotationSpeed;
-        
-        // Dynamic branch count (oscillates between 3 and 7)
-        animParams.numBranches = 5 + (int)(2.0 * sin(branchCountPhase));
-        if (animParams.numBranches < 3) animParams.numBranches = 3;
-        if (animParams.numBranches > 7) animParams.numBranches = 7;
-        
-        // Breathing/growing effect
-        double breathe = 0.03 * sin(growthPhase * 0.7);
-        animParams.lambda = baseParams.lambda + breathe;
-        
-        // Swaying - angle variation
-        animParams.angle = baseParams.angle + 5.0 * sin(windPhase * 1.3);
-        
-        // Branch position shimmer
-        animParams.factor = baseParams.factor + 0.05 * sin(time * 0.9);
-        
-        // Additional wobble
-        animParams.angle += 2.0 * sin(time * 2.1);
-        
-        // Draw the tree with current parameters and rotation
-        drawTree(maxDepth, animParams, rotationAngle);
-        
-        // Update display
-        canvas.Update();
-        
-        // Frame rate control
-        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+        bool newFrame = true;
+        double generateMs = 0.0;
+        int depth = maxDepth;
+        if (cache.IsOpen()) {
+            double rotation;
+            planner.animation.Step(planner.clock.Tick(), rotation);
+            canvas.SetRotation(VIEW_TILT, rotation);
+            if (profiler) profiler->AddCount(PROFILE_SEGMENTS, cache.SegmentCount());
+        } else if (forest) {
+            double rotation;
+            double seconds = planner.clock.Tick();
+            forestTime += seconds;
+            planner.animation.Step(seconds, rotation);
+            auto bakeStart = std::chrono::steady_clock::now();
+            forest->Bake(forestTime, forestLines);
+            generateMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - bakeStart).count();
+            canvas.SwapLineBatch(forestLines);
+            canvas.SetRotation(VIEW_TILT, rotation);
+            if (profiler) {
+                profiler->AddTime(PROFILE_GENERATE, generateMs);
+                profiler->AddCount(PROFILE_SEGMENTS, forest->SegmentCount());
+            }
+        } else if (serial) {
+            double rotation;
+            TreeParams animParams = planner.Next(rotation, depth);
+            buildFrame(serialFrame, builder, depth, animParams, rotation);
+            presentFrame(canvas, serialFrame, profiler.get());
+            generateMs = serialFrame.generateMs;
+            shown = &serialFrame;
+        } else if (frames.Acquire()) {
+            presentFrame(canvas, frames.Front(), profiler.get());
+            generateMs = frames.Front().generateMs;
+            depth = frames.Front().depth;
+            shown = &frames.Front();
+        } else {
+            // Generation is behind: show the current frame again
+            newFrame = false;
+        }
+
+        // The shown frame's lines now live in the canvas; its parameters
+        // stay valid until the next frame is acquired
+        double clickX, clickY;
+        if (canvas.TakeClick(clickX, clickY) && shown) {
+            picker.Inspect(canvas, shown->params, shown->depth, clickX, clickY);
+        }
+
+        auto drawStart = std::chrono::steady_clock::now();
+        if (newFrame) {
+            canvas.Update();
+        } else {
+            // Redrawing an old frame is time spent waiting for the
+            // generator, not part of the next frame's draw
+            ProfileScope idle(profiler.get(), PROFILE_IDLE);
+            canvas.SetProfiler(nullptr);
+            canvas.Update();
+            canvas.SetProfiler(profiler.get());
+        }
+        auto drawEnd = std::chrono::steady_clock::now();
+        if (!newFrame) continue;
+        if (profiler) profiler->EndFrame();
+
+        // A serial frame costs generation plus drawing; the pipelined
+        // generator reads the draw time when it reports its next frame.
+        // The vsync wait is not cost, or the budget could never be met.
+        double frameDrawMs = std::chrono::duration<double, std::milli>(drawEnd - drawStart).count();
+        double drawCostMs = frameDrawMs - canvas.PresentMs();
+        if (serial && !cache.IsOpen() && !forest) {
+            planner.Report(serialFrame, generateMs + drawCostMs);
+        }
+        drawMs.store(drawCostMs);
+
+        generateTotal += generateMs;
+        drawTotal += frameDrawMs;
+        if (shown) {
+            shapeHits += shown->shapeCacheHits;
+            shapeMisses += shown->shapeCacheMisses;
+            shapeFallbacks += shown->shapeCacheFallbacks;
+        }
+        if (++framesMeasured == reportInterval) {
+            double elapsed = std::chrono::duration<double, std::milli>(drawEnd - reportStart).count();
+            std::cout << "Average frame time (" << (serial ? "serial" : "pipelined") << ", "
+                      << renderPathName(renderPath) << "): "
+                      << elapsed / framesMeasured << " ms (generate "
+                      << generateTotal / framesMeasured << " ms, draw "
+                      << drawTotal / framesMeasured << " ms, depth " << depth << ")" << std::endl;
+            if (builder.shapeCache && shown) {
+                uint64_t lookups = shapeHits + shapeMisses;
+                std::cout << "Shape cache: " << (lookups ? 100.0 * shapeHits / lookups : 0.0)
+                          << "% of " << lookups << " lookups hit, " << shown->shapeCacheTrees
+                          << " trees in " << shown->shapeCacheBytes / (1024.0 * 1024.0)
+                          << " MB, " << shapeFallbacks << " frames generated exactly" << std::endl;
+            }
+            if (profiler) profiler->PrintSummary(std::cout);
+            framesMeasured = 0;
+            generateTotal = 0.0;
+            drawTotal = 0.0;
+            shapeHits = 0;
+            shapeMisses = 0;
+            shapeFallbacks = 0;
+            reportStart = drawEnd;
+        }
+    }
+
+    stop.store(true);
+    if (producer.joinable()) {
+        producer.join();
+    }
+
+    if (profiler) {
+        if (profiler->Write(profilePath)) {
+            std::cout << "Wrote " << profiler->FrameCount() << " frame records to "
+                      << profilePath << std::endl;
+        } else {
+            std::cerr << "Cannot write " << profilePath << std::endl;
+        }
     }
     
     std::cout << "Tree animation ended. Goodbye!" << std::endl;